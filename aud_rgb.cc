@@ -1,10 +1,15 @@
 /* Audacious-specific visualization plugin code for the RGB lamp. */
 /* Copyright 2013 Boris Gjenero. Released under the MIT license. */
 
+#include <atomic>
+#include <thread>
+#include <string.h>
+#include <semaphore.h>
 #include <glib.h>
 #include <libaudcore/i18n.h>
 #include <libaudcore/plugin.h>
 #include "rgbm.h"
+#include "rgbm_simd.h"
 
 class RGBWaterfall : public VisPlugin
 {
@@ -26,44 +31,173 @@ public:
 
 __attribute__((visibility("default"))) RGBWaterfall aud_plugin_instance;
 
-static double *left_samp = NULL, *right_samp = NULL;;
+/*
+ * Audacious calls render_multi_pcm() from its main thread, so analysis
+ * and display happen in a worker thread instead, and a slow frame can't
+ * stall the player. Blocks are handed over in a triple buffer: the
+ * callback fills back and swaps it with middle, and the worker swaps
+ * middle with front when it holds a new block. Neither side ever waits
+ * for the other, and a slow worker only sees the newest block.
+ */
+
+struct PCMBlock {
+    RGBM_SAMPTYPE left[RGBM_NUMSAMP], right[RGBM_NUMSAMP];
+};
+
+/* Set in middle when it holds a block the worker hasn't taken */
+#define BLOCK_NEW 4
+
+static PCMBlock blocks[3];
+static std::atomic<unsigned int> middle;
+static unsigned int back, front;
+
+static std::thread worker;
+/* Posted for each new block, and when stopping */
+static sem_t wake;
+static std::atomic<bool> stopping;
+
+/* Runs in the main loop, because plugins can't be disabled elsewhere */
+static gboolean disable_plugin(gpointer unused)
+{
+    /* There should be a better way to get current plugin handle. */
+    PluginHandle *ph = aud_plugin_lookup_basename("aud_sdl_rgb");
+    if (ph) aud_plugin_enable(ph, false);
+    return FALSE;
+}
+
+static void worker_run(void)
+{
+    RGBM_SAMPTYPE *left_samp, *right_samp;
+
+    rgbm_get_wave_buffers(&left_samp, &right_samp);
+    for (;;) {
+        unsigned int m;
+
+        while (sem_wait(&wake) < 0);
+        if (stopping.load(std::memory_order_relaxed)) break;
+
+        m = middle.load(std::memory_order_relaxed);
+        if (!(m & BLOCK_NEW)) continue;
+        m = middle.exchange(front, std::memory_order_acq_rel);
+        front = m & ~BLOCK_NEW;
+
+        /* rgbm_render_wave() destroys its input, so copy every time */
+        memcpy(left_samp, blocks[front].left, sizeof(blocks[front].left));
+        memcpy(right_samp, blocks[front].right, sizeof(blocks[front].right));
+        if (!rgbm_render_wave()) {
+            g_idle_add(disable_plugin, NULL);
+            /* Wait for cleanup() */
+            while (!stopping.load(std::memory_order_relaxed))
+                sem_wait(&wake);
+            break;
+        }
+    }
+}
 
 bool RGBWaterfall::init(void)
 {
     bool res;
+    char *wisdom;
 
+    /* Plans are slow to measure, so they are saved for the next time. */
+    wisdom = g_build_filename(g_get_user_cache_dir(),
+                              "colourwaterfall-fftw.wisdom", NULL);
+    rgbm_configure_fft(RGBM_NUMSAMP, RGBM_PLAN_MEASURE, wisdom);
     res = rgbm_init();
-    if (res) rgbm_get_wave_buffers(&left_samp, &right_samp);
-    return res;
+    g_free(wisdom);
+    if (!res) return false;
+
+    back = 0;
+    middle.store(1, std::memory_order_relaxed);
+    front = 2;
+    stopping.store(false, std::memory_order_relaxed);
+    if (sem_init(&wake, 0, 0) != 0) {
+        rgbm_shutdown();
+        return false;
+    }
+    worker = std::thread(worker_run);
+    return true;
 }
 
 void RGBWaterfall::cleanup(void)
 {
+    stopping.store(true, std::memory_order_relaxed);
+    sem_post(&wake);
+    worker.join();
+    sem_destroy(&wake);
     rgbm_shutdown();
 }
 
-void RGBWaterfall::render_multi_pcm(const float * pcm, int channels)
+/*
+ * Channels beyond the first two are mixed in, assuming the usual WAVE
+ * order for each count: front left and right, centre, LFE, then back
+ * and side pairs. L and R go to one side, C to both at -3 dB, B is back
+ * centre at -6 dB, l and r are surround sides at -3 dB, and X is LFE,
+ * which is left out. Channels past the known layouts are ignored.
+ */
+static const char *const layouts[] = {
+    "", "C", "LR", "LRC", "LRlr", "LRClr", "LRCXlr", "LRCXBlr", "LRCXlrlr"
+};
+
+static void downmix(const float * pcm, int channels, PCMBlock * block)
 {
-    int i;
-    if (channels == 1) {
-        for (i = 0; i < RGBM_NUMSAMP; i++) {
-            left_samp[i] = pcm[i];
-            right_samp[i] = pcm[i];
+    static int weights_channels = 0;
+    static float wl[8], wr[8];
+    const char *layout;
+    int i, c, used;
+
+    if (channels != weights_channels) {
+        layout = channels < (int)G_N_ELEMENTS(layouts) ? layouts[channels]
+                                                      : layouts[8];
+        for (c = 0; layout[c] != '\0'; c++) {
+            switch (layout[c]) {
+            case 'L': wl[c] = 1.0f;    wr[c] = 0.0f;    break;
+            case 'R': wl[c] = 0.0f;    wr[c] = 1.0f;    break;
+            case 'C': wl[c] = 0.7071f; wr[c] = 0.7071f; break;
+            case 'B': wl[c] = 0.5f;    wr[c] = 0.5f;    break;
+            case 'l': wl[c] = 0.7071f; wr[c] = 0.0f;    break;
+            case 'r': wl[c] = 0.0f;    wr[c] = 0.7071f; break;
+            default:  wl[c] = 0.0f;    wr[c] = 0.0f;    break;
+            }
         }
-    } else if (channels > 1) {
-        for (i = 0; i < RGBM_NUMSAMP; i++) {
-            left_samp[i] = pcm[i * channels];
-            right_samp[i] = pcm[i * channels + 1];
+        weights_channels = channels;
+    }
+
+    used = channels < 8 ? channels : 8;
+    for (i = 0; i < RGBM_NUMSAMP; i++) {
+        const float *frame = &pcm[i * channels];
+        float l = 0.0f, r = 0.0f;
+
+        for (c = 0; c < used; c++) {
+            l += frame[c] * wl[c];
+            r += frame[c] * wr[c];
         }
+        block->left[i] = RGBM_SAMPLE_FLOAT(l);
+        block->right[i] = RGBM_SAMPLE_FLOAT(r);
+    }
+}
+
+void RGBWaterfall::render_multi_pcm(const float * pcm, int channels)
+{
+    PCMBlock *block = &blocks[back];
+
+    if (channels == 2) {
+        rgbm_deinterleave(pcm, block->left, block->right, RGBM_NUMSAMP);
+    } else if (channels == 1) {
+        for (int i = 0; i < RGBM_NUMSAMP; i++) {
+            block->left[i] = RGBM_SAMPLE_FLOAT(pcm[i]);
+            block->right[i] = RGBM_SAMPLE_FLOAT(pcm[i]);
+        }
+    } else if (channels > 2) {
+        downmix(pcm, channels, block);
     } else {
         return;
     }
 
-    if (!rgbm_render_wave()) {
-        /* There should be a better way to get current plugin handle. */
-        PluginHandle *ph = aud_plugin_lookup_basename("aud_sdl_rgb");
-        if (ph) aud_plugin_enable(ph, false);
-    }
+    /* Publish the block, taking back whichever one the worker left */
+    back = middle.exchange(back | BLOCK_NEW, std::memory_order_acq_rel) &
+           ~BLOCK_NEW;
+    sem_post(&wake);
 }
 
 void RGBWaterfall::clear(void)
@@ -0,0 +1,642 @@
+/* Renders whole audio files to waterfall images using all cores. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+/*
+ * Each worker thread has its own analysis context and renders one track
+ * at a time into an image in memory, which is then written as a binary
+ * PPM. Tracks are sorted longest first and dealt out to per-worker
+ * queues. A worker takes from the front of its own queue, and when that
+ * is empty, steals from the back of another worker's queue, so all
+ * cores stay busy until the last tracks.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "rgbm.h"
+#include "display.h"
+#include "pcmfile.h"
+
+#define BATCH_MAX_WORKERS 256
+/* Initial image rows when the track length is unknown */
+#define BATCH_INITIAL_ROWS 4096
+
+struct batch_job {
+    char *in, *out;
+    /* Offset in in of the path below the directory or list entry it
+     * was found through, which out keeps below out_dir */
+    size_t rel;
+    off_t size;
+};
+
+/* Stripes of one track, as rgb24 rows from top to bottom */
+struct batch_image {
+    unsigned char *rgb;
+    unsigned int width, rows, alloc_rows;
+};
+
+struct batch_worker {
+    pthread_t thread;
+    /* Indices of jobs, with [head, tail) still to be done */
+    pthread_mutex_t lock;
+    unsigned int *queue, head, tail;
+
+    rgbm_ctx *ctx;
+    /* Most recent num_samp frames, like wavefeed */
+    int16_t *window;
+    struct batch_image image;
+
+    unsigned int tracks, failed, stolen;
+    double audio_secs;
+};
+
+static struct batch_job *jobs = NULL;
+static unsigned int num_jobs = 0, alloc_jobs = 0;
+static struct batch_worker *workers;
+static unsigned int num_workers;
+
+static const char *out_dir = NULL;
+static unsigned int width = DISPLAY_WIDTH;
+static unsigned int num_samp = RGBM_NUMSAMP, hop = RGBM_NUMSAMP * 2 / 3;
+static int analysis = RGBM_ANALYSIS_FFT;
+static int plan_effort = RGBM_PLAN_ESTIMATE;
+static const char *wisdom_file = NULL;
+static bool verbose = false;
+
+/*
+ * Image sink
+ */
+
+static bool image_add_row(struct batch_image *img, RGBM_STRIPETYPE **stripe) {
+    unsigned char *p;
+    unsigned int i;
+
+    if (img->rows == img->alloc_rows) {
+        unsigned int n = img->alloc_rows * 2;
+        p = realloc(img->rgb, (size_t)n * img->width * 3);
+        if (p == NULL) return false;
+        img->rgb = p;
+        img->alloc_rows = n;
+    }
+
+    p = &img->rgb[(size_t)img->rows * img->width * 3];
+    for (i = 0; i < img->width; i++) {
+        *(p++) = display_clip(stripe[0][i]);
+        *(p++) = display_clip(stripe[1][i]);
+        *(p++) = display_clip(stripe[2][i]);
+    }
+    img->rows++;
+    return true;
+}
+
+static bool image_write_ppm(const struct batch_image *img, const char *name) {
+    FILE *f = fopen(name, "wb");
+    size_t len = (size_t)img->rows * img->width * 3;
+    bool ok;
+
+    if (f == NULL) {
+        perror(name);
+        return false;
+    }
+    fprintf(f, "P6\n%u %u\n255\n", img->width, img->rows);
+    ok = fwrite(img->rgb, 1, len, f) == len;
+    if (fclose(f) != 0) ok = false;
+    if (!ok) {
+        perror(name);
+        remove(name);
+    }
+    return ok;
+}
+
+/*
+ * Rendering one track
+ */
+
+static bool render_window(struct batch_worker *w) {
+    RGBM_SAMPTYPE *left, *right;
+    unsigned int i;
+
+    /* rgbm_ctx_process_wave() destroys its input, so convert every time */
+    rgbm_ctx_get_wave_buffers(w->ctx, &left, &right);
+    for (i = 0; i < num_samp; i++) {
+        left[i] = RGBM_SAMPLE_S16(w->window[i * 2]);
+        right[i] = RGBM_SAMPLE_S16(w->window[i * 2 + 1]);
+    }
+    return image_add_row(&w->image, rgbm_ctx_process_wave(w->ctx));
+}
+
+/* Sliding DFT after the first row of a track, which started it from the
+ * whole window. Wave buffers are unused, so they hold converted frames. */
+static void push_frames(struct batch_worker *w, const int16_t *frames,
+                        unsigned int count) {
+    RGBM_SAMPTYPE *left, *right;
+    unsigned int i;
+
+    rgbm_ctx_get_wave_buffers(w->ctx, &left, &right);
+    for (i = 0; i < count; i++) {
+        left[i] = RGBM_SAMPLE_S16(frames[i * 2]);
+        right[i] = RGBM_SAMPLE_S16(frames[i * 2 + 1]);
+    }
+    rgbm_ctx_push_samples(w->ctx, left, right, count);
+}
+
+static bool render_track(struct batch_worker *w, const struct batch_job *job) {
+    struct pcmfile *pf;
+    unsigned long total_frames = 0, rows;
+    unsigned int pending = 0;
+    bool ok = true;
+
+    pf = pcmfile_open(job->in, false);
+    if (pf == NULL) return false;
+
+    /* Size the image for the whole track when its length is known */
+    rows = pcmfile_length(pf) / hop + 1;
+    if (pcmfile_length(pf) == 0) rows = BATCH_INITIAL_ROWS;
+    if (rows > w->image.alloc_rows) {
+        unsigned char *p = realloc(w->image.rgb, rows * width * 3);
+        if (p != NULL) {
+            w->image.rgb = p;
+            w->image.alloc_rows = rows;
+        }
+    }
+    w->image.rows = 0;
+    memset(w->window, 0, sizeof(int16_t) * num_samp * 2);
+
+    while (ok) {
+        const int16_t *frames;
+        unsigned int count = pcmfile_read(pf, &frames);
+
+        if (count == 0) break;
+        total_frames += count;
+        /* Same hops as wavefeed_push() */
+        while (ok && count > 0) {
+            unsigned int n = hop - pending;
+            bool slide = analysis == RGBM_ANALYSIS_SDFT && w->image.rows > 0;
+
+            if (n > count) n = count;
+            if (slide) {
+                push_frames(w, frames, n);
+            } else {
+                memmove(&w->window[0], &w->window[n * 2],
+                        (num_samp - n) * 2 * sizeof(int16_t));
+                memcpy(&w->window[(num_samp - n) * 2], frames,
+                       n * 2 * sizeof(int16_t));
+            }
+            frames += n * 2;
+            count -= n;
+            pending += n;
+            if (pending == hop) {
+                pending = 0;
+                ok = slide ? image_add_row(&w->image,
+                                           rgbm_ctx_process_sliding(w->ctx))
+                           : render_window(w);
+            }
+        }
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Error: out of memory rendering %s\n", job->in);
+    } else if (w->image.rows == 0) {
+        fprintf(stderr, "Error: %s is too short to render\n", job->in);
+        ok = false;
+    } else {
+        ok = image_write_ppm(&w->image, job->out);
+    }
+
+    if (ok) {
+        double secs = (double)total_frames / pcmfile_rate(pf);
+
+        w->audio_secs += secs;
+        if (verbose) {
+            fprintf(stderr, "%s: %.1f s, %u rows\n", job->out, secs,
+                    w->image.rows);
+        }
+    }
+    pcmfile_close(pf);
+    return ok;
+}
+
+/*
+ * Work stealing
+ */
+
+/* Returns the next job for worker w, or -1 when no work remains */
+static int take_job(struct batch_worker *w) {
+    unsigned int i;
+    int job = -1;
+
+    pthread_mutex_lock(&w->lock);
+    if (w->head < w->tail) job = w->queue[w->head++];
+    pthread_mutex_unlock(&w->lock);
+    if (job >= 0) return job;
+
+    /* Own queue is empty, so steal. Work is never added, so once all
+     * queues are found empty, everything has been taken. */
+    for (i = 1; i < num_workers && job < 0; i++) {
+        struct batch_worker *v = &workers[(w - workers + i) % num_workers];
+
+        pthread_mutex_lock(&v->lock);
+        if (v->head < v->tail) job = v->queue[--v->tail];
+        pthread_mutex_unlock(&v->lock);
+    }
+    if (job >= 0) w->stolen++;
+    return job;
+}
+
+static void *worker_thread(void *arg) {
+    struct batch_worker *w = arg;
+    int job;
+
+    w->ctx = rgbm_ctx_create(width, num_samp, analysis, plan_effort,
+                             wisdom_file);
+    w->window = malloc(sizeof(int16_t) * num_samp * 2);
+    w->image.width = width;
+    w->image.alloc_rows = BATCH_INITIAL_ROWS;
+    w->image.rgb = malloc((size_t)BATCH_INITIAL_ROWS * width * 3);
+    if (w->ctx == NULL || w->window == NULL || w->image.rgb == NULL) {
+        fprintf(stderr, "Error initializing worker\n");
+        /* Other workers will steal this worker's jobs */
+        return NULL;
+    }
+
+    while ((job = take_job(w)) >= 0) {
+        if (render_track(w, &jobs[job])) {
+            w->tracks++;
+        } else {
+            w->failed++;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Finding tracks
+ */
+
+static bool is_wav(const char *name) {
+    size_t len = strlen(name);
+    return len > 4 && !strcasecmp(name + len - 4, ".wav");
+}
+
+/* Image name is the track name with .ppm instead of the extension,
+ * either beside the track or in out_dir. In out_dir, tracks found in a
+ * directory keep their path below it, so tracks with the same name in
+ * different album directories get different images. */
+static char *image_name(const struct batch_job *job) {
+    const char *in = job->in, *slash = strrchr(in, '/'), *base = in, *dot;
+    size_t len;
+    char *out;
+
+    if (out_dir != NULL) base = in + job->rel;
+    dot = strrchr(base, '.');
+    if (dot == NULL || (slash != NULL && dot < slash)) {
+        dot = base + strlen(base);
+    }
+    len = (out_dir != NULL ? strlen(out_dir) + 1 : 0) + (dot - base) + 5;
+    out = malloc(len);
+    if (out == NULL) return NULL;
+    snprintf(out, len, "%s%s%.*s.ppm", out_dir != NULL ? out_dir : "",
+             out_dir != NULL ? "/" : "", (int)(dot - base), base);
+    return out;
+}
+
+/* Creates the directories of an image name in out_dir */
+static bool make_dirs(char *name) {
+    char *slash;
+
+    for (slash = strchr(name + 1, '/'); slash != NULL;
+         slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        if (mkdir(name, 0777) < 0 && errno != EEXIST) {
+            perror(name);
+            *slash = '/';
+            return false;
+        }
+        *slash = '/';
+    }
+    return true;
+}
+
+static int by_image_name(const void *a, const void *b) {
+    return strcmp((*(const struct batch_job *const *)a)->out,
+                  (*(const struct batch_job *const *)b)->out);
+}
+
+/* Workers could overwrite each other's images if two tracks had the
+ * same image name, so that is an error before rendering starts. */
+static bool check_image_names(void) {
+    const struct batch_job **sorted;
+    unsigned int i;
+    bool ok = true;
+
+    sorted = malloc(sizeof(struct batch_job *) * num_jobs);
+    if (sorted == NULL) return false;
+    for (i = 0; i < num_jobs; i++) sorted[i] = &jobs[i];
+    qsort(sorted, num_jobs, sizeof(struct batch_job *), by_image_name);
+    for (i = 1; i < num_jobs; i++) {
+        if (!strcmp(sorted[i - 1]->out, sorted[i]->out)) {
+            fprintf(stderr, "Error: %s and %s would both be rendered to "
+                            "%s\n", sorted[i - 1]->in, sorted[i]->in,
+                    sorted[i]->out);
+            ok = false;
+        }
+    }
+    free(sorted);
+    return ok;
+}
+
+static bool add_job(const char *name, size_t rel, off_t size) {
+    struct batch_job *job;
+
+    if (num_jobs == alloc_jobs) {
+        unsigned int n = alloc_jobs > 0 ? alloc_jobs * 2 : 256;
+        job = realloc(jobs, n * sizeof(struct batch_job));
+        if (job == NULL) return false;
+        jobs = job;
+        alloc_jobs = n;
+    }
+    job = &jobs[num_jobs];
+    job->in = strdup(name);
+    job->rel = rel;
+    /* Named after all options are known, because -o may follow -l */
+    job->out = NULL;
+    job->size = size;
+    if (job->in == NULL) return false;
+    num_jobs++;
+    return true;
+}
+
+/* Adds a file, or WAV files anywhere under a directory. Rel is the
+ * offset of the part of names kept in image names in out_dir. */
+static bool add_path(const char *name, size_t rel) {
+    struct stat st;
+    DIR *dir;
+    struct dirent *de;
+    bool ok = true;
+
+    if (stat(name, &st) < 0) {
+        perror(name);
+        return false;
+    }
+    if (!S_ISDIR(st.st_mode)) return add_job(name, rel, st.st_size);
+
+    dir = opendir(name);
+    if (dir == NULL) {
+        perror(name);
+        return false;
+    }
+    while (ok && (de = readdir(dir)) != NULL) {
+        size_t len = strlen(name) + strlen(de->d_name) + 2;
+        char *path;
+
+        if (de->d_name[0] == '.') continue;
+        path = malloc(len);
+        if (path == NULL) {
+            ok = false;
+            break;
+        }
+        snprintf(path, len, "%s/%s", name, de->d_name);
+        if (stat(path, &st) == 0 &&
+            (S_ISDIR(st.st_mode) || is_wav(de->d_name))) {
+            ok = add_path(path, rel);
+        }
+        free(path);
+    }
+    closedir(dir);
+    return ok;
+}
+
+/* Adds a file or directory named on the command line or in a list.
+ * Only the names of files are kept in image names in out_dir, but
+ * tracks found in directories keep their path below the directory. */
+static bool add_arg(const char *name) {
+    const char *slash = strrchr(name, '/');
+    struct stat st;
+
+    if (stat(name, &st) < 0) {
+        perror(name);
+        return false;
+    }
+    if (S_ISDIR(st.st_mode)) return add_path(name, strlen(name) + 1);
+    return add_path(name, slash != NULL ? slash + 1 - name : 0);
+}
+
+/* Adds tracks named one per line in a file, or standard input for - */
+static bool add_list(const char *name) {
+    FILE *f = strcmp(name, "-") ? fopen(name, "r") : stdin;
+    char line[4096];
+    bool ok = true;
+
+    if (f == NULL) {
+        perror(name);
+        return false;
+    }
+    while (ok && fgets(line, sizeof(line), f) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] != '\0') ok = add_arg(line);
+    }
+    if (f != stdin) fclose(f);
+    return ok;
+}
+
+static int longest_first(const void *a, const void *b) {
+    off_t sa = ((const struct batch_job *)a)->size;
+    off_t sb = ((const struct batch_job *)b)->size;
+    return (sa < sb) - (sa > sb);
+}
+
+/*
+ * Main
+ */
+
+static double elapsed(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) +
+           (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [options] file_or_directory...\n"
+                    "Renders WAV files to waterfall images in PPM format, "
+                    "one row per hop.\n"
+                    "Directories are searched for .wav files.\n"
+                    "Options:\n"
+                    "  -l file    also render tracks listed one per line, "
+                    "- for standard input\n"
+                    "  -o dir     write images to dir instead of beside "
+                    "the tracks, keeping\n"
+                    "             paths below directories which were "
+                    "searched\n"
+                    "  -j count   worker threads, 1 to %u (default one per "
+                    "core)\n"
+                    "  -W pixels  image width (default %u)\n"
+                    "  -H frames  frames between rows, up to FFT size "
+                    "(default 2/3 of FFT size)\n"
+                    "  -N size    FFT size, %u to %u (default %u)\n"
+                    "  -A type    analysis: fft, cq for constant-Q, "
+                    "best with -N 8192,\n"
+                    "             or sdft for sliding DFT, best with "
+                    "small -H\n"
+                    "  -p effort  FFTW planning: estimate, measure or "
+                    "patient (default estimate)\n"
+                    "  -w file    FFTW wisdom file\n"
+                    "  -v         report each track\n",
+            name, BATCH_MAX_WORKERS, DISPLAY_WIDTH, RGBM_MIN_NUMSAMP,
+            RGBM_MAX_NUMSAMP, RGBM_NUMSAMP);
+    exit(-1);
+}
+
+int main(int argc, char **argv) {
+    static const char *efforts[] = { "estimate", "measure", "patient" };
+    static const char *analyses[] = { "fft", "cq", "sdft" };
+    struct timespec start;
+    unsigned int i, tracks = 0, failed = 0, stolen = 0;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    double audio_secs = 0.0, secs;
+    bool hop_set = false;
+    int opt;
+
+    num_workers = cores > 0 ? cores : 1;
+    while ((opt = getopt(argc, argv, "l:o:j:W:H:N:A:p:w:v")) != -1) {
+        switch (opt) {
+        case 'l':
+            if (!add_list(optarg)) return -1;
+            break;
+        case 'o':
+            out_dir = optarg;
+            break;
+        case 'j':
+            num_workers = atoi(optarg);
+            if (num_workers < 1 || num_workers > BATCH_MAX_WORKERS)
+                usage(argv[0]);
+            break;
+        case 'W':
+            width = atoi(optarg);
+            if (width < 1) usage(argv[0]);
+            break;
+        case 'H':
+            hop = atoi(optarg);
+            if (hop < 1) usage(argv[0]);
+            hop_set = true;
+            break;
+        case 'N':
+            num_samp = atoi(optarg);
+            if (num_samp < RGBM_MIN_NUMSAMP || num_samp > RGBM_MAX_NUMSAMP)
+                usage(argv[0]);
+            break;
+        case 'A':
+            for (analysis = RGBM_ANALYSIS_SDFT; analysis >= RGBM_ANALYSIS_FFT;
+                 analysis--) {
+                if (!strcmp(optarg, analyses[analysis])) break;
+            }
+            if (analysis < RGBM_ANALYSIS_FFT) usage(argv[0]);
+            break;
+        case 'p':
+            for (plan_effort = RGBM_PLAN_PATIENT;
+                 plan_effort >= RGBM_PLAN_ESTIMATE; plan_effort--) {
+                if (!strcmp(optarg, efforts[plan_effort])) break;
+            }
+            if (plan_effort < RGBM_PLAN_ESTIMATE) usage(argv[0]);
+            break;
+        case 'w':
+            wisdom_file = optarg;
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (!hop_set) hop = num_samp * 2 / 3;
+    if (hop > num_samp) usage(argv[0]);
+    if (optind == argc && num_jobs == 0) usage(argv[0]);
+    for (i = optind; i < argc; i++) {
+        if (!add_arg(argv[i])) return -1;
+    }
+    if (num_jobs == 0) {
+        fprintf(stderr, "Error: no tracks found\n");
+        return -1;
+    }
+    for (i = 0; i < num_jobs; i++) {
+        jobs[i].out = image_name(&jobs[i]);
+        if (jobs[i].out == NULL) return -1;
+    }
+    if (!check_image_names()) return -1;
+    for (i = 0; out_dir != NULL && i < num_jobs; i++) {
+        if (!make_dirs(jobs[i].out)) return -1;
+    }
+
+    /* Deal longest tracks first, so short ones fill in at the end */
+    qsort(jobs, num_jobs, sizeof(struct batch_job), longest_first);
+    if (num_workers > num_jobs) num_workers = num_jobs;
+    workers = calloc(num_workers, sizeof(struct batch_worker));
+    if (workers == NULL) return -1;
+    for (i = 0; i < num_workers; i++) {
+        workers[i].queue = malloc(sizeof(unsigned int) *
+                                  (num_jobs / num_workers + 1));
+        if (workers[i].queue == NULL) return -1;
+        pthread_mutex_init(&workers[i].lock, NULL);
+    }
+    for (i = 0; i < num_jobs; i++) {
+        struct batch_worker *w = &workers[i % num_workers];
+        w->queue[w->tail++] = i;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < num_workers; i++) {
+        if (pthread_create(&workers[i].thread, NULL, worker_thread,
+                           &workers[i]) != 0) {
+            fprintf(stderr, "Error creating worker thread\n");
+            return -1;
+        }
+    }
+    for (i = 0; i < num_workers; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    secs = elapsed(&start);
+
+    /* Queues may be used by any worker until all have finished */
+    for (i = 0; i < num_workers; i++) {
+        struct batch_worker *w = &workers[i];
+
+        tracks += w->tracks;
+        failed += w->failed;
+        stolen += w->stolen;
+        audio_secs += w->audio_secs;
+        if (w->ctx != NULL) rgbm_ctx_destroy(w->ctx);
+        free(w->window);
+        free(w->image.rgb);
+        free(w->queue);
+        pthread_mutex_destroy(&w->lock);
+    }
+
+    fprintf(stderr, "Rendered %u tracks, %.3f h of audio, in %.2f s with "
+            "%u workers (%u tracks stolen)\n"
+            "%.2f tracks/s, %.3f audio-hours/s\n",
+            tracks, audio_secs / 3600, secs, num_workers, stolen,
+            secs > 0 ? tracks / secs : 0.0,
+            secs > 0 ? audio_secs / 3600 / secs : 0.0);
+    if (tracks + failed < num_jobs) {
+        fprintf(stderr, "Error: %u tracks were not rendered\n",
+                num_jobs - tracks - failed);
+    }
+
+    for (i = 0; i < num_jobs; i++) {
+        free(jobs[i].in);
+        free(jobs[i].out);
+    }
+    free(jobs);
+    free(workers);
+    return failed > 0 || tracks < num_jobs ? 1 : 0;
+}
@@ -0,0 +1,733 @@
+/* Per-stage benchmark for the colour waterfall pipeline. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+/* The stages are internal to rgbm.c, or rgbm_fixed.c with RGBM_FIXED,
+ * so it is included directly. RGBM_BENCH also compiles in alternatives
+ * that are compared here. */
+#define RGBM_BENCH
+#ifdef RGBM_FIXED
+#include "rgbm_fixed.c"
+#else
+#include "rgbm.c"
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <SDL.h>
+#include "display.h"
+
+#define BENCH_RATE 44100
+
+static rgbm_ctx *ctx;
+/* New samples per frame. By default, the same overlap as for live input. */
+static unsigned int hop;
+
+enum bench_stage {
+    STAGE_WINDOW,
+    STAGE_FFT,
+    STAGE_TO_REAL,
+    STAGE_SUM,
+    STAGE_SQRT,
+    STAGE_PEAKIFY,
+    STAGE_DISPLAY,
+    STAGE_TOTAL,
+    NUM_STAGES
+};
+
+static const char *stage_names[NUM_STAGES] = {
+    "fft_pack_window",
+    "fftw_execute",
+    "fft_split_magnitude",
+    "sum_to_stripe",
+    "sqrt_stripe",
+    "peakify_stripe",
+    "display_render",
+    "total"
+};
+
+/*
+ * Synthetic sources. Each generates one new stereo sample per call,
+ * with t counting samples from the start.
+ */
+
+/* Logarithmic sweep from 20 Hz to 20 kHz every 10 seconds.
+ * Right side is quieter, so energy is not centered. */
+static void gen_sweep(unsigned long t, double *l, double *r) {
+    static double phase = 0;
+    double period = 10.0 * BENCH_RATE;
+    double frac = fmod(t, period) / period;
+    double freq = 20.0 * pow(1000.0, frac);
+
+    phase += 2 * M_PI * freq / BENCH_RATE;
+    if (phase > 2 * M_PI) phase -= 2 * M_PI;
+    *l = 0.5 * sin(phase);
+    *r = 0.25 * sin(phase);
+}
+
+/* Paul Kellet's economy pink noise filter, applied to independent
+ * white noise on each side. */
+static double pink_filter(double b[3], double white) {
+    b[0] = 0.99765 * b[0] + white * 0.0990460;
+    b[1] = 0.96300 * b[1] + white * 0.2965164;
+    b[2] = 0.57000 * b[2] + white * 1.0526913;
+    return (b[0] + b[1] + b[2] + white * 0.1848) * 0.05;
+}
+
+static void gen_pink(unsigned long t, double *l, double *r) {
+    static double bl[3], br[3];
+    static uint32_t seed = 12345;
+
+    seed = seed * 1664525 + 1013904223;
+    *l = pink_filter(bl, (double)seed / 2147483648.0 - 1.0);
+    seed = seed * 1664525 + 1013904223;
+    *r = pink_filter(br, (double)seed / 2147483648.0 - 1.0);
+}
+
+/* Full-scale 1 kHz square wave, which saturates many pixels */
+static void gen_square(unsigned long t, double *l, double *r) {
+    *l = *r = ((t * 2000 / BENCH_RATE) & 1) ? -1.0 : 32767.0 / 32768.0;
+}
+
+static void gen_silence(unsigned long t, double *l, double *r) {
+    *l = *r = 0.0;
+}
+
+struct bench_source {
+    const char *name;
+    void (*gen)(unsigned long t, double *l, double *r);
+    /* Same level in both channels, so every bin's balance is on a pixel
+     * boundary and colour levels aren't checked against the bound */
+    bool balanced;
+};
+
+static const struct bench_source sources[] = {
+    { "sweep", gen_sweep, false },
+    { "pink", gen_pink, false },
+    { "square", gen_square, true },
+    { "silence", gen_silence, true },
+    { NULL, NULL, false }
+};
+
+/*
+ * Comparison between engines. With -d, the bins and colour levels of
+ * every frame are written to a file, and with -c, a build of the other
+ * engine compares its own with them. "make check-fixed" uses this to
+ * check rgbm_fixed.c against the double precision engine.
+ */
+
+/* Bounds documented in rgbm_fixed.c: the largest difference between
+ * bins, and the least share of colour components of a source that isn't
+ * balanced which may differ by more than 1 level. */
+#define CHECK_MAX_BIN_ERROR (4.0 / 65536)
+#define CHECK_MIN_WITHIN_1 0.985
+
+struct check_header {
+    uint32_t numsamp, hop, frames, bins, width;
+};
+
+static FILE *dump_file, *compare_file;
+static double *check_bins, *other_bins;
+static unsigned char *check_levels, *other_levels;
+
+struct check_stats {
+    double max_bin_error;
+    /* Compared colour components differing by 0, 1 and more levels */
+    unsigned long level_diffs[3];
+    unsigned int max_level_diff;
+};
+
+static struct check_stats check_stats[sizeof(sources) / sizeof(sources[0])];
+
+static int16_t pcm16(double d) {
+    if (d >= 32767.0 / 32768.0) return 32767;
+    if (d <= -1.0) return -32768;
+    return (int16_t)floor(d * 32768.0 + 0.5);
+}
+
+static double bin_value(RGBM_BINTYPE b) {
+#ifdef RGBM_FIXED
+    return (double)b / (1 << RGBM_BIN_FRAC_BITS);
+#else
+    return b;
+#endif
+}
+
+/* Writes the dump header or checks it against the compared dump, so
+ * dumps from different settings aren't compared. Returns false on error. */
+static bool check_start(unsigned int frames) {
+    struct check_header h, other;
+    unsigned int bins = ctx->use_bins, width = ctx->width;
+
+    h.numsamp = ctx->num_samp;
+    h.hop = hop;
+    h.frames = frames;
+    h.bins = bins;
+    h.width = width;
+    check_bins = malloc(sizeof(double) * 2 * bins);
+    other_bins = malloc(sizeof(double) * 2 * bins);
+    check_levels = malloc(3 * width);
+    other_levels = malloc(3 * width);
+    if (check_bins == NULL || other_bins == NULL ||
+        check_levels == NULL || other_levels == NULL) {
+        fprintf(stderr, "Error allocating memory\n");
+        return false;
+    }
+
+    if (dump_file != NULL && fwrite(&h, sizeof(h), 1, dump_file) != 1) {
+        perror("Error writing dump");
+        return false;
+    }
+    if (compare_file != NULL) {
+        if (fread(&other, sizeof(other), 1, compare_file) != 1) {
+            fprintf(stderr, "Error reading dump header\n");
+            return false;
+        }
+        if (memcmp(&h, &other, sizeof(h))) {
+            fprintf(stderr, "Dump is from different settings: FFT size %u, "
+                            "hop %u, %u frames, %u bins, width %u\n",
+                    other.numsamp, other.hop, other.frames, other.bins,
+                    other.width);
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Dumps and/or compares the bins and colour levels of the current frame,
+ * adding the comparison to st. Returns false on error. */
+static bool check_frame(RGBM_STRIPETYPE **stripe, struct check_stats *st) {
+    unsigned int bins = ctx->use_bins, width = ctx->width, i, j;
+
+    for (i = 0; i < bins; i++) {
+        check_bins[i] = bin_value(ctx->fft_bins_l[i]);
+        check_bins[bins + i] = bin_value(ctx->fft_bins_r[i]);
+    }
+    for (j = 0; j < 3; j++) {
+        for (i = 0; i < width; i++) {
+            check_levels[j * width + i] = display_clip(stripe[j][i]);
+        }
+    }
+
+    if (dump_file != NULL &&
+        (fwrite(check_bins, sizeof(double), 2 * bins, dump_file) !=
+             2 * bins ||
+         fwrite(check_levels, 1, 3 * width, dump_file) != 3 * width)) {
+        perror("Error writing dump");
+        return false;
+    }
+    if (compare_file == NULL) return true;
+
+    if (fread(other_bins, sizeof(double), 2 * bins, compare_file) !=
+            2 * bins ||
+        fread(other_levels, 1, 3 * width, compare_file) != 3 * width) {
+        fprintf(stderr, "Dump ended early\n");
+        return false;
+    }
+    for (i = 0; i < 2 * bins; i++) {
+        double err = fabs(check_bins[i] - other_bins[i]);
+        if (err > st->max_bin_error) st->max_bin_error = err;
+    }
+    for (i = 0; i < 3 * width; i++) {
+        unsigned int diff = abs(check_levels[i] - other_levels[i]);
+        st->level_diffs[diff < 2 ? diff : 2]++;
+        if (diff > st->max_level_diff) st->max_level_diff = diff;
+    }
+    return true;
+}
+
+/* Reports the comparison of each source. Returns false if a bound is
+ * exceeded. */
+static bool check_report(void) {
+    bool ok = true;
+    int s;
+
+    printf("%-8s %14s %11s %11s %9s\n", "source", "max_bin_2^-16",
+           "equal_%", "within_1_%", "max_diff");
+    for (s = 0; sources[s].name != NULL; s++) {
+        const struct check_stats *st = &check_stats[s];
+        unsigned long total = st->level_diffs[0] + st->level_diffs[1] +
+                              st->level_diffs[2];
+        double within_1;
+        bool src_ok;
+
+        if (total == 0) continue;
+        within_1 = (double)(st->level_diffs[0] + st->level_diffs[1]) / total;
+        src_ok = st->max_bin_error <= CHECK_MAX_BIN_ERROR &&
+                 (sources[s].balanced || within_1 >= CHECK_MIN_WITHIN_1);
+        printf("%-8s %14.2f %11.3f %11.3f %9u%s\n", sources[s].name,
+               st->max_bin_error * 65536,
+               100.0 * st->level_diffs[0] / total, 100 * within_1,
+               st->max_level_diff, src_ok ? "" : "  FAILED");
+        if (!src_ok) ok = false;
+    }
+    if (!ok) {
+        printf("Bins may differ by %.0f * 2^-16, and at least %.1f%% of "
+               "colour components\nmay differ by at most 1 level\n",
+               CHECK_MAX_BIN_ERROR * 65536, CHECK_MIN_WITHIN_1 * 100);
+    }
+    return ok;
+}
+
+/*
+ * Timing
+ */
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const uint64_t *sorted, unsigned int n,
+                           double p) {
+    unsigned int i = p * (n - 1) + 0.5;
+    return sorted[i];
+}
+
+/* Runs one source through the pipeline, recording per-stage times.
+ * Returns false if dumping or comparing failed. */
+static bool bench_source(const struct bench_source *src,
+                         unsigned int frames,
+                         uint64_t *times[NUM_STAGES]) {
+    static double left_win[RGBM_MAX_NUMSAMP], right_win[RGBM_MAX_NUMSAMP];
+    unsigned long t = 0;
+    unsigned int f, i, width;
+    RGBM_STRIPETYPE **stripe;
+
+    width = ctx->width;
+    stripe = ctx->stripe;
+    memset(left_win, 0, sizeof(left_win));
+    memset(right_win, 0, sizeof(right_win));
+
+    for (f = 0; f < frames; f++) {
+        uint64_t t0, t1;
+        int s;
+
+        /* Slide window and generate new samples, untimed */
+        memmove(&left_win[0], &left_win[hop],
+                sizeof(double) * (ctx->num_samp - hop));
+        memmove(&right_win[0], &right_win[hop],
+                sizeof(double) * (ctx->num_samp - hop));
+        for (i = ctx->num_samp - hop; i < ctx->num_samp; i++) {
+            src->gen(t++, &left_win[i], &right_win[i]);
+        }
+        if (dump_file != NULL || compare_file != NULL) {
+            /* Both engines get the same 16-bit samples, as from a file,
+             * so only their arithmetic is compared */
+            for (i = 0; i < ctx->num_samp; i++) {
+                ctx->fft_in_l[i] = RGBM_SAMPLE_S16(pcm16(left_win[i]));
+                ctx->fft_in_r[i] = RGBM_SAMPLE_S16(pcm16(right_win[i]));
+            }
+        } else {
+            for (i = 0; i < ctx->num_samp; i++) {
+                ctx->fft_in_l[i] = RGBM_SAMPLE_FLOAT(left_win[i]);
+                ctx->fft_in_r[i] = RGBM_SAMPLE_FLOAT(right_win[i]);
+            }
+        }
+
+#ifndef RGBM_FIXED
+        if (ctx->analysis == RGBM_ANALYSIS_SDFT) {
+            /* Only new samples, as in rgbm_ctx_push_samples() */
+            const RGBM_SAMPTYPE *l = &ctx->fft_in_l[ctx->num_samp - hop];
+            const RGBM_SAMPTYPE *r = &ctx->fft_in_r[ctx->num_samp - hop];
+            unsigned int count = hop, n;
+
+            times[STAGE_WINDOW][f] = 0;
+            times[STAGE_FFT][f] = 0;
+            while (count > 0 || ctx->sdft_until_resync == 0) {
+                t0 = now_ns();
+                if (ctx->sdft_until_resync == 0) sdft_resync(ctx);
+                t1 = now_ns();
+                times[STAGE_FFT][f] += t1 - t0;
+                n = sdft_update(ctx, l, r, count);
+                times[STAGE_WINDOW][f] += now_ns() - t1;
+                l += n;
+                r += n;
+                count -= n;
+            }
+
+            t0 = now_ns();
+            sdft_window_bins(ctx);
+            t1 = now_ns();
+            times[STAGE_TO_REAL][f] = t1 - t0;
+        } else
+#endif
+        {
+            t0 = now_ns();
+            fft_pack_window(ctx);
+            t1 = now_ns();
+            times[STAGE_WINDOW][f] = t1 - t0;
+
+            t0 = t1;
+#ifdef RGBM_FIXED
+            fft_execute(ctx);
+#else
+            FFTW(execute)(ctx->fft_plan);
+#endif
+            t1 = now_ns();
+            times[STAGE_FFT][f] = t1 - t0;
+
+            t0 = t1;
+            fft_to_bins(ctx);
+            t1 = now_ns();
+            times[STAGE_TO_REAL][f] = t1 - t0;
+        }
+
+        t0 = t1;
+#ifdef RGBM_FIXED
+        memset(ctx->acc, 0, sizeof(uint64_t) * 3 * width);
+        sum_to_stripe(ctx, ctx->fft_bins_l, ctx->fft_bins_r, width);
+#else
+        zero_stripe(stripe, width);
+        sum_to_stripe(ctx, ctx->fft_bins_l, ctx->fft_bins_r, stripe, width);
+#endif
+        t1 = now_ns();
+        times[STAGE_SUM][f] = t1 - t0;
+
+        t0 = t1;
+#ifdef RGBM_FIXED
+        sqrt_stripe(ctx, stripe, width);
+#else
+        sqrt_stripe(stripe, width);
+#endif
+        t1 = now_ns();
+        times[STAGE_SQRT][f] = t1 - t0;
+
+        t0 = t1;
+        peakify_stripe(ctx, stripe, width);
+        t1 = now_ns();
+        times[STAGE_PEAKIFY][f] = t1 - t0;
+
+        if ((dump_file != NULL || compare_file != NULL) &&
+            !check_frame(stripe, &check_stats[src - sources])) {
+            return false;
+        }
+        t1 = now_ns();
+
+        t0 = t1;
+        display_render(stripe[0], stripe[1], stripe[2]);
+        t1 = now_ns();
+        times[STAGE_DISPLAY][f] = t1 - t0;
+
+        times[STAGE_TOTAL][f] = 0;
+        for (s = 0; s < STAGE_TOTAL; s++) {
+            times[STAGE_TOTAL][f] += times[s][f];
+        }
+    }
+    return true;
+}
+
+static void report_stage(FILE *csv, const char *label, const char *source,
+                         const char *stage, unsigned int frames,
+                         uint64_t *times) {
+    uint64_t sum = 0, p50, p90, p99, max;
+    double mean;
+    unsigned int f;
+
+    for (f = 0; f < frames; f++) sum += times[f];
+    mean = (double)sum / frames;
+    qsort(times, frames, sizeof(uint64_t), cmp_u64);
+    p50 = percentile(times, frames, 0.50);
+    p90 = percentile(times, frames, 0.90);
+    p99 = percentile(times, frames, 0.99);
+    max = times[frames - 1];
+
+    printf("%-8s %-20s %10.0f %9lu %9lu %9lu %9lu %12.0f\n",
+           source, stage, mean, (unsigned long)p50,
+           (unsigned long)p90, (unsigned long)p99, (unsigned long)max,
+           mean > 0 ? 1e9 / mean : 0.0);
+    if (csv != NULL) {
+        fprintf(csv, "%s,%s,%s,%u,%.1f,%lu,%lu,%lu,%lu,%.1f\n",
+                label, source, stage, frames, mean,
+                (unsigned long)p50, (unsigned long)p90,
+                (unsigned long)p99, (unsigned long)max,
+                mean > 0 ? 1e9 / mean : 0.0);
+    }
+}
+
+static void report(FILE *csv, const char *label, const char *source,
+                   unsigned int frames, uint64_t *times[NUM_STAGES]) {
+    int s;
+
+    for (s = 0; s < NUM_STAGES; s++) {
+        report_stage(csv, label, source, stage_names[s], frames, times[s]);
+    }
+}
+
+/*
+ * Worst case for peakify: every pixel is far above the limit, so each
+ * one pushes energy left across all previous saturated pixels. The
+ * original walk is quadratic in width here, while the linear version
+ * should take the same time per pixel at every width.
+ */
+
+#define SATURATED_MAX_FRAMES 200
+
+static const unsigned int saturated_widths[] = { 320, 640, 1280, 2560, 0 };
+
+static void fill_saturated(RGBM_STRIPETYPE **stripe, unsigned int width,
+                           unsigned int f) {
+    unsigned int i;
+
+    for (i = 0; i < width; i++) {
+        stripe[0][i] = (4000 + (i * 7 + f) % 1000) * RGBM_STRIPE_ONE;
+        stripe[1][i] = (3000 + (i * 13 + f) % 1000) * RGBM_STRIPE_ONE;
+        stripe[2][i] = (2000 + (i * 17 + f) % 1000) * RGBM_STRIPE_ONE;
+    }
+}
+
+static void bench_peakify_walk(RGBM_STRIPETYPE **stripe,
+                               unsigned int width) {
+    peakify_stripe_walk(stripe, width);
+}
+
+static void bench_peakify_linear(RGBM_STRIPETYPE **stripe,
+                                 unsigned int width) {
+    peakify_stripe_linear(ctx, stripe, width);
+}
+
+static void bench_saturated(FILE *csv, const char *label,
+                            unsigned int frames, uint64_t *times) {
+    static const struct {
+        const char *name;
+        void (*peakify)(RGBM_STRIPETYPE **stripe, unsigned int width);
+    } algs[] = {
+        { "peakify_walk", bench_peakify_walk },
+        { "peakify_linear", bench_peakify_linear },
+        { NULL, NULL }
+    };
+    const unsigned int *w;
+    unsigned int f, a;
+    char source[32];
+
+    if (frames > SATURATED_MAX_FRAMES) frames = SATURATED_MAX_FRAMES;
+
+    for (w = saturated_widths; *w != 0; w++) {
+        RGBM_STRIPETYPE *alloc, *stripe[3];
+
+        alloc = malloc(sizeof(RGBM_STRIPETYPE) * 3 * *w);
+        if (alloc == NULL) break;
+        stripe[0] = alloc;
+        stripe[1] = &alloc[*w];
+        stripe[2] = &alloc[*w * 2];
+        snprintf(source, sizeof(source), "sat%u", *w);
+        for (a = 0; algs[a].name != NULL; a++) {
+            for (f = 0; f < frames; f++) {
+                uint64_t t0;
+
+                fill_saturated(stripe, *w, f);
+                t0 = now_ns();
+                algs[a].peakify(stripe, *w);
+                times[f] = now_ns() - t0;
+            }
+            report_stage(csv, label, source, algs[a].name, frames, times);
+        }
+        free(alloc);
+    }
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-n frames] [-s source] [-o csv_file] "
+                    "[-l label] [-N fft_size] [-A analysis]\n"
+                    "       [-H hop] [-p effort] [-w wisdom_file] "
+                    "[-D sinks]\n"
+                    "       [-d dump_file | -c compare_file]\n"
+                    "Analysis: fft, cq or sdft (default fft)\n"
+                    "Hop: new samples per frame, up to fft_size "
+                    "(default 2/3 of fft_size)\n"
+                    "Sources: sweep, pink, square, silence, saturated "
+                    "(default all)\n"
+                    "Effort: estimate, measure or patient "
+                    "(default estimate)\n"
+                    "Sinks: sdl, null, raw:file, shm[:name], "
+                    "led[:dest[@count]], rec:file\n"
+                    "       or net[:host:port[@stripes]], comma separated "
+                    "(default sdl)\n"
+                    "Dump: writes bins and colour levels of every frame\n"
+                    "Compare: compares them with a dump from the other "
+                    "engine, failing\n"
+                    "         if they differ by more than documented for "
+                    "fixed point\n",
+            name);
+    exit(-1);
+}
+
+int main(int argc, char **argv) {
+    static const char *efforts[] = { "estimate", "measure", "patient" };
+    static const char *analyses[] = { "fft", "cq", "sdft" };
+    unsigned int frames = 5000, numsamp = RGBM_NUMSAMP;
+    int effort = RGBM_PLAN_ESTIMATE, analysis = RGBM_ANALYSIS_FFT;
+    const char *only = NULL, *csvname = NULL, *label = "default";
+    const char *wisdom = NULL, *dumpname = NULL, *comparename = NULL;
+    const struct bench_source *src;
+    uint64_t *times[NUM_STAGES];
+    FILE *csv = NULL;
+    bool ok = true;
+    int opt, s;
+
+    while ((opt = getopt(argc, argv, "n:s:o:l:N:A:H:p:w:D:d:c:")) != -1) {
+        switch (opt) {
+        case 'n':
+            frames = atoi(optarg);
+            if (frames == 0) usage(argv[0]);
+            break;
+        case 's':
+            only = optarg;
+            break;
+        case 'o':
+            csvname = optarg;
+            break;
+        case 'l':
+            label = optarg;
+            break;
+        case 'N':
+            numsamp = atoi(optarg);
+            break;
+        case 'A':
+            for (analysis = RGBM_ANALYSIS_SDFT; analysis >= RGBM_ANALYSIS_FFT;
+                 analysis--) {
+                if (!strcmp(optarg, analyses[analysis])) break;
+            }
+            if (analysis < RGBM_ANALYSIS_FFT) usage(argv[0]);
+            break;
+        case 'H':
+            hop = atoi(optarg);
+            if (hop == 0) usage(argv[0]);
+            break;
+        case 'p':
+            for (effort = RGBM_PLAN_PATIENT; effort >= RGBM_PLAN_ESTIMATE;
+                 effort--) {
+                if (!strcmp(optarg, efforts[effort])) break;
+            }
+            if (effort < RGBM_PLAN_ESTIMATE) usage(argv[0]);
+            break;
+        case 'w':
+            wisdom = optarg;
+            break;
+        case 'D':
+            if (!display_configure(optarg)) usage(argv[0]);
+            break;
+        case 'd':
+            dumpname = optarg;
+            break;
+        case 'c':
+            comparename = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    /* Render to an off-screen surface unless told otherwise */
+    if (getenv("SDL_VIDEODRIVER") == NULL) {
+        SDL_putenv("SDL_VIDEODRIVER=dummy");
+    }
+
+    if (numsamp < RGBM_MIN_NUMSAMP || numsamp > RGBM_MAX_NUMSAMP)
+        usage(argv[0]);
+    if (hop == 0) hop = numsamp * 2 / 3;
+    if (hop > numsamp) usage(argv[0]);
+    if (dumpname != NULL && comparename != NULL) usage(argv[0]);
+    /* Stages are timed from this thread, so display here too */
+    if (!display_init()) {
+        fprintf(stderr, "Error initializing display\n");
+        return -1;
+    }
+    ctx = rgbm_ctx_create(display_width(), numsamp, analysis, effort,
+                          wisdom);
+    if (ctx == NULL) {
+        fprintf(stderr, "Error initializing visualization\n");
+        return -1;
+    }
+#ifdef RGBM_FIXED
+    stage_names[STAGE_FFT] = "fft_execute";
+    stage_names[STAGE_TO_REAL] = "fft_to_bins";
+#endif
+    if (analysis == RGBM_ANALYSIS_CQ) {
+        stage_names[STAGE_TO_REAL] = "cq_apply_kernels";
+    } else if (analysis == RGBM_ANALYSIS_SDFT) {
+        stage_names[STAGE_WINDOW] = "sdft_update";
+        stage_names[STAGE_FFT] = "sdft_resync";
+        stage_names[STAGE_TO_REAL] = "sdft_window_bins";
+    }
+#ifdef RGBM_FIXED
+    printf("Kernels: %s, fixed point\n", rgbm_simd_init());
+#else
+    printf("Kernels: %s, %s precision\n", rgbm_simd_init(),
+           sizeof(RGBM_SAMPTYPE) == sizeof(float) ? "single" : "double");
+#endif
+
+    if (csvname != NULL) {
+        csv = fopen(csvname, "w");
+        if (csv == NULL) {
+            perror(csvname);
+            return -1;
+        }
+        fprintf(csv, "label,source,stage,frames,mean_ns,p50_ns,p90_ns,"
+                     "p99_ns,max_ns,frames_per_s\n");
+    }
+    if (dumpname != NULL) {
+        dump_file = fopen(dumpname, "wb");
+        if (dump_file == NULL) {
+            perror(dumpname);
+            return -1;
+        }
+    }
+    if (comparename != NULL) {
+        compare_file = fopen(comparename, "rb");
+        if (compare_file == NULL) {
+            perror(comparename);
+            return -1;
+        }
+    }
+    if ((dump_file != NULL || compare_file != NULL) && !check_start(frames))
+        return -1;
+
+    for (s = 0; s < NUM_STAGES; s++) {
+        times[s] = malloc(sizeof(uint64_t) * frames);
+        if (times[s] == NULL) {
+            fprintf(stderr, "Error allocating memory\n");
+            return -1;
+        }
+    }
+
+    printf("%-8s %-20s %10s %9s %9s %9s %9s %12s\n", "source", "stage",
+           "mean_ns", "p50_ns", "p90_ns", "p99_ns", "max_ns", "frames/s");
+    for (src = sources; src->name != NULL; src++) {
+        if (only != NULL && strcmp(only, src->name)) continue;
+        if (!bench_source(src, frames, times)) return -1;
+        report(csv, label, src->name, frames, times);
+    }
+    /* Saturated stripes don't come from the engine, so aren't compared */
+    if ((only == NULL || !strcmp(only, "saturated")) &&
+        dump_file == NULL && compare_file == NULL) {
+        bench_saturated(csv, label, frames, times[0]);
+    }
+    if (compare_file != NULL) {
+        printf("\nCompared with %s:\n", comparename);
+        ok = check_report();
+    }
+
+    for (s = 0; s < NUM_STAGES; s++) free(times[s]);
+    if (csv != NULL) fclose(csv);
+    if (dump_file != NULL && fclose(dump_file) != 0) {
+        perror(dumpname);
+        ok = false;
+    }
+    if (compare_file != NULL) fclose(compare_file);
+    free(check_bins);
+    free(other_bins);
+    free(check_levels);
+    free(other_levels);
+    rgbm_ctx_destroy(ctx);
+    display_quit();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+/* Sends stripes to one or more display sinks chosen at run time. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "display.h"
+
+/*
+ * Null sink, which discards stripes, for benchmarking analysis alone
+ */
+
+static void *null_init(const char *arg) {
+    static int state;
+    return &state;
+}
+
+static bool null_render(void *state, RGBM_STRIPETYPE *r,
+                        RGBM_STRIPETYPE *g, RGBM_STRIPETYPE *b) {
+    return true;
+}
+
+static bool null_pollquit(void *state) {
+    return false;
+}
+
+static void null_quit(void *state) {
+}
+
+static const struct display_backend display_null = {
+    "null", null_init, null_render, null_pollquit, null_quit
+};
+
+static const struct display_backend *backends[] = {
+    &display_sdl,
+    &display_null,
+    &display_raw,
+#ifdef DISPLAY_SHM
+    &display_shm,
+#endif
+#ifdef DISPLAY_LED
+    &display_led,
+#endif
+#ifdef DISPLAY_REC
+    &display_rec,
+#endif
+#ifdef DISPLAY_NET
+    &display_net,
+#endif
+    NULL
+};
+
+/*
+ * Configured sinks
+ */
+
+struct display_sink {
+    const struct display_backend *backend;
+    char *arg;
+    void *state;
+};
+
+static struct display_sink sinks[DISPLAY_MAX_SINKS];
+/* Time of the stripe being rendered, or 0 if unknown */
+static uint64_t stripe_time;
+static unsigned int num_sinks = 0;
+
+static void free_sinks(void) {
+    while (num_sinks > 0) {
+        num_sinks--;
+        free(sinks[num_sinks].arg);
+    }
+}
+
+/* Adds sink from specification of len characters at spec */
+static bool add_sink(const char *spec, size_t len) {
+    const struct display_backend **b;
+    const char *colon = memchr(spec, ':', len);
+    size_t name_len = colon != NULL ? (size_t)(colon - spec) : len;
+    struct display_sink *sink;
+
+    if (num_sinks >= DISPLAY_MAX_SINKS) {
+        fprintf(stderr, "Error: more than %u display sinks\n",
+                DISPLAY_MAX_SINKS);
+        return false;
+    }
+
+    for (b = backends; *b != NULL; b++) {
+        if (strlen((*b)->name) == name_len &&
+            !strncmp((*b)->name, spec, name_len)) break;
+    }
+    if (*b == NULL) {
+        fprintf(stderr, "Error: unknown display sink %.*s\n",
+                (int)name_len, spec);
+        return false;
+    }
+
+    sink = &sinks[num_sinks];
+    sink->backend = *b;
+    sink->arg = NULL;
+    sink->state = NULL;
+    if (colon != NULL) {
+        len -= name_len + 1;
+        sink->arg = malloc(len + 1);
+        if (sink->arg == NULL) return false;
+        memcpy(sink->arg, colon + 1, len);
+        sink->arg[len] = '\0';
+    }
+    num_sinks++;
+    return true;
+}
+
+bool display_configure(const char *spec) {
+    const char *end;
+
+    free_sinks();
+    do {
+        end = strchr(spec, ',');
+        if (end == NULL) end = spec + strlen(spec);
+        if (!add_sink(spec, end - spec)) {
+            free_sinks();
+            return false;
+        }
+        spec = end + 1;
+    } while (*end != '\0');
+
+    return true;
+}
+
+bool display_init(void) {
+    unsigned int i;
+
+    if (num_sinks == 0 && !display_configure(DISPLAY_DEFAULT_SINKS))
+        return false;
+
+    for (i = 0; i < num_sinks; i++) {
+        sinks[i].state = sinks[i].backend->init(sinks[i].arg);
+        if (sinks[i].state == NULL) {
+            while (i > 0) {
+                i--;
+                sinks[i].backend->quit(sinks[i].state);
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+unsigned int display_width(void) {
+    return DISPLAY_WIDTH;
+}
+
+bool display_render(RGBM_STRIPETYPE *r, RGBM_STRIPETYPE *g,
+                    RGBM_STRIPETYPE *b) {
+    unsigned int i;
+    bool res = true;
+
+    for (i = 0; i < num_sinks; i++) {
+        if (!sinks[i].backend->render(sinks[i].state, r, g, b)) res = false;
+    }
+    /* Each time only applies to one stripe */
+    stripe_time = 0;
+    return res;
+}
+
+void display_set_time(uint64_t ns) {
+    stripe_time = ns;
+}
+
+uint64_t display_time(void) {
+    return stripe_time;
+}
+
+bool display_pollquit(void) {
+    unsigned int i;
+    bool res = false;
+
+    /* Every sink is polled, so each can process its events */
+    for (i = 0; i < num_sinks; i++) {
+        if (sinks[i].backend->pollquit(sinks[i].state)) res = true;
+    }
+    return res;
+}
+
+void display_quit(void) {
+    unsigned int i;
+
+    for (i = 0; i < num_sinks; i++) {
+        sinks[i].backend->quit(sinks[i].state);
+        sinks[i].state = NULL;
+    }
+}
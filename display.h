@@ -1,9 +1,79 @@
 /* Winamp-specific visualization plugin code for the RGB lamp. */
 /* Copyright 2013 Boris Gjenero. Released under the MIT license. */
 
+#ifndef _DISPLAY_H_
+#define _DISPLAY_H_
+
+#include <stdbool.h>
+#include "rgbm.h"
+
+/* Width of stripes passed to all sinks */
+#define DISPLAY_WIDTH 640
+/* Maximum number of sinks receiving each stripe */
+#define DISPLAY_MAX_SINKS 4
+/* Sinks used when display_configure() is not called */
+#define DISPLAY_DEFAULT_SINKS "sdl"
+
+/* One kind of sink which can receive stripes */
+struct display_backend {
+    const char *name;
+    /* Arg is text after ':' in the sink specification, or NULL if there
+     * was none. Returns state passed to the other functions, or NULL
+     * on failure after printing an error. */
+    void *(*init)(const char *arg);
+    bool (*render)(void *state, RGBM_STRIPETYPE *r, RGBM_STRIPETYPE *g,
+                   RGBM_STRIPETYPE *b);
+    /* Returns true if this sink wants visualization to end */
+    bool (*pollquit)(void *state);
+    void (*quit)(void *state);
+};
+
+extern const struct display_backend display_sdl, display_raw;
+#ifdef DISPLAY_SHM
+extern const struct display_backend display_shm;
+#endif
+#ifdef DISPLAY_LED
+extern const struct display_backend display_led;
+#endif
+#ifdef DISPLAY_REC
+extern const struct display_backend display_rec;
+#endif
+#ifdef DISPLAY_NET
+extern const struct display_backend display_net;
+#endif
+
+/* Sinks is a comma separated list of name[:arg], for example
+ * "sdl,raw:out.rgb". Must be called before display_init(). Returns
+ * false if the list is invalid. */
+bool display_configure(const char *sinks);
+
+/* These operate on all configured sinks */
 bool display_init(void);
 unsigned int display_width(void);
 /* These must be arrays of size display_width() */
-bool display_render(double *r, double *g, double *b);
+bool display_render(RGBM_STRIPETYPE *r, RGBM_STRIPETYPE *g,
+                    RGBM_STRIPETYPE *b);
+/* Sets the time in nanoseconds of the next stripe passed to
+ * display_render(), for sinks which record stripes. It is the stripe's
+ * position in a file, or the CLOCK_MONOTONIC capture time of live audio,
+ * or 0 if unknown. Sinks get it from display_time() while rendering. */
+void display_set_time(uint64_t ns);
+uint64_t display_time(void);
 bool display_pollquit(void);
-void display_quit(void);
\ No newline at end of file
+void display_quit(void);
+
+/* Converts a stripe value to a colour component */
+#ifdef RGBM_FIXED
+static inline unsigned char display_clip(int32_t v) {
+    int t = (v + RGBM_STRIPE_ONE / 2) >> RGBM_STRIPE_FRAC_BITS;
+#else
+static inline unsigned char display_clip(double d) {
+    int t = d + 0.5;
+#endif
+
+    if (t < 0) return 0;
+    if (t > 255) return 255;
+    return t;
+}
+
+#endif /* !_DISPLAY_H_ */
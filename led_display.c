@@ -0,0 +1,339 @@
+/* Display sink driving an LED strip over a serial port or UDP. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+/*
+ * The sink argument is DEST[@COUNT]. DEST is a serial device, such as
+ * a USB serial adapter or a pty for testing, or udp:HOST:PORT. COUNT
+ * is the number of LEDs, and the stripe is averaged down to that many.
+ *
+ * Serial output uses the Adalight protocol: "Ada", the LED count minus
+ * one as a big endian 16-bit number, a checksum byte, then red, green
+ * and blue for each LED. UDP output uses the WLED DRGB protocol: one
+ * datagram per frame, beginning with 2 and a timeout in seconds.
+ *
+ * Rendering only prepares the newest frame. A writer thread sends it,
+ * so a slow link skips stale frames instead of stalling rendering.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <termios.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <SDL.h>
+#include "display.h"
+
+#define LED_DEFAULT_COUNT 60
+/* Limit of a DRGB datagram */
+#define LED_MAX_COUNT 490
+#define LED_SERIAL_BAUD B115200
+#define LED_HEADER_MAX 6
+/* Seconds WLED waits after the last frame before resuming its effects */
+#define LED_UDP_TIMEOUT 2
+/* Writer checks for shutdown this often while waiting on the link */
+#define LED_POLL_MS 100
+
+struct led_state {
+    int fd;
+    bool udp;
+    unsigned int count;
+    /* Smoothed LED values, count * 3 */
+    double *avg;
+
+    SDL_Thread *thread;
+    SDL_mutex *lock;
+    SDL_cond *cond;
+    bool stopping, failed;
+    /* Newest frame, and a copy being sent by the writer thread */
+    unsigned char *latest, *sending;
+    size_t frame_len;
+    /* Frames prepared, and the count when the writer last took one */
+    unsigned long frames_new, frames_taken;
+    unsigned long frames_sent;
+};
+
+static size_t led_header(const struct led_state *s, unsigned char *h) {
+    unsigned int n = s->count - 1;
+
+    if (s->udp) {
+        h[0] = 2;
+        h[1] = LED_UDP_TIMEOUT;
+        return 2;
+    }
+    h[0] = 'A';
+    h[1] = 'd';
+    h[2] = 'a';
+    h[3] = n >> 8;
+    h[4] = n & 0xff;
+    h[5] = h[3] ^ h[4] ^ 0x55;
+    return 6;
+}
+
+static bool led_stopping(struct led_state *s) {
+    bool stopping;
+
+    SDL_mutexP(s->lock);
+    stopping = s->stopping;
+    SDL_mutexV(s->lock);
+    return stopping;
+}
+
+/* Writes the whole buffer to a non-blocking descriptor. Returns false
+ * on error or if stopping while waiting. */
+static bool led_write_all(struct led_state *s, const unsigned char *p,
+                          size_t len) {
+    struct pollfd pfd = { s->fd, POLLOUT, 0 };
+
+    while (len > 0) {
+        ssize_t res = write(s->fd, p, len);
+        if (res >= 0) {
+            p += res;
+            len -= res;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            /* UDP frames are independent, so just give up on this one */
+            if (s->udp) return true;
+            if (poll(&pfd, 1, LED_POLL_MS) < 0 && errno != EINTR) {
+                return false;
+            }
+            if (led_stopping(s)) return false;
+        } else if (errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int led_thread(void *data) {
+    struct led_state *s = data;
+    bool ok = true;
+
+    SDL_mutexP(s->lock);
+    while (true) {
+        while (s->frames_new == s->frames_taken && !s->stopping) {
+            SDL_CondWait(s->cond, s->lock);
+        }
+        if (s->stopping) break;
+
+        /* Only the newest frame is sent. Older ones are stale. */
+        memcpy(s->sending, s->latest, s->frame_len);
+        s->frames_taken = s->frames_new;
+        s->frames_sent++;
+        SDL_mutexV(s->lock);
+
+        ok = led_write_all(s, s->sending, s->frame_len);
+
+        SDL_mutexP(s->lock);
+        if (!ok) {
+            if (!s->stopping) perror("Error writing to LEDs");
+            s->failed = true;
+            break;
+        }
+    }
+    SDL_mutexV(s->lock);
+    return 0;
+}
+
+static bool led_open_serial(struct led_state *s, const char *dev) {
+    struct termios tio;
+
+    s->fd = open(dev, O_WRONLY | O_NOCTTY | O_NONBLOCK);
+    if (s->fd < 0) {
+        perror(dev);
+        return false;
+    }
+    if (isatty(s->fd)) {
+        if (tcgetattr(s->fd, &tio) < 0) {
+            perror(dev);
+            return false;
+        }
+        cfmakeraw(&tio);
+        cfsetospeed(&tio, LED_SERIAL_BAUD);
+        cfsetispeed(&tio, LED_SERIAL_BAUD);
+        tio.c_cflag |= CLOCAL;
+        if (tcsetattr(s->fd, TCSANOW, &tio) < 0) {
+            perror(dev);
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Dest is HOST:PORT */
+static bool led_open_udp(struct led_state *s, const char *dest) {
+    struct addrinfo hints, *res, *ai;
+    char host[256];
+    const char *port = strrchr(dest, ':');
+    int err;
+
+    if (port == NULL || port - dest >= sizeof(host)) {
+        fprintf(stderr, "Error: LED destination must be udp:HOST:PORT\n");
+        return false;
+    }
+    memcpy(host, dest, port - dest);
+    host[port - dest] = '\0';
+    port++;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    err = getaddrinfo(host, port, &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "Error: %s: %s\n", dest, gai_strerror(err));
+        return false;
+    }
+    s->fd = -1;
+    for (ai = res; ai != NULL; ai = ai->ai_next) {
+        s->fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (s->fd < 0) continue;
+        if (connect(s->fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        close(s->fd);
+        s->fd = -1;
+    }
+    freeaddrinfo(res);
+    if (s->fd < 0) {
+        perror(dest);
+        return false;
+    }
+    fcntl(s->fd, F_SETFL, fcntl(s->fd, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+static void led_free(struct led_state *s) {
+    if (s->fd >= 0) close(s->fd);
+    if (s->cond != NULL) SDL_DestroyCond(s->cond);
+    if (s->lock != NULL) SDL_DestroyMutex(s->lock);
+    free(s->avg);
+    free(s->latest);
+    free(s->sending);
+    free(s);
+}
+
+static void *led_init(const char *arg) {
+    struct led_state *s;
+    char dest[256];
+    const char *at;
+    size_t len;
+
+    if (arg == NULL || arg[0] == '\0') arg = RGBPORT;
+    s = calloc(1, sizeof(struct led_state));
+    if (s == NULL) return NULL;
+    s->fd = -1;
+
+    at = strchr(arg, '@');
+    len = at != NULL ? (size_t)(at - arg) : strlen(arg);
+    s->count = at != NULL ? atoi(at + 1) : LED_DEFAULT_COUNT;
+    if (len >= sizeof(dest) || s->count < 1 || s->count > LED_MAX_COUNT) {
+        fprintf(stderr, "Error: LED sink needs DEST[@COUNT] with 1 to %u "
+                        "LEDs\n", LED_MAX_COUNT);
+        led_free(s);
+        return NULL;
+    }
+    memcpy(dest, arg, len);
+    dest[len] = '\0';
+
+    if (!strncmp(dest, "udp:", 4)) {
+        s->udp = true;
+        if (!led_open_udp(s, dest + 4)) {
+            led_free(s);
+            return NULL;
+        }
+    } else if (!led_open_serial(s, dest)) {
+        led_free(s);
+        return NULL;
+    }
+
+    s->avg = calloc(s->count * 3, sizeof(double));
+    s->latest = malloc(LED_HEADER_MAX + s->count * 3);
+    s->sending = malloc(LED_HEADER_MAX + s->count * 3);
+    s->lock = SDL_CreateMutex();
+    s->cond = SDL_CreateCond();
+    if (s->avg == NULL || s->latest == NULL || s->sending == NULL ||
+        s->lock == NULL || s->cond == NULL) {
+        fprintf(stderr, "Error initializing LED sink\n");
+        led_free(s);
+        return NULL;
+    }
+    s->frame_len = led_header(s, s->latest) + s->count * 3;
+
+    s->thread = SDL_CreateThread(led_thread, s);
+    if (s->thread == NULL) {
+        fprintf(stderr, "Error creating LED thread: %s\n", SDL_GetError());
+        led_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+static bool led_render(void *state, RGBM_STRIPETYPE *r,
+                       RGBM_STRIPETYPE *g, RGBM_STRIPETYPE *b) {
+    struct led_state *s = state;
+    RGBM_STRIPETYPE *stripe[3] = { r, g, b };
+    unsigned char *p;
+    unsigned int led, i, start, end;
+    int j;
+
+    /* Average stripe down to LEDs, then smooth over time. This happens
+     * for every stripe even if the link is slow, so the smoothing
+     * does not depend on link speed. */
+    for (led = 0; led < s->count; led++) {
+        start = led * DISPLAY_WIDTH / s->count;
+        end = (led + 1) * DISPLAY_WIDTH / s->count;
+        if (end <= start) end = start + 1;
+        for (j = 0; j < 3; j++) {
+            double sum = 0.0, avgsize, *avg = &s->avg[led * 3 + j];
+
+            for (i = start; i < end; i++) sum += stripe[j][i];
+            sum /= end - start;
+
+            avgsize = sum > *avg ? RGBM_AVGUP : RGBM_AVGDN;
+            *avg = ((avgsize - 1.0) * *avg + sum) / avgsize;
+        }
+    }
+
+    SDL_mutexP(s->lock);
+    p = s->latest + s->frame_len - s->count * 3;
+    for (i = 0; i < s->count * 3; i++) {
+        *(p++) = display_clip(s->avg[i]);
+    }
+    s->frames_new++;
+    SDL_CondSignal(s->cond);
+    SDL_mutexV(s->lock);
+
+    return true;
+}
+
+static bool led_pollquit(void *state) {
+    struct led_state *s = state;
+    bool failed;
+
+    SDL_mutexP(s->lock);
+    failed = s->failed;
+    SDL_mutexV(s->lock);
+    return failed;
+}
+
+static void led_quit(void *state) {
+    struct led_state *s = state;
+    unsigned long skipped;
+
+    SDL_mutexP(s->lock);
+    s->stopping = true;
+    SDL_CondSignal(s->cond);
+    SDL_mutexV(s->lock);
+    SDL_WaitThread(s->thread, NULL);
+
+    skipped = s->frames_new - s->frames_sent;
+    if (skipped > 0) {
+        fprintf(stderr, "LED frames not sent: %lu\n", skipped);
+    }
+    led_free(s);
+}
+
+const struct display_backend display_led = {
+    "led", led_init, led_render, led_pollquit, led_quit
+};
@@ -0,0 +1,87 @@
+/* Display sink streaming stripes to other hosts over UDP. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+/*
+ * The sink argument is HOST:PORT[@STRIPES]. HOST may be a multicast
+ * group, so any number of receivers can show the same stripes, or a
+ * single receiver. STRIPES is how many are sent per system call. Rows
+ * are quantized to 8 bits and run length coded against the previous
+ * one, as described in stripenet.h. colourwaterfall-netrecv receives
+ * them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "display.h"
+#include "stripenet.h"
+
+struct net_state {
+    struct stripenet *net;
+    unsigned char rgb[DISPLAY_WIDTH * 3];
+};
+
+static void *net_init(const char *arg) {
+    struct net_state *s;
+    char dest[256];
+    const char *at;
+    size_t len;
+    int batch;
+
+    if (arg == NULL || arg[0] == '\0') arg = STRIPENET_DEFAULT_DEST;
+    at = strchr(arg, '@');
+    len = at != NULL ? (size_t)(at - arg) : strlen(arg);
+    batch = at != NULL ? atoi(at + 1) : STRIPENET_DEFAULT_BATCH;
+    if (len >= sizeof(dest) || batch < 1 || batch > STRIPENET_MAX_BATCH) {
+        fprintf(stderr, "Error: network sink needs HOST:PORT[@STRIPES] "
+                        "with 1 to %u stripes\n", STRIPENET_MAX_BATCH);
+        return NULL;
+    }
+    memcpy(dest, arg, len);
+    dest[len] = '\0';
+
+    s = malloc(sizeof(struct net_state));
+    if (s == NULL) return NULL;
+    s->net = stripenet_create(dest, DISPLAY_WIDTH, batch);
+    if (s->net == NULL) {
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+static bool net_render(void *state, RGBM_STRIPETYPE *r,
+                       RGBM_STRIPETYPE *g, RGBM_STRIPETYPE *b) {
+    struct net_state *s = state;
+    unsigned char *p = s->rgb;
+    int i;
+
+    for (i = 0; i < DISPLAY_WIDTH; i++) {
+        *(p++) = display_clip(r[i]);
+        *(p++) = display_clip(g[i]);
+        *(p++) = display_clip(b[i]);
+    }
+    stripenet_send(s->net, s->rgb);
+    return true;
+}
+
+static bool net_pollquit(void *state) {
+    return false;
+}
+
+static void net_quit(void *state) {
+    struct net_state *s = state;
+    struct stripenet_stats stats;
+
+    stripenet_stats(s->net, &stats);
+    stripenet_destroy(s->net);
+    if (stats.lost > 0) {
+        fprintf(stderr, "Network sink dropped %lu of %lu datagrams\n",
+                stats.lost, stats.datagrams + stats.lost);
+    }
+    free(s);
+}
+
+const struct display_backend display_net = {
+    "net", net_init, net_render, net_pollquit, net_quit
+};
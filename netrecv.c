@@ -0,0 +1,111 @@
+/* Receives stripes streamed by the net display sink and displays them. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "display.h"
+#include "stripenet.h"
+
+/* How long to wait for a stripe before checking for quit events */
+#define WAIT_MS 20
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-D sinks] [-n stripes] [-k] [[host:]port]\n"
+                    "Displays stripes sent with -D net[:host:port], "
+                    "printing statistics each second.\n"
+                    "  -D sinks    comma separated displays, as for "
+                    "colourwaterfall (default sdl)\n"
+                    "  -n stripes  exit after this many stripes\n"
+                    "  -k          keep running when the sender stops\n"
+                    "With a multicast group as host, it is joined. "
+                    "The default is %s\n",
+            name, STRIPENET_DEFAULT_DEST);
+    exit(-1);
+}
+
+int main(int argc, char **argv) {
+    const char *addr = STRIPENET_DEFAULT_DEST;
+    struct stripenet *net;
+    struct stripenet_stats stats, sec_start;
+    RGBM_STRIPETYPE *stripe[3];
+    unsigned long limit = 0, got = 0;
+    unsigned int width, i;
+    bool keep = false, ended = false;
+    time_t last;
+    int opt, j;
+
+    while ((opt = getopt(argc, argv, "D:n:k")) != -1) {
+        switch (opt) {
+        case 'D':
+            if (!display_configure(optarg)) return -1;
+            break;
+        case 'n':
+            limit = strtoul(optarg, NULL, 0);
+            break;
+        case 'k':
+            keep = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind == argc - 1) {
+        addr = argv[optind];
+    } else if (optind != argc) {
+        usage(argv[0]);
+    }
+
+    net = stripenet_listen(addr);
+    if (net == NULL) return -1;
+    if (!display_init()) {
+        stripenet_close(net);
+        return -1;
+    }
+    for (j = 0; j < 3; j++) {
+        stripe[j] = calloc(display_width(), sizeof(RGBM_STRIPETYPE));
+        if (stripe[j] == NULL) return -1;
+    }
+
+    stripenet_stats(net, &sec_start);
+    last = time(NULL);
+    while ((limit == 0 || got < limit) && !display_pollquit()) {
+        const unsigned char *rgb = stripenet_receive(net, WAIT_MS, &width,
+                                                     &ended);
+
+        if (rgb != NULL) {
+            /* Scale to the display width by picking nearest pixels */
+            for (i = 0; i < display_width(); i++) {
+                const unsigned char *p = &rgb[i * width / display_width() *
+                                              3];
+                for (j = 0; j < 3; j++) stripe[j][i] = p[j] * RGBM_STRIPE_ONE;
+            }
+            if (!display_render(stripe[0], stripe[1], stripe[2])) break;
+            got++;
+        } else if (ended && !keep) {
+            break;
+        }
+
+        if (time(NULL) != last) {
+            stripenet_stats(net, &stats);
+            fprintf(stderr, "%lu stripes, %lu lost, %lu datagrams, "
+                            "%lu kB\n",
+                    stats.stripes - sec_start.stripes,
+                    stats.lost - sec_start.lost,
+                    stats.datagrams - sec_start.datagrams,
+                    (unsigned long)((stats.bytes - sec_start.bytes) / 1024));
+            sec_start = stats;
+            last = time(NULL);
+        }
+    }
+
+    stripenet_stats(net, &stats);
+    fprintf(stderr, "Total %lu stripes, %lu lost%s\n", stats.stripes,
+            stats.lost, ended ? ", sender stopped" : "");
+    display_quit();
+    stripenet_close(net);
+    for (j = 0; j < 3; j++) free(stripe[j]);
+    return 0;
+}
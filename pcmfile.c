@@ -0,0 +1,294 @@
+/* Reading audio from WAV files and raw PCM pipes. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+#ifdef WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+#include "pcmfile.h"
+
+/* Only this rate matches the frequency tables */
+#define PCMFILE_RATE 44100
+/* Most channels accepted, beyond the two which are used */
+#define PCMFILE_MAX_CHANNELS 8
+
+#define WAVE_FORMAT_PCM 1
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+/* Input is either entirely memory mapped or read via stdio. */
+struct pcm_source {
+    FILE *f;
+    const unsigned char *map;
+    size_t map_len, map_pos;
+};
+
+struct pcmfile {
+    struct pcm_source src;
+    unsigned int channels, rate;
+    unsigned long length;
+    /* Bytes of sample data not yet read, or UINT64_MAX to read to the
+     * end of input */
+    uint64_t data_left;
+    int16_t readbuf[PCMFILE_CHUNK_FRAMES * PCMFILE_MAX_CHANNELS];
+    int16_t stereo[PCMFILE_CHUNK_FRAMES * 2];
+};
+
+/* Get up to len bytes. When mapped, *ptr points directly into the
+ * mapping. Otherwise data is read into buf. Returns number of bytes.
+ */
+static size_t source_get(struct pcm_source *src, const void **ptr,
+                         size_t len, void *buf) {
+    if (src->map != NULL) {
+        if (len > src->map_len - src->map_pos)
+            len = src->map_len - src->map_pos;
+        *ptr = &src->map[src->map_pos];
+        src->map_pos += len;
+        return len;
+    } else {
+        *ptr = buf;
+        return fread(buf, 1, len, src->f);
+    }
+}
+
+static bool source_skip(struct pcm_source *src, size_t len) {
+    unsigned char buf[256];
+    const void *p;
+
+    while (len > 0) {
+        size_t n = len > sizeof(buf) ? sizeof(buf) : len;
+        if (source_get(src, &p, n, buf) != n) return false;
+        len -= n;
+    }
+    return true;
+}
+
+static bool source_open(struct pcm_source *src, const char *name) {
+    src->map = NULL;
+
+    if (!strcmp(name, "-")) {
+        src->f = stdin;
+#ifdef WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    } else {
+        src->f = fopen(name, "rb");
+        if (src->f == NULL) {
+            perror(name);
+            return false;
+        }
+    }
+
+#ifdef __linux__
+    {
+        struct stat st;
+        /* Regular files are mapped, avoiding copies through stdio. */
+        if (fstat(fileno(src->f), &st) == 0 && S_ISREG(st.st_mode) &&
+            st.st_size > 0) {
+            void *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                           fileno(src->f), 0);
+            if (m != MAP_FAILED) {
+                madvise(m, st.st_size, MADV_SEQUENTIAL);
+                src->map = m;
+                src->map_len = st.st_size;
+                src->map_pos = 0;
+                return true;
+            }
+        }
+    }
+#endif
+
+    /* Pipes may only supply small amounts at a time. */
+    setvbuf(src->f, NULL, _IOFBF, 1 << 20);
+    return true;
+}
+
+/* Returns the number of bytes left in a mapped or regular file, or
+ * UINT64_MAX for pipes and other streamed input. */
+static uint64_t source_remaining(struct pcm_source *src) {
+    struct stat st;
+    long pos;
+
+    if (src->map != NULL) return src->map_len - src->map_pos;
+    if (fstat(fileno(src->f), &st) != 0 || !S_ISREG(st.st_mode))
+        return UINT64_MAX;
+    pos = ftell(src->f);
+    if (pos < 0 || pos > st.st_size) return UINT64_MAX;
+    return st.st_size - pos;
+}
+
+static void source_close(struct pcm_source *src) {
+#ifdef __linux__
+    if (src->map != NULL) munmap((void *)src->map, src->map_len);
+#endif
+    if (src->f != stdin) fclose(src->f);
+}
+
+static uint32_t get_le32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static unsigned int get_le16(const unsigned char *p) {
+    return p[0] | (p[1] << 8);
+}
+
+/* Parse WAV header up to the start of sample data, setting *data_size
+ * to the size given for it. Returns number of channels, or 0 on failure.
+ */
+static unsigned int wav_parse_header(struct pcm_source *src,
+                                     const char *name, unsigned int *rate,
+                                     uint32_t *data_size) {
+    unsigned char buf[40];
+    const unsigned char *p;
+    unsigned int channels = 0;
+
+    if (source_get(src, (const void **)&p, 12, buf) != 12 ||
+        memcmp(p, "RIFF", 4) || memcmp(p + 8, "WAVE", 4)) {
+        fprintf(stderr, "Error: %s is not a WAV file\n", name);
+        return 0;
+    }
+
+    for (;;) {
+        uint32_t size;
+
+        if (source_get(src, (const void **)&p, 8, buf) != 8) {
+            fprintf(stderr, "Error: no audio data in %s\n", name);
+            return 0;
+        }
+        size = get_le32(p + 4);
+
+        if (!memcmp(p, "data", 4)) {
+            if (channels == 0) {
+                fprintf(stderr, "Error: data before format in %s\n", name);
+            }
+            *data_size = size;
+            return channels;
+        } else if (!memcmp(p, "fmt ", 4) && size >= 16 &&
+                   size <= sizeof(buf)) {
+            unsigned int format, bits;
+
+            if (source_get(src, (const void **)&p, size, buf) != size)
+                return 0;
+            format = get_le16(p);
+            channels = get_le16(p + 2);
+            *rate = get_le32(p + 4);
+            bits = get_le16(p + 14);
+            if (format == WAVE_FORMAT_EXTENSIBLE && size >= 26) {
+                /* First two bytes of sub-format GUID are the format */
+                format = get_le16(p + 24);
+            }
+            if (format != WAVE_FORMAT_PCM || bits != 16 || channels == 0) {
+                fprintf(stderr, "Error: %s is not 16-bit PCM\n", name);
+                return 0;
+            }
+            if (*rate != PCMFILE_RATE) {
+                fprintf(stderr, "Warning: %s has sample rate %u, "
+                        "frequencies will be off\n", name, *rate);
+            }
+            if (size & 1) source_skip(src, 1);
+        } else {
+            /* Chunks are padded to even size */
+            if (!source_skip(src, size + (size & 1))) return 0;
+        }
+    }
+}
+
+/* Convert frames with any number of channels to stereo. Mono is
+ * duplicated to both sides and channels after the first two are ignored.
+ */
+static const int16_t *to_stereo(const int16_t *in, unsigned int frames,
+                                unsigned int channels, int16_t *out) {
+    unsigned int i;
+
+    if (channels == 2) return in;
+
+    for (i = 0; i < frames; i++) {
+        out[i * 2] = in[i * channels];
+        out[i * 2 + 1] = in[i * channels + (channels > 1)];
+    }
+    return out;
+}
+
+struct pcmfile *pcmfile_open(const char *name, bool raw) {
+    struct pcmfile *pf = malloc(sizeof(struct pcmfile));
+    uint32_t data_size = 0;
+    uint64_t remaining;
+
+    if (pf == NULL) {
+        fprintf(stderr, "Error: out of memory opening %s\n", name);
+        return NULL;
+    }
+    if (!source_open(&pf->src, name)) {
+        free(pf);
+        return NULL;
+    }
+
+    pf->channels = 2;
+    pf->rate = PCMFILE_RATE;
+    if (!raw) {
+        pf->channels = wav_parse_header(&pf->src, name, &pf->rate,
+                                        &data_size);
+        if (pf->channels == 0) {
+            pcmfile_close(pf);
+            return NULL;
+        }
+        if (pf->channels > PCMFILE_MAX_CHANNELS) {
+            fprintf(stderr, "Error: too many channels in %s\n", name);
+            pcmfile_close(pf);
+            return NULL;
+        }
+    }
+
+    /* Data ends at the size given in the header, so chunks after it
+     * aren't shown as audio. Streamed WAV files often have a size of 0
+     * or 0xFFFFFFFF, or one that isn't correct, so they, pipes and sizes
+     * past the end of the file are read to the end. */
+    remaining = source_remaining(&pf->src);
+    pf->data_left = remaining;
+    if (!raw && remaining != UINT64_MAX && data_size != 0 &&
+        data_size != 0xFFFFFFFF && data_size <= remaining) {
+        pf->data_left = data_size;
+    }
+    /* Only files have a known length */
+    pf->length = 0;
+    if (pf->data_left != UINT64_MAX) {
+        pf->length = pf->data_left / (pf->channels * sizeof(int16_t));
+    }
+    return pf;
+}
+
+unsigned int pcmfile_rate(const struct pcmfile *pf) {
+    return pf->rate;
+}
+
+unsigned long pcmfile_length(const struct pcmfile *pf) {
+    return pf->length;
+}
+
+unsigned int pcmfile_read(struct pcmfile *pf, const int16_t **frames) {
+    const void *p;
+    size_t got, want;
+    unsigned int nframes;
+
+    want = PCMFILE_CHUNK_FRAMES * pf->channels * sizeof(int16_t);
+    if (want > pf->data_left) want = pf->data_left;
+    got = source_get(&pf->src, &p, want, pf->readbuf);
+    if (pf->data_left != UINT64_MAX) pf->data_left -= got;
+    nframes = got / (pf->channels * sizeof(int16_t));
+    *frames = to_stereo(p, nframes, pf->channels, pf->stereo);
+    return nframes;
+}
+
+void pcmfile_close(struct pcmfile *pf) {
+    source_close(&pf->src);
+    free(pf);
+}
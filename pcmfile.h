@@ -0,0 +1,30 @@
+/* Header file for reading audio from files and pipes. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#ifndef _PCMFILE_H_
+#define _PCMFILE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Most frames returned by one pcmfile_read() */
+#define PCMFILE_CHUNK_FRAMES 65536
+
+/* An open WAV or raw PCM file. Separate files may be read from
+ * different threads at the same time. */
+struct pcmfile;
+
+/* Opens a WAV file, or raw 16-bit native endian stereo PCM if raw is
+ * set. A name of "-" reads from standard input. Returns NULL after
+ * printing a message if the file cannot be used. */
+struct pcmfile *pcmfile_open(const char *name, bool raw);
+unsigned int pcmfile_rate(const struct pcmfile *pf);
+/* Number of frames in the file, or 0 if unknown, as with pipes */
+unsigned long pcmfile_length(const struct pcmfile *pf);
+/* Reads stereo frames, setting *frames to point to them. They remain
+ * valid until the next call. Returns the number of frames, which is 0
+ * at the end of the file. */
+unsigned int pcmfile_read(struct pcmfile *pf, const int16_t **frames);
+void pcmfile_close(struct pcmfile *pf);
+
+#endif /* !_PCMFILE_H_ */
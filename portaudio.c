@@ -3,15 +3,25 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
 #include <portaudio.h>
-#include <pthread.h>
 #ifdef __linux__
-#include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#else
+#include <semaphore.h>
 #endif
 #include "rgbm.h"
+#include "wavefeed.h"
+#include "pcmfile.h"
+#ifdef DISPLAY_REC
+#include "display.h"
+#include "stripehist.h"
+#endif
 
-#define inputsize (RGBM_NUMSAMP * 2 / 3)
 
 /* Default sound device, for visualizing playback from other programs */
 #ifdef WIN32
@@ -20,55 +30,165 @@
 #define MONITOR_NAME "pulse_monitor"
 #endif
 
+/* Size of ring in frames. Must be a power of two, and much larger
+ * than RGBM_MAX_NUMSAMP plus the device block size. */
+#define RING_FRAMES 32768
+/* Sound device sample rate */
+#define SOUND_RATE 44100
+
 static PaStream *stream = NULL;
-static double *left_samp = NULL, *right_samp = NULL;
-/* Each ring contains enough samples for one output block. Input block
- * size must be smaller or equal to output block size. Input samples 
- * are added at ring_write, wrapping around the rings. They are copied
- * from there to the output buffers, forming un-wrapped output blocks.
+/* Single producer, single consumer ring of raw interleaved stereo frames.
+ * Only pa_callback advances ring_write_pos and only the render loop
+ * advances ring_read_pos, so neither side ever needs to take a lock.
+ * Positions count frames, only increase, and wrap modulo RING_FRAMES
+ * when indexing. If the ring is full, the callback drops the whole
+ * block instead of waiting.
  */
-static double left_ring[RGBM_NUMSAMP], right_ring[RGBM_NUMSAMP];
-static int ring_write = 0;
-pthread_mutex_t mutex;
-pthread_cond_t cond;
-static bool sound_available = false;
+static int16_t ring[RING_FRAMES * 2];
+static atomic_ulong ring_write_pos, ring_read_pos;
+/* Blocks dropped by pa_callback because the ring was full */
+static atomic_ulong ring_overruns;
+/* Blocks which PortAudio reported as overflowed before reaching us */
+static atomic_ulong input_overflows;
+/* Largest block seen by pa_callback, for judging render loop backlog */
+static atomic_ulong largest_block;
+/* Frames skipped by render loop to keep up with the most recent audio */
+static unsigned long frames_skipped = 0;
+/* CLOCK_MONOTONIC capture time of ring position stamp_pos, from the most
+ * recent block. Written by pa_callback as a sequence lock: stamp_seq is
+ * odd during an update, so the reader retries if it changes. */
+static atomic_uint stamp_seq;
+static atomic_ulong stamp_pos;
+static atomic_ullong stamp_ns;
+#ifdef __linux__
+static int wake_fd = -1;
+#else
+static sem_t wake_sem;
+#endif
 
 static void error(const char *s) {
     fprintf(stderr, "Error: %s\n", s);
     exit(-1);
 }
 
-static void sound_store(const int16_t *input) {
-    int i, outidx;
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static double elapsed(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) +
+           (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void stamp_publish(unsigned long pos, uint64_t ns) {
+    unsigned int seq = atomic_load_explicit(&stamp_seq, memory_order_relaxed);
+
+    /* Release stores keep the data after the odd sequence number */
+    atomic_store_explicit(&stamp_seq, seq + 1, memory_order_relaxed);
+    atomic_store_explicit(&stamp_pos, pos, memory_order_release);
+    atomic_store_explicit(&stamp_ns, ns, memory_order_release);
+    atomic_store_explicit(&stamp_seq, seq + 2, memory_order_release);
+}
+
+/* Returns the capture time of ring position pos, or 0 if unknown */
+static uint64_t stamp_time(unsigned long pos) {
+    unsigned int seq;
+    unsigned long spos;
+    uint64_t ns;
 
-    outidx = ring_write;
-    for (i = 0; i < inputsize; i++) {
-        left_ring[outidx] = input[i * 2] / 32768.0;
-        right_ring[outidx] = input[i * 2 + 1] / 32768.0;
-        outidx++;
-        if (outidx >= RGBM_NUMSAMP) outidx = 0;
+    /* Acquire loads keep the data before the second sequence check */
+    do {
+        seq = atomic_load_explicit(&stamp_seq, memory_order_acquire);
+        spos = atomic_load_explicit(&stamp_pos, memory_order_acquire);
+        ns = atomic_load_explicit(&stamp_ns, memory_order_acquire);
+    } while ((seq & 1) ||
+             seq != atomic_load_explicit(&stamp_seq, memory_order_relaxed));
+
+    if (ns == 0) return 0;
+    return ns + (long)(pos - spos) * (int64_t)1000000000 / SOUND_RATE;
+}
+
+/* Wake up render loop. This must never block. */
+static void sound_wake(void) {
+#ifdef __linux__
+    uint64_t one = 1;
+    /* Only fails if the counter would overflow, and then a wakeup
+     * is pending anyway. */
+    if (write(wake_fd, &one, sizeof(one)) < 0) return;
+#else
+    sem_post(&wake_sem);
+#endif
+}
+
+/* Wait until pa_callback signals that more frames may be available. */
+static void sound_wait(void) {
+#ifdef __linux__
+    struct pollfd pfd = { wake_fd, POLLIN, 0 };
+    uint64_t count;
+
+    if (poll(&pfd, 1, -1) > 0) {
+        if (read(wake_fd, &count, sizeof(count)) < 0) return;
     }
-    ring_write = outidx;
+#else
+    sem_wait(&wake_sem);
+#endif
 }
 
 static int pa_callback(const void *input, void *output,
                        unsigned long frameCount,
                        const PaStreamCallbackTimeInfo *timeInfo,
                        PaStreamCallbackFlags statusFlags, void *userData) {
-    if (frameCount != inputsize) {
-        error("callback got unexpected number of samples.");
+    unsigned long wpos, rpos, idx, first;
+    uint64_t delay;
+
+    if (frameCount > atomic_load_explicit(&largest_block,
+                                          memory_order_relaxed)) {
+        atomic_store_explicit(&largest_block, frameCount,
+                              memory_order_relaxed);
     }
 
-    pthread_mutex_lock(&mutex);
-    sound_store((int16_t *)input);
-    sound_available = true;
-    pthread_cond_signal(&cond);
-    pthread_mutex_unlock(&mutex);
+    if (statusFlags & paInputOverflow) {
+        atomic_fetch_add_explicit(&input_overflows, 1, memory_order_relaxed);
+    }
+
+    wpos = atomic_load_explicit(&ring_write_pos, memory_order_relaxed);
+    rpos = atomic_load_explicit(&ring_read_pos, memory_order_acquire);
+    if (RING_FRAMES - (wpos - rpos) < frameCount) {
+        atomic_fetch_add_explicit(&ring_overruns, 1, memory_order_relaxed);
+        return paContinue;
+    }
+
+    idx = wpos & (RING_FRAMES - 1);
+    first = RING_FRAMES - idx;
+    if (first > frameCount) first = frameCount;
+    memcpy(&ring[idx * 2], input, first * 2 * sizeof(int16_t));
+    memcpy(&ring[0], (const int16_t *)input + first * 2,
+           (frameCount - first) * 2 * sizeof(int16_t));
+
+    /* Time from capture of the first frame until now. Some host APIs
+     * don't report it, and then the block is assumed to have just been
+     * completed. */
+    if (timeInfo != NULL && timeInfo->inputBufferAdcTime > 0 &&
+        timeInfo->currentTime >= timeInfo->inputBufferAdcTime) {
+        delay = (timeInfo->currentTime - timeInfo->inputBufferAdcTime) * 1e9;
+    } else {
+        delay = (uint64_t)frameCount * 1000000000 / SOUND_RATE;
+    }
+    stamp_publish(wpos, mono_ns() - delay);
+
+    atomic_store_explicit(&ring_write_pos, wpos + frameCount,
+                          memory_order_release);
+    sound_wake();
 
     return paContinue;
 }
 
-static void sound_open(const char *devname) {
+/* Block size of 0 lets PortAudio choose. */
+static void sound_open(const char *devname, unsigned long blocksize) {
     PaError err;
     PaStreamParameters inputParameters;
     PaDeviceIndex numDevices;
@@ -101,6 +221,13 @@ static void sound_open(const char *devname) {
 #endif
     if(err != paNoError) error("initializing PortAudio.");
 
+#ifdef __linux__
+    wake_fd = eventfd(0, EFD_NONBLOCK);
+    if (wake_fd < 0) error("creating eventfd");
+#else
+    if (sem_init(&wake_sem, 0, 0) != 0) error("creating semaphore");
+#endif
+
     if ((devname == NULL) ?
 #ifdef WIN32
         0
@@ -148,8 +275,8 @@ static void sound_open(const char *devname) {
     err = Pa_OpenStream(&stream,
                       &inputParameters,
                       NULL, //&outputParameters,
-                      44100,
-                      inputsize,
+                      SOUND_RATE,
+                      blocksize,
                       paClipOff,
                       pa_callback,
                       NULL); /* no callback userData */
@@ -157,9 +284,6 @@ static void sound_open(const char *devname) {
 
     err = Pa_StartStream( stream );
     if(err != paNoError) error("starting PortAudio stream");
-
-    pthread_mutex_init(&mutex, NULL);
-    pthread_cond_init(&cond, NULL);
 }
 
 static void sound_close(void) {
@@ -174,59 +298,395 @@ static void sound_close(void) {
     err = Pa_Terminate();
     if (err != paNoError) error("terminating PortAudio");
 
-    pthread_cond_destroy(&cond);
-    pthread_mutex_destroy(&mutex);
+#ifdef __linux__
+    close(wake_fd);
+#else
+    sem_destroy(&wake_sem);
+#endif
+
+    if (ring_overruns > 0 || input_overflows > 0 || frames_skipped > 0) {
+        fprintf(stderr, "Audio blocks dropped: %lu ring full, "
+                "%lu device overflow; frames skipped: %lu\n",
+                (unsigned long)ring_overruns, (unsigned long)input_overflows,
+                frames_skipped);
+    }
 }
 
-static void sound_retrieve(void) {
-    pthread_mutex_lock(&mutex);
+/* Wait for enough audio for at least one output block, and render all
+ * blocks it contains. Returns false when visualization should end. */
+static int sound_process(void) {
+    unsigned long numsamp = rgbm_num_samples();
+    unsigned long wpos, rpos, avail, idx, first;
+    int res;
+
+    rpos = atomic_load_explicit(&ring_read_pos, memory_order_relaxed);
+    for (;;) {
+        wpos = atomic_load_explicit(&ring_write_pos, memory_order_acquire);
+        avail = wpos - rpos;
+        if (avail >= wavefeed_needed()) break;
+        sound_wait();
+    }
 
-    while (!sound_available) {
-        pthread_cond_wait(&cond, &mutex);
+    /* If rendering fell behind, only the newest frames matter. */
+    if (avail > numsamp +
+                atomic_load_explicit(&largest_block, memory_order_relaxed)) {
+        frames_skipped += avail - numsamp;
+        rpos += avail - numsamp;
+        wavefeed_timestamp(stamp_time(rpos), SOUND_RATE);
+        idx = rpos & (RING_FRAMES - 1);
+        first = RING_FRAMES - idx;
+        if (first > numsamp) first = numsamp;
+        wavefeed_resync(&ring[idx * 2], first);
+        wavefeed_resync(&ring[0], numsamp - first);
+        res = wavefeed_render();
+        avail = numsamp;
+    } else {
+        /* Frames are consumed in place, and the callback cannot
+         * overwrite them until ring_read_pos moves past them. */
+        wavefeed_timestamp(stamp_time(rpos), SOUND_RATE);
+        idx = rpos & (RING_FRAMES - 1);
+        first = RING_FRAMES - idx;
+        if (first > avail) first = avail;
+        res = wavefeed_push(&ring[idx * 2], first) &&
+              wavefeed_push(&ring[0], avail - first);
     }
 
-    memcpy(&left_samp[0], &left_ring[ring_write],
-           sizeof(double) * (RGBM_NUMSAMP - ring_write));
-    memcpy(&right_samp[0], &right_ring[ring_write],
-           sizeof(double) * (RGBM_NUMSAMP - ring_write));
-    if (ring_write > 0) {
-        /* Samples are wrapped around the ring. Copy the second part. */
-        memcpy(&left_samp[RGBM_NUMSAMP - ring_write], &left_ring[0],
-               sizeof(double) * ring_write);
-        memcpy(&right_samp[RGBM_NUMSAMP - ring_write], &right_ring[0],
-               sizeof(double) * ring_write);
+    atomic_store_explicit(&ring_read_pos, rpos + avail,
+                          memory_order_release);
+    return res;
+}
+
+/* Optionally reports capture to display latency once per second */
+static void sound_visualize(bool show_latency) {
+    struct timespec last;
+
+    clock_gettime(CLOCK_MONOTONIC, &last);
+    while (sound_process()) {
+        struct rgbm_latency lat;
+
+        if (!show_latency || elapsed(&last) < 1.0) continue;
+        clock_gettime(CLOCK_MONOTONIC, &last);
+        if (rgbm_get_latency(&lat)) {
+            fprintf(stderr, "Latency: last %.1f ms, mean %.1f ms, "
+                            "max %.1f ms, %lu stripes, %lu stale\n",
+                    lat.last_ns / 1e6, lat.mean_ns / 1e6, lat.max_ns / 1e6,
+                    lat.stripes, lat.stale);
+        }
     }
+}
+
+/* Default location for saving FFTW plans between runs */
+static const char *default_wisdom_file(void) {
+    static char path[1024];
+    const char *dir;
 
-    sound_available = false;
-    pthread_mutex_unlock(&mutex);
+#ifdef WIN32
+    dir = getenv("LOCALAPPDATA");
+    if (dir == NULL) return NULL;
+    snprintf(path, sizeof(path), "%s\\colourwaterfall-fftw.wisdom", dir);
+#else
+    dir = getenv("XDG_CACHE_HOME");
+    if (dir != NULL && dir[0] != '\0') {
+        snprintf(path, sizeof(path), "%s/colourwaterfall-fftw.wisdom", dir);
+    } else {
+        dir = getenv("HOME");
+        if (dir == NULL) return NULL;
+        snprintf(path, sizeof(path), "%s/.cache/colourwaterfall-fftw.wisdom",
+                 dir);
+    }
+#endif
+    return path;
 }
 
-static void sound_visualize(void) {
-    do {
-        sound_retrieve();
-    } while (rgbm_render_wave());
+/* Visualize a file as fast as possible, without waiting for real time.
+ * Returns false after printing a message if the file cannot be used. */
+static bool file_visualize(const char *name, bool raw) {
+    struct pcmfile *pf;
+    struct timespec start;
+    unsigned long total_frames = 0;
+    double secs;
+
+    pf = pcmfile_open(name, raw);
+    if (pf == NULL) return false;
+    /* Rendering isn't paced, so history is timed by file position */
+    wavefeed_stream_rate(pcmfile_rate(pf));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (;;) {
+        const int16_t *frames;
+        unsigned int nframes = pcmfile_read(pf, &frames);
+
+        if (nframes == 0) break;
+        total_frames += nframes;
+        if (!wavefeed_push(frames, nframes)) break;
+    }
+    secs = elapsed(&start);
+
+    fprintf(stderr, "Rendered %.1f s of audio in %.2f s "
+            "(%.1fx real time)\n",
+            (double)total_frames / pcmfile_rate(pf), secs,
+            secs > 0 ? total_frames / (pcmfile_rate(pf) * secs) : 0.0);
+    pcmfile_close(pf);
+    return true;
+}
+
+#ifdef DISPLAY_REC
+/* Shows rows recorded with the rec sink at their original pace,
+ * starting start_secs into the history, without any analysis.
+ * Returns false after printing a message if the history can't be used. */
+static bool history_replay(const char *name, double start_secs) {
+    struct stripehist *hist;
+    RGBM_STRIPETYPE *stripe;
+    const unsigned char *p;
+    struct timespec start;
+    unsigned int width, i;
+    uint64_t first, n, t, t_first = 0;
+
+    hist = stripehist_open(name);
+    if (hist == NULL) return false;
+    width = stripehist_width(hist);
+    if (width != display_width()) {
+        fprintf(stderr, "Error: %s is %u pixels wide, but the display is "
+                        "%u\n", name, width, display_width());
+        stripehist_close(hist);
+        return false;
+    }
+    stripe = malloc(sizeof(RGBM_STRIPETYPE) * width * 3);
+    if (stripe == NULL || !display_init()) {
+        fprintf(stderr, "Error initializing display\n");
+        free(stripe);
+        stripehist_close(hist);
+        return false;
+    }
+
+    first = stripehist_seek(hist, start_secs * 1e9);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (n = first; (p = stripehist_row(hist, n, &t)) != NULL; n++) {
+        double wait;
+
+        if (n == first) t_first = t;
+        wait = (t - t_first) / 1e9 - elapsed(&start);
+        if (wait > 0) {
+            struct timespec ts;
+            ts.tv_sec = wait;
+            ts.tv_nsec = (wait - ts.tv_sec) * 1e9;
+            nanosleep(&ts, NULL);
+        }
+
+        for (i = 0; i < width; i++) {
+            stripe[i] = p[i * 3] * RGBM_STRIPE_ONE;
+            stripe[width + i] = p[i * 3 + 1] * RGBM_STRIPE_ONE;
+            stripe[width * 2 + i] = p[i * 3 + 2] * RGBM_STRIPE_ONE;
+        }
+        if (!display_render(stripe, &stripe[width], &stripe[width * 2]) ||
+            display_pollquit()) break;
+    }
+
+    fprintf(stderr, "Replayed rows %llu to %llu of %llu\n",
+            (unsigned long long)first, (unsigned long long)n,
+            (unsigned long long)stripehist_rows(hist));
+    display_quit();
+    free(stripe);
+    stripehist_close(hist);
+    return true;
+}
+#endif
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [options] [sound device]\n"
+                    "       %s [options] -f wav_file\n"
+                    "       %s [options] -r raw_pcm_file\n"
+                    "Options:\n"
+                    "  -H frames  frames between output rows, up to FFT "
+                    "size\n"
+                    "             (default 2/3 of FFT size)\n"
+                    "  -b frames  sound device block size, 0 lets the "
+                    "device choose (default hop)\n"
+                    "  -N size    FFT size, %u to %u (default %u)\n"
+                    "  -A type    analysis: fft, cq for constant-Q, "
+                    "best with -N 8192,\n"
+                    "             or sdft for sliding DFT, best with "
+                    "small -H\n"
+                    "  -p effort  FFTW planning: estimate, measure or "
+                    "patient (default measure)\n"
+                    "  -w file    FFTW wisdom file, or - for none\n"
+                    "  -P policy  when display is slow: sync, drop, coalesce, "
+                    "block or latest,\n"
+                    "             which also skips stale rows (default block "
+                    "for files,\n"
+                    "             otherwise drop)\n"
+                    "  -M ms      age of stale rows for -P latest "
+                    "(default %u)\n"
+                    "  -L         report capture to display latency every "
+                    "second\n"
+                    "  -B count   display queue buffers, at least 2 "
+                    "(default %u)\n"
+                    "  -D sinks   comma separated displays: sdl, null, "
+                    "raw:file, shm[:name],\n"
+                    "             led[:dest[@count]], rec:file, "
+                    "net[:host:port[@stripes]]\n"
+                    "             (default sdl). raw writes rgb24 video "
+                    "rows, to standard output\n"
+                    "             for -. shm publishes to other processes. "
+                    "led drives an LED\n"
+                    "             strip via a serial device or "
+                    "udp:host:port. rec records rows to\n"
+                    "             a history file. net streams rows to "
+                    "colourwaterfall-netrecv.\n"
+                    "Files are rendered as fast as possible. "
+                    "Use - for standard input.\n"
+                    "Raw PCM is 16-bit native endian stereo at 44100 Hz.\n",
+            name, name, name,
+            RGBM_MIN_NUMSAMP, RGBM_MAX_NUMSAMP, RGBM_NUMSAMP,
+            RGBM_PRESENT_STALE_MS, RGBM_PRESENT_BUFFERS);
+#ifdef DISPLAY_REC
+    fprintf(stderr, "Replay: %s [-D sinks] -R history_file [-S seconds]\n"
+                    "  -R file    show rows recorded with -D rec:file at "
+                    "their original pace,\n"
+                    "             without analysis\n"
+                    "  -S secs    start replay this far into the history\n",
+            name);
+#endif
+    exit(-1);
 }
 
 int main(int argc, char **argv) {
-    char *snddev = NULL;
+    static const char *efforts[] = { "estimate", "measure", "patient" };
+    static const char *policies[] = { "sync", "drop", "coalesce", "block",
+                                      "latest" };
+    static const char *analyses[] = { "fft", "cq", "sdft" };
+    char *snddev = NULL, *filename = NULL;
+#ifdef DISPLAY_REC
+    char *history = NULL;
+    double history_start = 0.0;
+#endif
+    const char *wisdom = default_wisdom_file();
+    bool raw = false;
+    unsigned int hop = WAVEFEED_DEFAULT_HOP, numsamp = RGBM_NUMSAMP;
+    bool hop_set = false;
+    int effort = RGBM_PLAN_MEASURE;
+    int analysis = RGBM_ANALYSIS_FFT;
+    int policy = -1;
+    unsigned int buffers = RGBM_PRESENT_BUFFERS;
+    unsigned int stale_ms = RGBM_PRESENT_STALE_MS;
+    bool show_latency = false;
+    long blocksize = -1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:r:H:b:N:A:p:w:P:M:LB:D:R:S:")) != -1) {
+        switch (opt) {
+#ifdef DISPLAY_REC
+        case 'R':
+            history = optarg;
+            break;
+        case 'S':
+            history_start = atof(optarg);
+            if (history_start < 0) usage(argv[0]);
+            break;
+#endif
+        case 'r':
+            raw = true;
+            /* Fall through */
+        case 'f':
+            if (filename != NULL) usage(argv[0]);
+            filename = optarg;
+            break;
+        case 'H':
+            hop = atoi(optarg);
+            if (hop < 1) usage(argv[0]);
+            hop_set = true;
+            break;
+        case 'b':
+            blocksize = atol(optarg);
+            if (blocksize < 0 || blocksize > RING_FRAMES / 4) usage(argv[0]);
+            break;
+        case 'N':
+            numsamp = atoi(optarg);
+            break;
+        case 'A':
+            for (analysis = RGBM_ANALYSIS_SDFT; analysis >= RGBM_ANALYSIS_FFT;
+                 analysis--) {
+                if (!strcmp(optarg, analyses[analysis])) break;
+            }
+            if (analysis < RGBM_ANALYSIS_FFT) usage(argv[0]);
+            break;
+        case 'p':
+            for (effort = RGBM_PLAN_PATIENT; effort >= RGBM_PLAN_ESTIMATE;
+                 effort--) {
+                if (!strcmp(optarg, efforts[effort])) break;
+            }
+            if (effort < RGBM_PLAN_ESTIMATE) usage(argv[0]);
+            break;
+        case 'w':
+            wisdom = strcmp(optarg, "-") ? optarg : NULL;
+            break;
+        case 'P':
+            for (policy = RGBM_PRESENT_LATEST; policy >= RGBM_PRESENT_SYNC;
+                 policy--) {
+                if (!strcmp(optarg, policies[policy])) break;
+            }
+            if (policy < RGBM_PRESENT_SYNC) usage(argv[0]);
+            break;
+        case 'M':
+            stale_ms = atoi(optarg);
+            break;
+        case 'L':
+            show_latency = true;
+            break;
+        case 'B':
+            buffers = atoi(optarg);
+            break;
+        case 'D':
+            if (!rgbm_configure_display(optarg)) usage(argv[0]);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+#ifdef DISPLAY_REC
+    if (history != NULL) {
+        if (optind != argc || filename != NULL) usage(argv[0]);
+        return history_replay(history, history_start) ? 0 : -1;
+    }
+#endif
 
-    if (argc == 2) {
-        snddev = argv[1];
-    } else if (argc != 1) {
-        fprintf(stderr, "Usage: %s [sound device]\n", argv[0]);
-        return -1;
+    if (optind == argc - 1 && filename == NULL) {
+        snddev = argv[optind];
+    } else if (optind != argc) {
+        usage(argv[0]);
+    }
+    /* Default keeps the same overlap at every FFT size */
+    if (!hop_set) hop = numsamp * 2 / 3;
+    if (hop > numsamp) usage(argv[0]);
+    if (blocksize < 0) blocksize = hop;
+
+    /* Files should be shown completely, while live input must keep up */
+    if (policy < 0) {
+        policy = filename != NULL ? RGBM_PRESENT_BLOCK : RGBM_PRESENT_DROP;
     }
 
+    if (!rgbm_configure_fft(numsamp, effort, wisdom) ||
+        !rgbm_configure_analysis(analysis)) usage(argv[0]);
+    if (!rgbm_configure_present(policy, buffers) ||
+        !rgbm_configure_stale(stale_ms)) usage(argv[0]);
     if (!rgbm_init()) {
         error("initializing visualization");
     }
-    rgbm_get_wave_buffers(&left_samp, &right_samp);
+    wavefeed_init(hop);
 
-    sound_open(snddev);
+    if (filename != NULL) {
+        if (!file_visualize(filename, raw)) {
+            rgbm_shutdown();
+            return -1;
+        }
+    } else {
+        sound_open(snddev, blocksize);
 
-    sound_visualize();
+        sound_visualize(show_latency);
 
-    sound_close();
+        sound_close();
+    }
     rgbm_shutdown();
 
     return 0;
@@ -0,0 +1,360 @@
+/* Passes finished stripes to the display, normally via a separate thread */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <SDL.h>
+#include "present.h"
+#include "display.h"
+
+static int policy = RGBM_PRESENT_SYNC;
+
+/* How often the display is polled while no stripes arrive */
+#define IDLE_POLL_MS 16
+
+/*
+ * Stripe buffers are each either free, queued, being filled by
+ * present_stripe() or being displayed. The queue and free list hold
+ * buffer indices and are protected by lock.
+ */
+static unsigned int num_bufs, buf_width;
+static RGBM_STRIPETYPE *bufs;
+static unsigned int *queue, q_head, q_count;
+static unsigned int *free_list, num_free;
+/* Capture time of each buffer's stripe, or 0 if unknown */
+static uint64_t *buf_time;
+/* Position in the stream of each buffer's stripe, or 0 if unknown */
+static uint64_t *buf_stream;
+static uint64_t stale_ns;
+
+static SDL_Thread *thread;
+static SDL_mutex *lock;
+/* Signalled when a stripe is queued or when stopping */
+static SDL_cond *ready_cond;
+/* Signalled when a buffer is freed or when quit is requested */
+static SDL_cond *space_cond;
+static int init_result;
+static bool stopping, quit_requested;
+
+static unsigned long stripes_dropped, stripes_coalesced;
+
+/* Latency since present_latency() was last called, protected by lock
+ * unless policy is RGBM_PRESENT_SYNC. Totals are kept for the summary. */
+static struct rgbm_latency lat;
+static uint64_t lat_sum;
+static unsigned long total_stripes, total_stale;
+static uint64_t total_sum, total_max;
+
+static RGBM_STRIPETYPE *buf_channel(unsigned int buf, int channel) {
+    return &bufs[(buf * 3 + channel) * buf_width];
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Called after a stripe captured at capture_ns was displayed */
+static void record_latency(uint64_t capture_ns) {
+    uint64_t now, latency;
+
+    if (capture_ns == 0) return;
+    now = now_ns();
+    latency = now > capture_ns ? now - capture_ns : 0;
+    lat.stripes++;
+    lat.last_ns = latency;
+    lat_sum += latency;
+    if (latency > lat.max_ns) lat.max_ns = latency;
+    total_stripes++;
+    total_sum += latency;
+    if (latency > total_max) total_max = latency;
+}
+
+/* With RGBM_PRESENT_LATEST, frees queued stripes which have become stale
+ * while a newer one is waiting, so the display jumps to current audio
+ * instead of catching up through old rows. Called with lock held. */
+static void skip_stale(void) {
+    uint64_t now = now_ns();
+
+    while (q_count > 1) {
+        uint64_t t = buf_time[queue[q_head]];
+
+        if (t == 0 || t + stale_ns >= now) break;
+        free_list[num_free++] = queue[q_head];
+        q_head = (q_head + 1) % num_bufs;
+        q_count--;
+        lat.stale++;
+        total_stale++;
+    }
+}
+
+static int present_thread(void *unused) {
+    unsigned int buf;
+    uint64_t capture_ns, stream_ns;
+    bool quit;
+
+    quit = !display_init();
+
+    SDL_mutexP(lock);
+    init_result = quit ? -1 : 1;
+    SDL_CondSignal(ready_cond);
+    if (init_result < 0) {
+        SDL_mutexV(lock);
+        return 0;
+    }
+
+    while (true) {
+        while (q_count == 0 && !stopping) {
+            if (SDL_CondWaitTimeout(ready_cond, lock, IDLE_POLL_MS) ==
+                SDL_MUTEX_TIMEDOUT) {
+                /* Lets sinks finish showing the last stripes and notice
+                 * a closed window while audio is paused */
+                SDL_mutexV(lock);
+                quit = display_pollquit();
+                SDL_mutexP(lock);
+                if (quit) quit_requested = true;
+            }
+        }
+        /* Stripes queued before stopping are still displayed, so the
+         * end of a file isn't lost */
+        if (q_count == 0) break;
+
+        if (policy == RGBM_PRESENT_LATEST) skip_stale();
+        buf = queue[q_head];
+        q_head = (q_head + 1) % num_bufs;
+        q_count--;
+        capture_ns = buf_time[buf];
+        stream_ns = buf_stream[buf];
+        SDL_mutexV(lock);
+
+        display_set_time(stream_ns != 0 ? stream_ns : capture_ns);
+        display_render(buf_channel(buf, 0), buf_channel(buf, 1),
+                       buf_channel(buf, 2));
+        quit = display_pollquit();
+
+        SDL_mutexP(lock);
+        record_latency(capture_ns);
+        if (quit) quit_requested = true;
+        free_list[num_free++] = buf;
+        SDL_CondSignal(space_cond);
+    }
+    SDL_mutexV(lock);
+
+    display_quit();
+    return 0;
+}
+
+/* Frees the stripe queue and its synchronization, whether or not
+ * present_init() created all of it */
+static void free_queue(void) {
+    if (space_cond != NULL) SDL_DestroyCond(space_cond);
+    if (ready_cond != NULL) SDL_DestroyCond(ready_cond);
+    if (lock != NULL) SDL_DestroyMutex(lock);
+    space_cond = NULL;
+    ready_cond = NULL;
+    lock = NULL;
+    free(bufs);
+    free(buf_time);
+    free(buf_stream);
+    free(queue);
+    free(free_list);
+    bufs = NULL;
+    buf_time = NULL;
+    buf_stream = NULL;
+    queue = NULL;
+    free_list = NULL;
+}
+
+int present_init(int new_policy, unsigned int buffers,
+                 unsigned int stale_ms) {
+    policy = new_policy;
+    stale_ns = (uint64_t)stale_ms * 1000000;
+    memset(&lat, 0, sizeof(lat));
+    lat_sum = 0;
+    total_stripes = 0;
+    total_stale = 0;
+    total_sum = 0;
+    total_max = 0;
+    if (policy == RGBM_PRESENT_SYNC) return display_init();
+
+    buf_width = display_width();
+    num_bufs = buffers;
+    bufs = malloc(sizeof(RGBM_STRIPETYPE) * 3 * buf_width * num_bufs);
+    buf_time = malloc(sizeof(uint64_t) * num_bufs);
+    buf_stream = malloc(sizeof(uint64_t) * num_bufs);
+    queue = malloc(sizeof(unsigned int) * num_bufs);
+    free_list = malloc(sizeof(unsigned int) * num_bufs);
+    if (bufs == NULL || buf_time == NULL || buf_stream == NULL ||
+        queue == NULL || free_list == NULL) {
+        fprintf(stderr, "Error allocating stripe queue\n");
+        free_queue();
+        return false;
+    }
+    for (num_free = 0; num_free < num_bufs; num_free++) {
+        free_list[num_free] = num_free;
+    }
+    q_head = 0;
+    q_count = 0;
+    stopping = false;
+    quit_requested = false;
+    stripes_dropped = 0;
+    stripes_coalesced = 0;
+
+    lock = SDL_CreateMutex();
+    ready_cond = SDL_CreateCond();
+    space_cond = SDL_CreateCond();
+    if (lock == NULL || ready_cond == NULL || space_cond == NULL) {
+        fprintf(stderr, "Error creating stripe queue: %s\n",
+                SDL_GetError());
+        free_queue();
+        return false;
+    }
+
+    /* The display is initialized in its own thread, because some
+     * systems require video calls to come from the initializing thread. */
+    init_result = 0;
+    SDL_mutexP(lock);
+    thread = SDL_CreateThread(present_thread, NULL);
+    if (thread == NULL) {
+        SDL_mutexV(lock);
+        fprintf(stderr, "Error creating display thread: %s\n",
+                SDL_GetError());
+        free_queue();
+        return false;
+    }
+    while (init_result == 0) SDL_CondWait(ready_cond, lock);
+    SDL_mutexV(lock);
+
+    if (init_result < 0) {
+        SDL_WaitThread(thread, NULL);
+        thread = NULL;
+        free_queue();
+        return false;
+    }
+    return true;
+}
+
+/* Merges src into queued buffer dst, keeping the brighter value of each
+ * colour so short peaks remain visible. */
+static void coalesce_stripe(unsigned int dst, RGBM_STRIPETYPE **src,
+                            unsigned int width) {
+    unsigned int i;
+    int j;
+
+    for (j = 0; j < 3; j++) {
+        RGBM_STRIPETYPE *p = buf_channel(dst, j);
+        for (i = 0; i < width; i++) {
+            if (src[j][i] > p[i]) p[i] = src[j][i];
+        }
+    }
+}
+
+int present_stripe(RGBM_STRIPETYPE **stripe, unsigned int width,
+                   uint64_t capture_ns, uint64_t stream_ns) {
+    unsigned int buf;
+    int j, res;
+
+    if (policy == RGBM_PRESENT_SYNC) {
+        display_set_time(stream_ns != 0 ? stream_ns : capture_ns);
+        display_render(stripe[0], stripe[1], stripe[2]);
+        record_latency(capture_ns);
+        return !display_pollquit();
+    }
+
+    if (width > buf_width) width = buf_width;
+
+    SDL_mutexP(lock);
+    /* There are at least two buffers and the display thread only holds
+     * one, so if none are free then at least one is queued. */
+    while (num_free == 0 && !quit_requested) {
+        if (policy == RGBM_PRESENT_BLOCK) {
+            SDL_CondWait(space_cond, lock);
+        } else if (policy == RGBM_PRESENT_COALESCE) {
+            buf = queue[(q_head + q_count - 1) % num_bufs];
+            coalesce_stripe(buf, stripe, width);
+            /* Latency is counted from the newest audio it contains */
+            if (capture_ns != 0) buf_time[buf] = capture_ns;
+            if (stream_ns != 0) buf_stream[buf] = stream_ns;
+            stripes_coalesced++;
+            SDL_mutexV(lock);
+            return true;
+        } else {
+            free_list[num_free++] = queue[q_head];
+            q_head = (q_head + 1) % num_bufs;
+            q_count--;
+            stripes_dropped++;
+        }
+    }
+    if (quit_requested) {
+        SDL_mutexV(lock);
+        return false;
+    }
+    buf = free_list[--num_free];
+    SDL_mutexV(lock);
+
+    /* Buffer is owned by this thread now, so copy without the lock */
+    for (j = 0; j < 3; j++) {
+        memcpy(buf_channel(buf, j), stripe[j],
+               sizeof(RGBM_STRIPETYPE) * width);
+    }
+
+    SDL_mutexP(lock);
+    buf_time[buf] = capture_ns;
+    buf_stream[buf] = stream_ns;
+    queue[(q_head + q_count) % num_bufs] = buf;
+    q_count++;
+    SDL_CondSignal(ready_cond);
+    res = !quit_requested;
+    SDL_mutexV(lock);
+
+    return res;
+}
+
+int present_latency(struct rgbm_latency *result) {
+    if (policy != RGBM_PRESENT_SYNC) SDL_mutexP(lock);
+    *result = lat;
+    if (lat.stripes > 0) result->mean_ns = lat_sum / lat.stripes;
+    memset(&lat, 0, sizeof(lat));
+    lat_sum = 0;
+    if (policy != RGBM_PRESENT_SYNC) SDL_mutexV(lock);
+    return result->stripes > 0;
+}
+
+static void report_latency(void) {
+    if (total_stripes == 0) return;
+    fprintf(stderr, "Capture to display latency: mean %.1f ms, "
+                    "max %.1f ms", total_sum / 1e6 / total_stripes,
+            total_max / 1e6);
+    if (total_stale > 0) {
+        fprintf(stderr, ", %lu stale stripes skipped", total_stale);
+    }
+    fprintf(stderr, "\n");
+}
+
+void present_quit(void) {
+    if (policy == RGBM_PRESENT_SYNC) {
+        display_quit();
+        report_latency();
+        return;
+    }
+
+    if (thread != NULL) {
+        SDL_mutexP(lock);
+        stopping = true;
+        SDL_CondSignal(ready_cond);
+        SDL_mutexV(lock);
+        SDL_WaitThread(thread, NULL);
+        thread = NULL;
+    }
+    if (stripes_dropped != 0 || stripes_coalesced != 0) {
+        fprintf(stderr, "Stripes not displayed in time: %lu dropped, "
+                        "%lu coalesced\n",
+                stripes_dropped, stripes_coalesced);
+    }
+    report_latency();
+    free_queue();
+}
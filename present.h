@@ -0,0 +1,24 @@
+/* Header file for passing finished stripes to the display. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#ifndef _PRESENT_H_
+#define _PRESENT_H_
+
+#include "rgbm.h"
+
+/* Policy is one of RGBM_PRESENT_*, and buffers counts the stripe being
+ * displayed plus queued ones. Stripes older than stale_ms are skipped with
+ * RGBM_PRESENT_LATEST. Initializes the display, in a new thread unless
+ * policy is RGBM_PRESENT_SYNC. */
+int present_init(int policy, unsigned int buffers, unsigned int stale_ms);
+/* Queues a copy of stripe for display. Capture_ns is the CLOCK_MONOTONIC
+ * time of its newest sample, and stream_ns is its position in the
+ * stream, each 0 if unknown. Returns false when visualization should
+ * end. */
+int present_stripe(RGBM_STRIPETYPE **stripe, unsigned int width,
+                   uint64_t capture_ns, uint64_t stream_ns);
+/* As for rgbm_get_latency() */
+int present_latency(struct rgbm_latency *lat);
+void present_quit(void);
+
+#endif /* !_PRESENT_H_ */
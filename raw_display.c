@@ -0,0 +1,125 @@
+/* Display sink writing stripes as raw rgb24 video rows. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+/* Rows are DISPLAY_WIDTH pixels of red, green and blue bytes, written
+ * one after another to a file or pipe. For example, an encoder can
+ * read them with: ffmpeg -f rawvideo -pix_fmt rgb24 -s 640x1 -i - ...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#ifdef WIN32
+#include <io.h>
+#endif
+#include "display.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/* Rows collected before each write, to keep system calls infrequent */
+#define RAW_BUFFER_ROWS 32
+#define RAW_ROW_BYTES (DISPLAY_WIDTH * 3)
+
+struct raw_state {
+    int fd;
+    bool failed;
+    unsigned int rows;
+    unsigned char buf[RAW_BUFFER_ROWS * RAW_ROW_BYTES];
+};
+
+static bool raw_flush(struct raw_state *s) {
+    const unsigned char *p = s->buf;
+    size_t left = s->rows * RAW_ROW_BYTES;
+
+    s->rows = 0;
+    while (left > 0 && !s->failed) {
+        ssize_t res = write(s->fd, p, left);
+        if (res < 0) {
+            if (errno == EINTR) continue;
+            /* Reader going away is a normal way to end */
+            if (errno != EPIPE) perror("Error writing raw video");
+            s->failed = true;
+        } else {
+            p += res;
+            left -= res;
+        }
+    }
+    return !s->failed;
+}
+
+static void *raw_init(const char *arg) {
+    struct raw_state *s;
+
+    if (arg == NULL) {
+        fprintf(stderr, "Error: raw display needs a file name, "
+                        "or - for standard output\n");
+        return NULL;
+    }
+
+    s = malloc(sizeof(struct raw_state));
+    if (s == NULL) return NULL;
+    s->failed = false;
+    s->rows = 0;
+
+    if (!strcmp(arg, "-")) {
+        s->fd = STDOUT_FILENO;
+#ifdef WIN32
+        setmode(s->fd, O_BINARY);
+#endif
+    } else {
+        s->fd = open(arg, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+        if (s->fd < 0) {
+            perror(arg);
+            free(s);
+            return NULL;
+        }
+    }
+#ifdef SIGPIPE
+    /* Let writes to a closed pipe fail instead of killing the process */
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    return s;
+}
+
+static bool raw_render(void *state, RGBM_STRIPETYPE *r,
+                       RGBM_STRIPETYPE *g, RGBM_STRIPETYPE *b) {
+    struct raw_state *s = state;
+    unsigned char *p;
+    int i;
+
+    if (s->failed) return false;
+
+    p = &s->buf[s->rows * RAW_ROW_BYTES];
+    for (i = 0; i < DISPLAY_WIDTH; i++) {
+        *(p++) = display_clip(r[i]);
+        *(p++) = display_clip(g[i]);
+        *(p++) = display_clip(b[i]);
+    }
+
+    if (++s->rows == RAW_BUFFER_ROWS) return raw_flush(s);
+    return true;
+}
+
+static bool raw_pollquit(void *state) {
+    struct raw_state *s = state;
+    return s->failed;
+}
+
+static void raw_quit(void *state) {
+    struct raw_state *s = state;
+
+    raw_flush(s);
+    if (s->fd != STDOUT_FILENO) close(s->fd);
+    free(s);
+}
+
+const struct display_backend display_raw = {
+    "raw", raw_init, raw_render, raw_pollquit, raw_quit
+};
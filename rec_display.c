@@ -0,0 +1,42 @@
+/* Display sink recording stripes to a memory mapped history file. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#include <stdio.h>
+#include "display.h"
+#include "stripehist.h"
+
+/* Arg is the history file name */
+static void *rec_init(const char *arg) {
+    if (arg == NULL || arg[0] == '\0') {
+        fprintf(stderr, "Error: rec sink needs a file name\n");
+        return NULL;
+    }
+    return stripehist_create(arg, DISPLAY_WIDTH);
+}
+
+static bool rec_render(void *state, RGBM_STRIPETYPE *r,
+                       RGBM_STRIPETYPE *g, RGBM_STRIPETYPE *b) {
+    unsigned char *p = stripehist_begin(state);
+    int i;
+
+    if (p == NULL) return false;
+    for (i = 0; i < DISPLAY_WIDTH; i++) {
+        *(p++) = display_clip(r[i]);
+        *(p++) = display_clip(g[i]);
+        *(p++) = display_clip(b[i]);
+    }
+    stripehist_append(state, display_time());
+    return true;
+}
+
+static bool rec_pollquit(void *state) {
+    return false;
+}
+
+static void rec_quit(void *state) {
+    stripehist_close(state);
+}
+
+const struct display_backend display_rec = {
+    "rec", rec_init, rec_render, rec_pollquit, rec_quit
+};
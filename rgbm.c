@@ -6,31 +6,19 @@
 
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <pthread.h>
 #include "rgbm.h"
-#include "display.h"
 #ifdef RGBM_LOGGING
 #include <stdio.h>
 #endif
 
-#if defined(RGBM_AUDACIOUS) || defined(RGBM_FFT)
-
-/* Audacious only gives mono frequency data, and this needs stereo. */
-#ifndef RGBM_FFT
-#define RGBM_FFT
-#endif
-
-#define RGBPORT "/dev/ttyUSB0"
 /* Calibrated in Audacious 3.4 in Ubuntu 13.10 */
 /* Frequency of bin is (i+1)*44100/512 (array starts with i=0).
  * Value corresponds to amplitude (not power or dB).
  */
 
-/* Moving average size when value is increasing */
-#define RGBM_AVGUP 5
-/* Moving average size when value is decreasing */
-#define RGBM_AVGDN 15
-
 /* Colour scaling to balance red and blue with green */
 #define RGBM_REDSCALE 2.40719835270744
 #define RGBM_BLUESCALE 1.60948950058501
@@ -39,68 +27,93 @@
 #define RGBM_SCALE (12000.0)
 #define RGBM_LIMIT 4095
 
-/* Table for bin weights for summing bin powers (amplitued squared) to green.
- * Below RGBM_PIVOTBIN, red + green = 1.0. At and above, red + blue = 1.0.
+/* Tables for bin weights for summing bin powers (amplitued squared) to
+ * green, and for adjusting bin amplitudes using equal loudness contour,
+ * are computed for the FFT size in rgbm_ctx_create(). Below pivot_bin,
+ * red + green = 1.0. At and above, red + blue = 1.0. Supported FFT sizes
+ * have them computed while compiling, in rgbm_engine.cc.
  */
-#include "greentab_audacious.h"
-
-/* Table for adjusting bin amplitudes using equal loudness contour. */
 #define HAVE_FREQ_ADJ
-static const double freq_adj[RGBM_USEBINS] = {
-#include "freqadj_audacious.h"
-};
-
-#elif defined(RGBM_WINAMP)
-
-#define RGBPORT "COM8"
-
-/* Calibrated in Winamp v5.666 Build 3512 (x86)
- * Frequency of bin roughly corresponds to (i - 1) * 44100 / 1024
- * This doesn't behave like a good FFT. Increased amplitude causes
- * peak to broaden more than it grows. I don't know the mathematical
- * connection between the signal and bins.
- */
+#include "rgbm_tables.h"
+#include "rgbm_engine.h"
 
-/* Moving average size when value is increasing */
-#define RGBM_AVGUP 7
-/* Moving average size when value is decreasing */
-#define RGBM_AVGDN 20
+/* Constant-Q bins are a semitone apart */
+#define RGBM_CQ_BINS_PER_OCTAVE 12
+/* Kernel weights smaller than this fraction of the largest weight in
+ * their row are left out, keeping the kernels sparse */
+#define RGBM_CQ_THRESHOLD 0.01
 
-/* Colour scaling to balance red and blue with green.
- * Calibrated using pink noise, after setting above parameters.
- */
-#define RGBM_REDSCALE 2.25818534475793
-#define RGBM_BLUESCALE 1.337960735802697
-
-/* Overall scaling to adapt output to values needed by librgblamp */
-#define RGBM_SCALE (3.5)
-#define RGBM_LIMIT 4095
-
-#include "greentab_winamp.h"
-
-#else
-#error Need to set define for type of music player.
-#endif
-
-#ifdef RGBM_FFT
 #include <fftw3.h>
+#ifdef RGBM_FLOAT
+#define FFTW(name) fftwf_ ## name
+#else
+#define FFTW(name) fftw_ ## name
 #endif
+#include "rgbm_simd.h"
 
 /*
- * Static global variables
+ * Analysis state
  */
 
-static double binavg[3];
-/* Set after successful PWM write, and enables rgb_matchpwm afterwards */
-static int wrotepwm;
+struct rgbm_ctx {
+    unsigned int width;
+    int use_bins, pivot_bin;
+    const double *green_tab, *freq_adj;
+    double *green_tab_buf, *freq_adj_buf;
+    /* Tables computed while compiling for the FFT size, if any */
+    const struct rgbm_engine *engine;
+    unsigned int num_samp;
+    /* Both channels are transformed together, with left as the real part
+     * and right as the imaginary part of an in-place complex FFT. */
+    FFTW(plan) fft_plan;
+    FFTW(complex) *fft_buf;
+    RGBM_SAMPTYPE *fft_in_l, *fft_in_r, *hamming;
+    RGBM_BINTYPE *fft_bins_l, *fft_bins_r;
+    int analysis;
+    /* Constant-Q kernels in compressed sparse row form. Bin k sums
+     * spectrum entries cq_col[cq_row[k]] to cq_col[cq_row[k + 1] - 1],
+     * which ascend, times complex weights in cq_val. */
+    unsigned int *cq_row, *cq_col;
+    RGBM_SAMPTYPE *cq_val;
+    /* Left real, left imaginary, right real and right imaginary parts
+     * of the spectrum, interleaved, up to the highest column used */
+    RGBM_SAMPTYPE *cq_spec;
+    unsigned int cq_cols;
+    /* Sliding DFT of the newest num_samp samples, without window, for
+     * bins 0 to use_bins. Each sample rotates every bin by sdft_rot.
+     * Samples are kept in a ring starting at the oldest, sdft_pos, so
+     * bins can be recomputed exactly after sdft_until_resync more. */
+    RGBM_SAMPTYPE *sdft_re_l, *sdft_im_l, *sdft_re_r, *sdft_im_r;
+    RGBM_SAMPTYPE *sdft_rot_re, *sdft_rot_im;
+    RGBM_SAMPTYPE *sdft_hist_l, *sdft_hist_r;
+    unsigned int sdft_pos, sdft_until_resync;
+    /* Bin power weights for green, and for red below pivot_bin or blue
+     * at and above it. These combine green_tab with the square of
+     * freq_adj. */
+    const RGBM_STRIPETYPE *green_w, *other_w;
+    RGBM_STRIPETYPE *green_w_buf, *other_w_buf;
+    /* Per-bin results of rgbm_weigh_bins() */
+    int *pos;
+    RGBM_STRIPETYPE *green, *other;
+    /* Energy going left from each pixel, for peakify_stripe_linear() */
+    double *left_rem;
+    unsigned int left_rem_width;
+    /* Output stripe, with pointers to red, green and blue parts */
+    RGBM_STRIPETYPE *stripe_alloc;
+    RGBM_STRIPETYPE *stripe[3];
+
+    double binavg[3];
+    /* Set after successful PWM write, and enables rgb_matchpwm
+     * afterwards */
+    int wrotepwm;
+};
+
+/* The FFTW planner and wisdom are shared by all threads */
+static pthread_mutex_t plan_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t simd_once = PTHREAD_ONCE_INIT;
 
-#ifdef RGBM_FFT
-static fftw_plan fft_plan_l, fft_plan_r;
-static double *fft_in_l, *fft_in_r, *fft_out_l, *fft_out_r;
-static double hamming[RGBM_NUMSAMP];
-#endif
 #ifdef RGBM_LOGGING
-static double testsum[RGBM_USEBINS];
+static double testsum[RGBM_MAX_NUMSAMP / 2];
 static unsigned int testctr;
 FILE *testlog = NULL;
 static double avgavg[3];
@@ -111,46 +124,39 @@ static double avgavg[3];
  * Internal routines
  */
 
-static void sum_to_stripe(const RGBM_BINTYPE left_bins[RGBM_NUMBINS],
-                          const RGBM_BINTYPE right_bins[RGBM_NUMBINS],
-                          double **stripe, unsigned int width){
-    int rgb, i = 0, limit = RGBM_PIVOTBIN, lr;
-    const RGBM_BINTYPE *left_right[2] = { left_bins, right_bins };
-
-    /* First, sum other to red before pivot.
-     * Then sum other to blue from pivot to end
-     */
-    for (rgb = 0; rgb < 3; rgb += 2) {
-        for (; i < limit; i++) {
-            double green[2], other[2], total;
-            int pos;
-
-            for (lr = 0; lr <= 1; lr++) {
-                double bin = left_right[lr][i];
+static void weights_init(rgbm_ctx *ctx) {
+    int i;
+
+    for (i = 0; i < ctx->use_bins; i++) {
+        double adj = 1.0;
 #ifdef HAVE_FREQ_ADJ
-                bin *= freq_adj[i];
+        adj = ctx->freq_adj[i] * ctx->freq_adj[i];
 #endif
-                bin *= bin;
-                green[lr] = green_tab[i] * bin;
-                other[lr] = bin - green[lr];
-            }
+        ctx->green_w_buf[i] = adj * ctx->green_tab[i];
+        ctx->other_w_buf[i] = adj * (1.0 - ctx->green_tab[i]);
+    }
+}
 
-            /* This calculation needs non-negative bin values. */
-            total = left_right[0][i] + left_right[1][i];
-            if (total > 0) {
-                pos = (double)((width - 1) * left_right[1][i]) / total + 0.5;
-                if (pos >= width) {
-                    pos = width - 1;
-                } else if (pos < 0) {
-                    pos = 0;
-                }
-            } else {
-                pos = width / 2;
-            }
-            stripe[rgb][pos] += other[0] + other[1];
-            stripe[1][pos] += green[0] + green[1];
-        }
-        limit = RGBM_USEBINS;
+static void sum_to_stripe(rgbm_ctx *ctx, const RGBM_BINTYPE left_bins[],
+                          const RGBM_BINTYPE right_bins[],
+                          RGBM_STRIPETYPE **stripe, unsigned int width){
+    const int *pos = ctx->pos;
+    const RGBM_STRIPETYPE *green = ctx->green, *other = ctx->other;
+    int i;
+
+    rgbm_weigh_bins(left_bins, right_bins, ctx->green_w, ctx->other_w,
+                    ctx->use_bins, width, ctx->pos, ctx->green, ctx->other);
+
+    /* Scatter one bin at a time, so bins landing on the same pixel
+     * add up. First, sum other to red before pivot. Then sum other
+     * to blue from pivot to end. */
+    for (i = 0; i < ctx->pivot_bin; i++) {
+        stripe[0][pos[i]] += other[i];
+        stripe[1][pos[i]] += green[i];
+    }
+    for (; i < ctx->use_bins; i++) {
+        stripe[2][pos[i]] += other[i];
+        stripe[1][pos[i]] += green[i];
     }
 } /* rgbm_sumbins */
 
@@ -178,15 +184,15 @@ static void rgbm_avgsums(const double sums[3],
 #endif
 
 #ifdef RGBM_LOGGING
-static void rgbm_testsum(const RGBM_BINTYPE bins[RGBM_NUMBINS]) {
+static void rgbm_testsum(rgbm_ctx *ctx, const RGBM_BINTYPE bins[]) {
     int i;
 
     if (testlog == NULL) return;
 
-    for (i = 0; i < RGBM_USEBINS; i++) {
+    for (i = 0; i < ctx->use_bins; i++) {
         double bin = bins[i];
 #ifdef HAVE_FREQ_ADJ
-        bin *= freq_adj[i];
+        bin *= ctx->freq_adj[i];
 #endif
         testsum[i] = (testsum[i] * (RGBM_TESTAVGSIZE - 1) + bin)
                      / RGBM_TESTAVGSIZE;
@@ -194,7 +200,7 @@ static void rgbm_testsum(const RGBM_BINTYPE bins[RGBM_NUMBINS]) {
 
     if (testctr++ >= RGBM_TESTAVGSIZE) {
         testctr = 0;
-        for (i = 0; i < RGBM_USEBINS; i++) {
+        for (i = 0; i < ctx->use_bins; i++) {
             fprintf(testlog, "%i:%f\n", i, testsum[i]);
         }
     }
@@ -202,57 +208,318 @@ static void rgbm_testsum(const RGBM_BINTYPE bins[RGBM_NUMBINS]) {
 #endif /* RGBM_LOGGING */
 
 /*
- * Interface routines
+ * Context creation
  */
 
-int rgbm_init(void) {
+static void simd_init_once(void) {
+    rgbm_simd_init();
+}
+
+/* Computes sparse spectral kernels for constant-Q bins at frequencies hz.
+ * Each temporal kernel is a windowed complex sinusoid Q periods long,
+ * aligned with the newest samples, but limited to the FFT size, so the
+ * lowest bins are wider when the FFT is small. Its FFT is computed with
+ * the context's plan, and weights large enough to matter are stored.
+ */
+static bool cq_init(rgbm_ctx *ctx, const double *hz) {
+    unsigned int num_samp = ctx->num_samp, nnz = 0, alloc = 0;
+    double q = 1.0 / (pow(2, 1.0 / RGBM_CQ_BINS_PER_OCTAVE) - 1);
+    int k, i;
+
+    ctx->cq_row = (unsigned int *)malloc(sizeof(unsigned int) *
+                                         (ctx->use_bins + 1));
+    if (ctx->cq_row == NULL) return false;
+    ctx->cq_row[0] = 0;
+    ctx->cq_cols = 1;
+
+    for (k = 0; k < ctx->use_bins; k++) {
+        unsigned int len = q * RGBM_TABLES_RATE / hz[k];
+        double peak = 0.0;
+
+        if (len > num_samp) len = num_samp;
+        for (i = 0; i < num_samp; i++) {
+            ctx->fft_buf[i][0] = 0.0;
+            ctx->fft_buf[i][1] = 0.0;
+        }
+        for (i = 0; i < len; i++) {
+            /* Same window and scaling as for the FFT at default size */
+            double w = (1 - 0.852 * cos(2 * M_PI * i / (len - 1))) *
+                       RGBM_NUMSAMP / len;
+            double ph = 2 * M_PI * hz[k] * i / RGBM_TABLES_RATE;
+            ctx->fft_buf[num_samp - len + i][0] = w * cos(ph);
+            ctx->fft_buf[num_samp - len + i][1] = w * sin(ph);
+        }
+        FFTW(execute)(ctx->fft_plan);
+
+        for (i = 1; i < num_samp / 2; i++) {
+            double m = hypot(ctx->fft_buf[i][0], ctx->fft_buf[i][1]);
+            if (m > peak) peak = m;
+        }
+        for (i = 1; i < num_samp / 2; i++) {
+            if (hypot(ctx->fft_buf[i][0], ctx->fft_buf[i][1]) <
+                peak * RGBM_CQ_THRESHOLD) continue;
+
+            if (nnz == alloc) {
+                unsigned int *col;
+                RGBM_SAMPTYPE *val;
+
+                alloc = alloc > 0 ? alloc * 2 : ctx->use_bins * 16;
+                /* Old blocks stay in ctx until replaced, so the context
+                 * destructor frees them if growing fails */
+                col = (unsigned int *)realloc(ctx->cq_col,
+                                              sizeof(unsigned int) * alloc);
+                if (col == NULL) return false;
+                ctx->cq_col = col;
+                val = (RGBM_SAMPTYPE *)realloc(ctx->cq_val,
+                                               sizeof(RGBM_SAMPTYPE) * 2 *
+                                               alloc);
+                if (val == NULL) return false;
+                ctx->cq_val = val;
+            }
+            /* By Parseval's theorem, correlating with the temporal kernel
+             * is the same as summing spectrum times conjugate kernel
+             * spectrum, divided by FFT size. */
+            ctx->cq_col[nnz] = i;
+            ctx->cq_val[nnz * 2] = ctx->fft_buf[i][0] / num_samp;
+            ctx->cq_val[nnz * 2 + 1] = -ctx->fft_buf[i][1] / num_samp;
+            nnz++;
+            if (i >= ctx->cq_cols) ctx->cq_cols = i + 1;
+        }
+        ctx->cq_row[k + 1] = nnz;
+    }
+
+    ctx->cq_spec = (RGBM_SAMPTYPE *)malloc(sizeof(RGBM_SAMPTYPE) * 4 *
+                                           ctx->cq_cols);
+    return ctx->cq_spec != NULL;
+}
+
+static bool sdft_init(rgbm_ctx *ctx) {
+    unsigned int num_samp = ctx->num_samp, nb = ctx->use_bins + 1;
+    int k;
+
+    ctx->sdft_re_l = (RGBM_SAMPTYPE *)calloc(nb, sizeof(RGBM_SAMPTYPE));
+    ctx->sdft_im_l = (RGBM_SAMPTYPE *)calloc(nb, sizeof(RGBM_SAMPTYPE));
+    ctx->sdft_re_r = (RGBM_SAMPTYPE *)calloc(nb, sizeof(RGBM_SAMPTYPE));
+    ctx->sdft_im_r = (RGBM_SAMPTYPE *)calloc(nb, sizeof(RGBM_SAMPTYPE));
+    ctx->sdft_rot_re = (RGBM_SAMPTYPE *)malloc(sizeof(RGBM_SAMPTYPE) * nb);
+    ctx->sdft_rot_im = (RGBM_SAMPTYPE *)malloc(sizeof(RGBM_SAMPTYPE) * nb);
+    ctx->sdft_hist_l = (RGBM_SAMPTYPE *)calloc(num_samp,
+                                               sizeof(RGBM_SAMPTYPE));
+    ctx->sdft_hist_r = (RGBM_SAMPTYPE *)calloc(num_samp,
+                                               sizeof(RGBM_SAMPTYPE));
+    if (ctx->sdft_re_l == NULL || ctx->sdft_im_l == NULL ||
+        ctx->sdft_re_r == NULL || ctx->sdft_im_r == NULL ||
+        ctx->sdft_rot_re == NULL || ctx->sdft_rot_im == NULL ||
+        ctx->sdft_hist_l == NULL || ctx->sdft_hist_r == NULL)
+        return false;
+
+    for (k = 0; k < nb; k++) {
+        ctx->sdft_rot_re[k] = cos(2 * M_PI * k / num_samp);
+        ctx->sdft_rot_im[k] = sin(2 * M_PI * k / num_samp);
+    }
+    /* All zero, like the window before any samples arrive */
+    ctx->sdft_pos = 0;
+    ctx->sdft_until_resync = num_samp;
+    return true;
+}
+
+static bool fft_init(rgbm_ctx *ctx, int effort, const char *wisdom_file) {
+    static const unsigned int effort_flags[] = {
+        FFTW_ESTIMATE, FFTW_MEASURE, FFTW_PATIENT
+    };
+    unsigned int flags = effort_flags[effort];
+    unsigned int num_samp = ctx->num_samp;
+    double *cq_hz = NULL;
+    bool ok;
     int i;
 
-#ifdef RGBM_FFT
-    fft_in_l = (double *)fftw_malloc(sizeof(double) * RGBM_NUMSAMP);
-    fft_in_r = (double *)fftw_malloc(sizeof(double) * RGBM_NUMSAMP);
-    fft_out_l = (double *)fftw_malloc(sizeof(double) * RGBM_NUMSAMP);
-    fft_out_r = (double *)fftw_malloc(sizeof(double) * RGBM_NUMSAMP);
-    fft_plan_l = fftw_plan_r2r_1d(RGBM_NUMSAMP,
-                                  fft_in_l, fft_out_l,
-                                  FFTW_R2HC,
-                                  FFTW_ESTIMATE | FFTW_DESTROY_INPUT);
-    fft_plan_r = fftw_plan_r2r_1d(RGBM_NUMSAMP,
-                                  fft_in_r, fft_out_r,
-                                  FFTW_R2HC,
-                                  FFTW_ESTIMATE | FFTW_DESTROY_INPUT);
-    for (i = 0; i < RGBM_NUMSAMP; i++) {
-        /* This has been scaled to maintain amplitude */
-        hamming[i] = 1 - 0.852 * cos(2 * M_PI * i / (RGBM_NUMSAMP - 1));
+    if (ctx->analysis == RGBM_ANALYSIS_CQ) {
+        ctx->use_bins = rgbm_tables_cq_bins(RGBM_CQ_BINS_PER_OCTAVE);
+        cq_hz = (double *)malloc(sizeof(double) * ctx->use_bins);
+        if (cq_hz == NULL) return false;
+        rgbm_tables_cq_hz(cq_hz, RGBM_CQ_BINS_PER_OCTAVE);
+    } else {
+        ctx->use_bins = rgbm_tables_usebins(num_samp);
+    }
+    ctx->fft_in_l = (RGBM_SAMPTYPE *)FFTW(malloc)(sizeof(RGBM_SAMPTYPE) *
+                                                  num_samp);
+    ctx->fft_in_r = (RGBM_SAMPTYPE *)FFTW(malloc)(sizeof(RGBM_SAMPTYPE) *
+                                                  num_samp);
+    ctx->fft_buf = (FFTW(complex) *)FFTW(malloc)(sizeof(FFTW(complex)) *
+                                                 num_samp);
+    ctx->fft_bins_l = (RGBM_BINTYPE *)malloc(sizeof(RGBM_BINTYPE) *
+                                             ctx->use_bins);
+    ctx->fft_bins_r = (RGBM_BINTYPE *)malloc(sizeof(RGBM_BINTYPE) *
+                                             ctx->use_bins);
+    ctx->hamming = (RGBM_SAMPTYPE *)malloc(sizeof(RGBM_SAMPTYPE) * num_samp);
+    ctx->green_tab_buf = (double *)malloc(sizeof(double) * ctx->use_bins);
+    ctx->freq_adj_buf = (double *)malloc(sizeof(double) * ctx->use_bins);
+    if (ctx->fft_in_l == NULL || ctx->fft_in_r == NULL ||
+        ctx->fft_buf == NULL || ctx->fft_bins_l == NULL ||
+        ctx->fft_bins_r == NULL || ctx->hamming == NULL ||
+        ctx->green_tab_buf == NULL || ctx->freq_adj_buf == NULL) {
+        free(cq_hz);
+        return false;
     }
-#endif
 
-    if (!display_init())
+    pthread_mutex_lock(&plan_lock);
+    /* Failure is fine. It just means plans need to be computed. */
+    if (wisdom_file != NULL) FFTW(import_wisdom_from_filename)(wisdom_file);
+
+    /* Planning with more effort than FFTW_ESTIMATE overwrites buffers,
+     * but they don't contain anything yet. */
+    ctx->fft_plan = FFTW(plan_dft_1d)(num_samp, ctx->fft_buf, ctx->fft_buf,
+                                      FFTW_FORWARD, flags);
+
+    if (ctx->fft_plan != NULL && wisdom_file != NULL &&
+        effort != RGBM_PLAN_ESTIMATE)
+        FFTW(export_wisdom_to_filename)(wisdom_file);
+    pthread_mutex_unlock(&plan_lock);
+    if (ctx->fft_plan == NULL) {
+        free(cq_hz);
         return false;
+    }
+
+    if (cq_hz != NULL) {
+        /* Kernels contain the window */
+        for (i = 0; i < num_samp; i++) ctx->hamming[i] = 1.0;
+        ctx->pivot_bin = rgbm_tables_green_hz(ctx->green_tab_buf, cq_hz,
+                                              ctx->use_bins);
+        rgbm_tables_freq_adj_hz(ctx->freq_adj_buf, cq_hz, ctx->use_bins);
+        ok = cq_init(ctx, cq_hz);
+        free(cq_hz);
+        if (!ok) return false;
+    } else {
+        if (ctx->analysis == RGBM_ANALYSIS_SDFT && !sdft_init(ctx))
+            return false;
+        for (i = 0; i < num_samp; i++) {
+            /* This has been scaled to maintain amplitude. Scaling by FFT
+             * size keeps the same brightness as with the default size. */
+            ctx->hamming[i] = (1 - 0.852 * cos(2 * M_PI * i /
+                                               (num_samp - 1))) *
+                              RGBM_NUMSAMP / num_samp;
+        }
+        ctx->engine = rgbm_engine_find(num_samp);
+        if (ctx->engine != NULL) {
+            ctx->pivot_bin = ctx->engine->pivot_bin;
+            ctx->green_tab = ctx->engine->green_tab;
+            ctx->freq_adj = ctx->engine->freq_adj;
+            return true;
+        }
+        ctx->pivot_bin = rgbm_tables_green(ctx->green_tab_buf, ctx->use_bins,
+                                           num_samp);
+        rgbm_tables_freq_adj(ctx->freq_adj_buf, ctx->use_bins, num_samp);
+    }
+    ctx->green_tab = ctx->green_tab_buf;
+    ctx->freq_adj = ctx->freq_adj_buf;
 
-    for (i = 0; i < 3; i++) binavg[i] = 0.0;
-#ifdef RGBM_LOGGING
-    for (i = 0; i < RGBM_USEBINS; i++) testsum[i] = 0.0;
-    testlog = fopen("rgbm.log", "w");
-    testctr = 0;
-#endif
-    wrotepwm = 0;
     return true;
 }
 
-void rgbm_shutdown(void) {
-    display_quit();
-#ifdef RGBM_FFT
-    fftw_destroy_plan(fft_plan_l);
-    fftw_destroy_plan(fft_plan_r);
-    fftw_free(fft_in_l);
-    fftw_free(fft_in_r);
-    fftw_free(fft_out_l);
-    fftw_free(fft_out_r);
-#endif
-#ifdef RGBM_LOGGING
-    if (testlog != NULL) fclose(testlog);
-#endif
+rgbm_ctx *rgbm_ctx_create(unsigned int width, unsigned int numsamp,
+                          int analysis, int effort,
+                          const char *wisdom_file) {
+    rgbm_ctx *ctx;
+    int i;
+
+    if (numsamp < RGBM_MIN_NUMSAMP || numsamp > RGBM_MAX_NUMSAMP ||
+        analysis < RGBM_ANALYSIS_FFT || analysis > RGBM_ANALYSIS_SDFT ||
+        effort < RGBM_PLAN_ESTIMATE || effort > RGBM_PLAN_PATIENT)
+        return NULL;
+    if (width == 0) return NULL;
+
+    pthread_once(&simd_once, simd_init_once);
+
+    ctx = (rgbm_ctx *)calloc(1, sizeof(rgbm_ctx));
+    if (ctx == NULL) return NULL;
+    ctx->width = width;
+
+    ctx->num_samp = numsamp;
+    ctx->analysis = analysis;
+    if (!fft_init(ctx, effort, wisdom_file)) {
+        rgbm_ctx_destroy(ctx);
+        return NULL;
+    }
+
+    ctx->pos = (int *)malloc(sizeof(int) * ctx->use_bins);
+    ctx->green = (RGBM_STRIPETYPE *)malloc(sizeof(RGBM_STRIPETYPE) *
+                                           ctx->use_bins);
+    ctx->other = (RGBM_STRIPETYPE *)malloc(sizeof(RGBM_STRIPETYPE) *
+                                           ctx->use_bins);
+    ctx->left_rem = (double *)malloc(sizeof(double) * 3 * width);
+    ctx->left_rem_width = width;
+    ctx->stripe_alloc = (RGBM_STRIPETYPE *)malloc(sizeof(RGBM_STRIPETYPE) *
+                                                  3 * width);
+    if (ctx->pos == NULL || ctx->green == NULL || ctx->other == NULL || ctx->left_rem == NULL ||
+        ctx->stripe_alloc == NULL) {
+        rgbm_ctx_destroy(ctx);
+        return NULL;
+    }
+    for (i = 0; i < 3; i++) {
+        ctx->stripe[i] = &ctx->stripe_alloc[width * i];
+    }
+
+    if (ctx->engine != NULL) {
+        ctx->green_w = ctx->engine->green_w;
+        ctx->other_w = ctx->engine->other_w;
+    } else {
+        ctx->green_w_buf = (RGBM_STRIPETYPE *)
+            malloc(sizeof(RGBM_STRIPETYPE) * ctx->use_bins);
+        ctx->other_w_buf = (RGBM_STRIPETYPE *)
+            malloc(sizeof(RGBM_STRIPETYPE) * ctx->use_bins);
+        if (ctx->green_w_buf == NULL || ctx->other_w_buf == NULL) {
+            rgbm_ctx_destroy(ctx);
+            return NULL;
+        }
+        weights_init(ctx);
+        ctx->green_w = ctx->green_w_buf;
+        ctx->other_w = ctx->other_w_buf;
+    }
+
+    for (i = 0; i < 3; i++) ctx->binavg[i] = 0.0;
+    ctx->wrotepwm = 0;
+    return ctx;
+}
+
+void rgbm_ctx_destroy(rgbm_ctx *ctx) {
+    if (ctx == NULL) return;
+    if (ctx->fft_plan != NULL) {
+        pthread_mutex_lock(&plan_lock);
+        FFTW(destroy_plan)(ctx->fft_plan);
+        pthread_mutex_unlock(&plan_lock);
+    }
+    FFTW(free)(ctx->fft_in_l);
+    FFTW(free)(ctx->fft_in_r);
+    FFTW(free)(ctx->fft_buf);
+    free(ctx->fft_bins_l);
+    free(ctx->fft_bins_r);
+    free(ctx->hamming);
+    free(ctx->green_tab_buf);
+    free(ctx->freq_adj_buf);
+    free(ctx->cq_row);
+    free(ctx->cq_col);
+    free(ctx->cq_val);
+    free(ctx->cq_spec);
+    free(ctx->sdft_re_l);
+    free(ctx->sdft_im_l);
+    free(ctx->sdft_re_r);
+    free(ctx->sdft_im_r);
+    free(ctx->sdft_rot_re);
+    free(ctx->sdft_rot_im);
+    free(ctx->sdft_hist_l);
+    free(ctx->sdft_hist_r);
+    free(ctx->green_w_buf);
+    free(ctx->other_w_buf);
+    free(ctx->pos);
+    free(ctx->green);
+    free(ctx->other);
+    free(ctx->left_rem);
+    free(ctx->stripe_alloc);
+    free(ctx);
+}
+
+unsigned int rgbm_ctx_width(const rgbm_ctx *ctx) {
+    return ctx->width;
 }
 
 #if 0
@@ -272,12 +539,10 @@ static int rgb_pwm2srgb(double n) {
 #endif
 
 #define sqrt_mult (100.0)
-static void sqrt_stripe(double **stripe, unsigned int width) {
-    int i, j;
+static void sqrt_stripe(RGBM_STRIPETYPE **stripe, unsigned int width) {
+    int i;
     for (i = 0; i < 3; i++) {
-        for (j = 0; j < width; j++) {
-            stripe[i][j] = sqrt(stripe[i][j]) * sqrt_mult;
-        }
+        rgbm_sqrt_scale(stripe[i], width, sqrt_mult);
     }
 }
 
@@ -321,7 +586,7 @@ static void peakify_stripe(double **stripe, unsigned int width) {
 
 //#define pixel_bound (255.0*255.0/sqrt_mult/sqrt_mult)
 #define pixel_bound (255.0)
-static bool bound_pixel(double **stripe, unsigned int index,
+static bool bound_pixel(RGBM_STRIPETYPE **stripe, unsigned int index,
                         double *rem) {
     int j;
     double max_col = stripe[0][index];
@@ -343,7 +608,12 @@ static bool bound_pixel(double **stripe, unsigned int index,
     }
 }
 
-static void peakify_stripe(double **stripe, unsigned int width) {
+/* Original algorithm, which walks left from every overflowing pixel.
+ * With many saturated neighbours this takes time proportional to the
+ * square of width. Define RGBM_PEAKIFY_WALK to use it. */
+#if defined(RGBM_PEAKIFY_WALK) || defined(RGBM_BENCH)
+static void peakify_stripe_walk(RGBM_STRIPETYPE **stripe,
+                                unsigned int width) {
     int i, j, k;
     double reml[3], remr[3] = { 0.0, 0.0, 0.0 };
 
@@ -373,111 +643,312 @@ static void peakify_stripe(double **stripe, unsigned int width) {
         }
     }
 }
+#endif
 
-static void zero_stripe(double **stripe, unsigned int width) {
+/* Same energy flow as peakify_stripe_walk(), in time proportional to
+ * width. Energy going left from each pixel is saved during the rightward
+ * pass. Then a single leftward pass carries all of it together, with
+ * each pixel absorbing what it has room for and passing on the rest.
+ * Only the order in which colours mix while passing through saturated
+ * pixels differs.
+ */
+#if !defined(RGBM_PEAKIFY_WALK) || defined(RGBM_BENCH)
+static void peakify_stripe_linear(rgbm_ctx *ctx, RGBM_STRIPETYPE **stripe,
+                                  unsigned int width) {
+    double *left_rem;
     int i, j;
-    for (i = 0; i < 3; i++) {
-        for (j = 0; j < width; j++) {
-            stripe[i][j] = 0;
+    double rem[3], carry[3] = { 0.0, 0.0, 0.0 };
+
+    if (width > ctx->left_rem_width) {
+        free(ctx->left_rem);
+        ctx->left_rem = malloc(width * 3 * sizeof(double));
+        if (ctx->left_rem == NULL) {
+            ctx->left_rem_width = 0;
+            return;
         }
+        ctx->left_rem_width = width;
     }
-}
+    left_rem = ctx->left_rem;
 
-static double **get_stripe(unsigned int width) {
-    static unsigned int cur_width = 0;
-    static double *cur_alloc = NULL;
-    static double *rgb_ptrs[3] = { NULL, NULL, NULL };
+    for (i = 0; i < width; i++) {
+        bound_pixel(stripe, i, rem);
 
-    if (width != cur_width) {
-        if (cur_alloc != NULL) free(cur_alloc);
+        for (j = 0; j < 3; j++) {
+            /* Half of overflow energy propagates in each direction. */
+            rem[j] /= 2.0;
+            left_rem[i * 3 + j] = rem[j];
+            stripe[j][i] += carry[j] + rem[j];
+        }
+        bound_pixel(stripe, i, carry);
+    }
 
-        if (width == 0) return NULL;
+    for (j = 0; j < 3; j++) carry[j] = 0.0;
+    for (i = width - 1; i >= 0; i--) {
+        for (j = 0; j < 3; j++) {
+            stripe[j][i] += carry[j];
+        }
+        bound_pixel(stripe, i, carry);
+        /* Energy from this pixel starts at the next one to the left */
+        for (j = 0; j < 3; j++) {
+            carry[j] += left_rem[i * 3 + j];
+        }
+    }
+}
+#endif
 
-        cur_alloc = malloc(width * 3 * sizeof(double));
-        if (cur_alloc == NULL) return NULL;
-        cur_width = width;
+static void peakify_stripe(rgbm_ctx *ctx, RGBM_STRIPETYPE **stripe,
+                           unsigned int width) {
+#ifdef RGBM_PEAKIFY_WALK
+    peakify_stripe_walk(stripe, width);
+#else
+    peakify_stripe_linear(ctx, stripe, width);
+#endif
+}
 
-        rgb_ptrs[0] = &cur_alloc[0];
-        rgb_ptrs[1] = &cur_alloc[width];
-        rgb_ptrs[2] = &cur_alloc[width * 2];
+static void zero_stripe(RGBM_STRIPETYPE **stripe, unsigned int width) {
+    int i, j;
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < width; j++) {
+            stripe[i][j] = 0;
+        }
     }
-
-    return rgb_ptrs;
 }
 
-int rgbm_render(const RGBM_BINTYPE left_bins[RGBM_NUMBINS],
-                const RGBM_BINTYPE right_bins[RGBM_NUMBINS]) {
+RGBM_STRIPETYPE **rgbm_ctx_process(rgbm_ctx *ctx,
+                                   const RGBM_BINTYPE left_bins[],
+                                   const RGBM_BINTYPE right_bins[]) {
     //int res;
 
-    int width;
-    double **stripe;
-
-    width = display_width();
-    stripe = get_stripe(width);
-    if (stripe == NULL) return 0;
+    unsigned int width = ctx->width;
+    RGBM_STRIPETYPE **stripe = ctx->stripe;
 
     zero_stripe(stripe, width);
-    sum_to_stripe(left_bins, right_bins, stripe, width);
+    sum_to_stripe(ctx, left_bins, right_bins, stripe, width);
     sqrt_stripe(stripe, width);
-    peakify_stripe(stripe, width);
+    peakify_stripe(ctx, stripe, width);
 #if 0
     rgbm_sumbins(bins, sums);
     sums[0] *= RGBM_REDSCALE;
     sums[2] *= RGBM_BLUESCALE;
-    rgbm_avgsums(sums, binavg, RGBM_SCALE, RGBM_LIMIT);
+    rgbm_avgsums(sums, ctx->binavg, RGBM_SCALE, RGBM_LIMIT);
 #endif
 #ifdef RGBM_LOGGING
     for (res = 0; res < 3; res++) {
-        avgavg[res] = (avgavg[res] * (RGBM_TESTAVGSIZE-1) + binavg[res])
+        avgavg[res] = (avgavg[res] * (RGBM_TESTAVGSIZE-1) + ctx->binavg[res])
                       / RGBM_TESTAVGSIZE;
     }
     if (testlog != NULL) {
         if (testctr == RGBM_TESTAVGSIZE-1) {
             fprintf(testlog, "%9f; %9f; %9f\n", avgavg[0], avgavg[1], avgavg[2]);
         }
-        rgbm_testsum(bins);
-        fprintf(testlog, "%9f, %9f, %9f\n", binavg[0], binavg[1], binavg[2]);
+        rgbm_testsum(ctx, bins);
+        fprintf(testlog, "%9f, %9f, %9f\n", ctx->binavg[0], ctx->binavg[1],
+                ctx->binavg[2]);
     }
 #endif
-    //display_render((int)binavg[0] >> 4 , (int)binavg[1] >> 4, (int)binavg[2] >> 4);
-    display_render(stripe[0], stripe[1], stripe[2]);
-    return !display_pollquit();
+    return stripe;
 //    res = rgb_pwm(binavg[0], binavg[1], binavg[2]);
  //   return res;
-} /* rgbm_render */
+} /* rgbm_ctx_process */
 
-#ifdef RGBM_FFT
-/* Convert FFTW halfcomplex format to real amplitudes.
- * bins[0] and bins[RGBM_NUMSAMP / 2] are real due to FFT symmetry. */
-static void fft_complex_to_real(RGBM_BINTYPE bins[RGBM_NUMSAMP]) {
-    int i;
-    for (i = 1; i < RGBM_NUMSAMP / 2; i++) {
-        double t;
-        t = bins[i] * bins[i];
-        t += bins[RGBM_NUMSAMP - i] * bins[RGBM_NUMSAMP - i];
-        bins[i] = sqrt(t);
+unsigned int rgbm_ctx_num_samples(const rgbm_ctx *ctx) {
+    return ctx->num_samp;
+}
+
+void rgbm_ctx_get_wave_buffers(rgbm_ctx *ctx, RGBM_SAMPTYPE *left[],
+                               RGBM_SAMPTYPE *right[]) {
+    *left = ctx->fft_in_l;
+    *right = ctx->fft_in_r;
+}
+
+/* Window both channels while packing them into one complex input. */
+static void fft_pack_window(rgbm_ctx *ctx) {
+    rgbm_pack_window(ctx->fft_in_l, ctx->fft_in_r, ctx->hamming,
+                     (RGBM_SAMPTYPE *)ctx->fft_buf, ctx->num_samp);
+}
+
+/* Separate the spectra of the two real channels and convert them to real
+ * amplitudes. With Z = FFT(L + iR), L[k] = (Z[k] + conj(Z[N - k])) / 2
+ * and R[k] = (Z[k] - conj(Z[N - k])) / 2i. Only used bins are computed.
+ * Bin 0 is left as the signed real DC value, like FFTW halfcomplex. */
+static void fft_split_magnitude(rgbm_ctx *ctx) {
+    ctx->fft_bins_l[0] = ctx->fft_buf[0][0];
+    ctx->fft_bins_r[0] = ctx->fft_buf[0][1];
+    rgbm_split_magnitude((RGBM_SAMPTYPE *)ctx->fft_buf, ctx->fft_bins_l,
+                         ctx->fft_bins_r, ctx->use_bins, ctx->num_samp);
+}
+
+/* Separate the two channels like fft_split_magnitude(), keeping complex
+ * values for the columns used by constant-Q kernels. Then multiply by
+ * the sparse kernels, with both channels in one pass over each row. */
+static void cq_apply_kernels(rgbm_ctx *ctx) {
+    const RGBM_SAMPTYPE *z = (const RGBM_SAMPTYPE *)ctx->fft_buf;
+    const RGBM_SAMPTYPE *val = ctx->cq_val;
+    const unsigned int *col = ctx->cq_col;
+    RGBM_SAMPTYPE *spec = ctx->cq_spec;
+    unsigned int n = ctx->num_samp, i, e;
+    int k;
+
+    for (i = 1; i < ctx->cq_cols; i++) {
+        RGBM_SAMPTYPE a = z[i * 2], b = z[i * 2 + 1];
+        RGBM_SAMPTYPE c = z[(n - i) * 2], d = z[(n - i) * 2 + 1];
+
+        spec[i * 4] = (a + c) / 2;
+        spec[i * 4 + 1] = (b - d) / 2;
+        spec[i * 4 + 2] = (b + d) / 2;
+        spec[i * 4 + 3] = (c - a) / 2;
+    }
+
+    for (k = 0; k < ctx->use_bins; k++) {
+        RGBM_SAMPTYPE lr = 0, li = 0, rr = 0, ri = 0;
+
+        for (e = ctx->cq_row[k]; e < ctx->cq_row[k + 1]; e++) {
+            const RGBM_SAMPTYPE *s = &spec[col[e] * 4];
+            RGBM_SAMPTYPE vr = val[e * 2], vi = val[e * 2 + 1];
+
+            lr += s[0] * vr - s[1] * vi;
+            li += s[0] * vi + s[1] * vr;
+            rr += s[2] * vr - s[3] * vi;
+            ri += s[2] * vi + s[3] * vr;
+        }
+        ctx->fft_bins_l[k] = sqrt(lr * lr + li * li);
+        ctx->fft_bins_r[k] = sqrt(rr * rr + ri * ri);
     }
 }
 
-void rgbm_get_wave_buffers(double *left[], double *right[]) {
-    *left = fft_in_l;
-    *right = fft_in_r;
+/* Adds up to count samples to the sliding DFT, stopping when bins are
+ * due to be recomputed. With X[k] the DFT of the window starting at
+ * the oldest sample, dropping sample o and adding s gives
+ * X'[k] = (X[k] - o + s) * exp(2 pi i k / N). Returns samples used. */
+static unsigned int sdft_update(rgbm_ctx *ctx, const RGBM_SAMPTYPE *left,
+                                const RGBM_SAMPTYPE *right,
+                                unsigned int count) {
+    RGBM_SAMPTYPE *re_l = ctx->sdft_re_l, *im_l = ctx->sdft_im_l;
+    RGBM_SAMPTYPE *re_r = ctx->sdft_re_r, *im_r = ctx->sdft_im_r;
+    const RGBM_SAMPTYPE *cr = ctx->sdft_rot_re, *ci = ctx->sdft_rot_im;
+    unsigned int nb = ctx->use_bins + 1, pos = ctx->sdft_pos, j, k;
+
+    if (count > ctx->sdft_until_resync) count = ctx->sdft_until_resync;
+    for (j = 0; j < count; j++) {
+        RGBM_SAMPTYPE dl = left[j] - ctx->sdft_hist_l[pos];
+        RGBM_SAMPTYPE dr = right[j] - ctx->sdft_hist_r[pos];
+
+        ctx->sdft_hist_l[pos] = left[j];
+        ctx->sdft_hist_r[pos] = right[j];
+        if (++pos == ctx->num_samp) pos = 0;
+
+        for (k = 0; k < nb; k++) {
+            RGBM_SAMPTYPE a = re_l[k] + dl, b = im_l[k];
+            RGBM_SAMPTYPE c = re_r[k] + dr, d = im_r[k];
+
+            re_l[k] = a * cr[k] - b * ci[k];
+            im_l[k] = a * ci[k] + b * cr[k];
+            re_r[k] = c * cr[k] - d * ci[k];
+            im_r[k] = c * ci[k] + d * cr[k];
+        }
+    }
+    ctx->sdft_pos = pos;
+    ctx->sdft_until_resync -= count;
+    return count;
 }
 
-static void fft_apply_window(double *samp) {
-    int i;
-    for (i = 0; i < RGBM_NUMSAMP; i++) {
-      samp[i] *= hamming[i];
+/* Rounding errors accumulate in the recursion, so once per window,
+ * bins are recomputed exactly from the saved samples using the FFT. */
+static void sdft_resync(rgbm_ctx *ctx) {
+    const RGBM_SAMPTYPE *z = (const RGBM_SAMPTYPE *)ctx->fft_buf;
+    unsigned int n = ctx->num_samp, pos = ctx->sdft_pos, i, k;
+
+    for (i = 0; i < n; i++) {
+        ctx->fft_buf[i][0] = ctx->sdft_hist_l[pos];
+        ctx->fft_buf[i][1] = ctx->sdft_hist_r[pos];
+        if (++pos == n) pos = 0;
+    }
+    FFTW(execute)(ctx->fft_plan);
+
+    /* Separate channels as in fft_split_magnitude() */
+    ctx->sdft_re_l[0] = z[0];
+    ctx->sdft_im_l[0] = 0;
+    ctx->sdft_re_r[0] = z[1];
+    ctx->sdft_im_r[0] = 0;
+    for (k = 1; k <= ctx->use_bins; k++) {
+        RGBM_SAMPTYPE a = z[k * 2], b = z[k * 2 + 1];
+        RGBM_SAMPTYPE c = z[(n - k) * 2], d = z[(n - k) * 2 + 1];
+
+        ctx->sdft_re_l[k] = (a + c) / 2;
+        ctx->sdft_im_l[k] = (b - d) / 2;
+        ctx->sdft_re_r[k] = (b + d) / 2;
+        ctx->sdft_im_r[k] = (c - a) / 2;
     }
+    ctx->sdft_until_resync = n;
 }
 
-int rgbm_render_wave(void) {
-    fft_apply_window(fft_in_l);
-    fft_apply_window(fft_in_r);
-    fftw_execute(fft_plan_l);
-    fftw_execute(fft_plan_r);
-    fft_complex_to_real(fft_out_l);
-    fft_complex_to_real(fft_out_r);
-    return rgbm_render(fft_out_l, fft_out_r);
+/* The periodic form of the FFT window, 1 - 0.852 * cos(2 pi m / N), is
+ * applied to the sliding DFT by convolving neighbouring bins, giving
+ * X[k] - 0.426 * (X[k - 1] + X[k + 1]). The FFT uses N - 1 instead of N,
+ * which no such kernel can match, so bins differ slightly. For real
+ * signals, X[-1] is the conjugate of X[1]. Bin 0 stays signed, like
+ * fft_split_magnitude(). */
+static void sdft_window_bins(rgbm_ctx *ctx) {
+    const RGBM_SAMPTYPE *re_l = ctx->sdft_re_l, *im_l = ctx->sdft_im_l;
+    const RGBM_SAMPTYPE *re_r = ctx->sdft_re_r, *im_r = ctx->sdft_im_r;
+    RGBM_SAMPTYPE scale = (RGBM_SAMPTYPE)RGBM_NUMSAMP / ctx->num_samp;
+    int k;
+
+    ctx->fft_bins_l[0] = (re_l[0] - 0.852 * re_l[1]) * scale;
+    ctx->fft_bins_r[0] = (re_r[0] - 0.852 * re_r[1]) * scale;
+    for (k = 1; k < ctx->use_bins; k++) {
+        RGBM_SAMPTYPE lr = re_l[k] - 0.426 * (re_l[k - 1] + re_l[k + 1]);
+        RGBM_SAMPTYPE li = im_l[k] - 0.426 * (im_l[k - 1] + im_l[k + 1]);
+        RGBM_SAMPTYPE rr = re_r[k] - 0.426 * (re_r[k - 1] + re_r[k + 1]);
+        RGBM_SAMPTYPE ri = im_r[k] - 0.426 * (im_r[k - 1] + im_r[k + 1]);
+
+        ctx->fft_bins_l[k] = sqrt(lr * lr + li * li) * scale;
+        ctx->fft_bins_r[k] = sqrt(rr * rr + ri * ri) * scale;
+    }
+}
+
+/* Turns the FFT output into bins for sum_to_stripe() */
+static void fft_to_bins(rgbm_ctx *ctx) {
+    if (ctx->analysis == RGBM_ANALYSIS_CQ) {
+        cq_apply_kernels(ctx);
+    } else {
+        fft_split_magnitude(ctx);
+    }
+}
+
+RGBM_STRIPETYPE **rgbm_ctx_process_wave(rgbm_ctx *ctx) {
+    if (ctx->analysis == RGBM_ANALYSIS_SDFT) {
+        /* The whole window replaces the sliding DFT's samples */
+        memcpy(ctx->sdft_hist_l, ctx->fft_in_l,
+               sizeof(RGBM_SAMPTYPE) * ctx->num_samp);
+        memcpy(ctx->sdft_hist_r, ctx->fft_in_r,
+               sizeof(RGBM_SAMPTYPE) * ctx->num_samp);
+        ctx->sdft_pos = 0;
+        sdft_resync(ctx);
+        return rgbm_ctx_process_sliding(ctx);
+    }
+
+    fft_pack_window(ctx);
+    /* Unlike planning, executing a plan is thread-safe */
+    FFTW(execute)(ctx->fft_plan);
+    fft_to_bins(ctx);
+    return rgbm_ctx_process(ctx, ctx->fft_bins_l, ctx->fft_bins_r);
+}
+
+void rgbm_ctx_push_samples(rgbm_ctx *ctx, const RGBM_SAMPTYPE left[],
+                           const RGBM_SAMPTYPE right[], unsigned int count) {
+    while (count > 0 || ctx->sdft_until_resync == 0) {
+        unsigned int n;
+
+        if (ctx->sdft_until_resync == 0) sdft_resync(ctx);
+        n = sdft_update(ctx, left, right, count);
+        left += n;
+        right += n;
+        count -= n;
+    }
+}
+
+RGBM_STRIPETYPE **rgbm_ctx_process_sliding(rgbm_ctx *ctx) {
+    sdft_window_bins(ctx);
+    return rgbm_ctx_process(ctx, ctx->fft_bins_l, ctx->fft_bins_r);
 }
-#endif
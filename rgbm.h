@@ -2,36 +2,206 @@
 /* Copyright 2013 Boris Gjenero. Released under the MIT license. */
 
 #ifndef _RGBM_H_
+#define _RGBM_H_
+
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#if defined(RGBM_AUDACIOUS) || defined(RGBM_FFT)
-
-/* Number of FFT bins */
+/* Default number of FFT samples and bins */
 #define RGBM_NUMSAMP 512
 #define RGBM_NUMBINS 256
-/* Type of FFT bins */
+/* Range of FFT sizes supported by rgbm_configure_fft() */
+#define RGBM_MIN_NUMSAMP 256
+#define RGBM_MAX_NUMSAMP 8192
+/* Type of FFT bins and samples. Single precision uses fftw3f. Fixed
+ * point, for CPUs without an FPU, uses Q15 samples and bin amplitudes
+ * with RGBM_BIN_FRAC_BITS fraction bits. */
+#if defined(RGBM_FIXED)
+#define RGBM_BINTYPE int32_t
+#define RGBM_SAMPTYPE int16_t
+#define RGBM_BIN_FRAC_BITS 16
+#elif defined(RGBM_FLOAT)
+#define RGBM_BINTYPE float
+#define RGBM_SAMPTYPE float
+#else
 #define RGBM_BINTYPE double
 #define RGBM_SAMPTYPE double
+#endif
+
+/* Sample from 16-bit PCM, and from floating point PCM from -1 to 1 */
+#ifdef RGBM_FIXED
+#define RGBM_SAMPLE_S16(s) ((int16_t)(s))
+#define RGBM_SAMPLE_FLOAT(f) rgbm_sample_float(f)
+static inline int16_t rgbm_sample_float(float f) {
+    if (f >= 32767.0f / 32768.0f) return 32767;
+    if (f <= -1.0f) return -32768;
+    return (int16_t)(f * 32768.0f + (f < 0 ? -0.5f : 0.5f));
+}
+#else
+#define RGBM_SAMPLE_S16(s) ((s) / 32768.0)
+#define RGBM_SAMPLE_FLOAT(f) (f)
+#endif
 
-#elif defined (RGBM_WINAMP)
+/* FFTW planner effort. More effort finds faster plans but takes
+ * longer, unless plans are found in the wisdom file. */
+#define RGBM_PLAN_ESTIMATE 0
+#define RGBM_PLAN_MEASURE 1
+#define RGBM_PLAN_PATIENT 2
 
-#define RGBM_NUMBINS 576
-#define RGBM_BINTYPE unsigned char
+/* How FFT output becomes bins. Constant-Q multiplies the FFT by sparse
+ * kernels precomputed at initialization, giving bins a semitone apart
+ * from 33 Hz. Bass bins only get their full resolution with a large FFT,
+ * such as 8192 samples. The sliding DFT updates the used FFT bins as
+ * each sample arrives, so a stripe can be produced after any number of
+ * new samples, at a cost proportional to samples times bins. */
+#define RGBM_ANALYSIS_FFT 0
+#define RGBM_ANALYSIS_CQ 1
+#define RGBM_ANALYSIS_SDFT 2
 
+/* Default LED output device */
+#ifdef _WIN32
+#define RGBPORT "COM8"
 #else
-#error Need to set define for type of music player.
+#define RGBPORT "/dev/ttyUSB0"
 #endif
+/* Moving average size for LED output when value is increasing */
+#define RGBM_AVGUP 5
+/* Moving average size for LED output when value is decreasing */
+#define RGBM_AVGDN 15
+
+/* Type of stripe values passed to the display, and the value of one
+ * colour level. Fixed point stripes have 4 fraction bits. */
+#if defined(RGBM_FIXED)
+#if defined(RGBM_FLOAT)
+#error RGBM_FIXED and RGBM_FLOAT cannot be used together.
+#endif
+#define RGBM_STRIPETYPE int32_t
+#define RGBM_STRIPE_FRAC_BITS 4
+#define RGBM_STRIPE_ONE (1 << RGBM_STRIPE_FRAC_BITS)
+#elif defined(RGBM_FLOAT)
+#define RGBM_STRIPETYPE float
+#define RGBM_STRIPE_ONE 1.0f
+#else
+#define RGBM_STRIPETYPE double
+#define RGBM_STRIPE_ONE 1.0
+#endif
+
+/* How finished stripes reach the display */
+#define RGBM_PRESENT_SYNC 0     /* Display from the rendering thread */
+#define RGBM_PRESENT_DROP 1     /* Drop the oldest queued stripe when full */
+#define RGBM_PRESENT_COALESCE 2 /* Merge into the newest queued stripe */
+#define RGBM_PRESENT_BLOCK 3    /* Wait until the display catches up */
+#define RGBM_PRESENT_LATEST 4   /* Like drop, and skip stale queued ones */
+/* Default buffer count, including the one being displayed */
+#define RGBM_PRESENT_BUFFERS 3
+/* Default age in milliseconds after which RGBM_PRESENT_LATEST considers a
+ * stripe stale, measured from capture of its newest sample */
+#define RGBM_PRESENT_STALE_MS 100
+
+/* Capture to display latency of stripes tagged with their capture time */
+struct rgbm_latency {
+    /* Tagged stripes displayed, and latency of the most recent one */
+    unsigned long stripes;
+    uint64_t last_ns;
+    uint64_t mean_ns, max_ns;
+    /* Stale stripes skipped by RGBM_PRESENT_LATEST */
+    unsigned long stale;
+};
+
+/*
+ * Reentrant analysis, in the colourwaterfall library. Each context turns
+ * one stream into stripes, without displaying them. Separate contexts
+ * may be used at the same time from different threads.
+ */
+typedef struct rgbm_ctx rgbm_ctx;
+/* Analysis, effort and wisdom_file are as for rgbm_configure_fft().
+ * Stripes are width pixels wide. Returns NULL on failure. With
+ * RGBM_FIXED, only RGBM_ANALYSIS_FFT and powers of two from
+ * RGBM_MIN_NUMSAMP are supported, and effort and wisdom_file are
+ * ignored. */
+rgbm_ctx *rgbm_ctx_create(unsigned int width, unsigned int numsamp,
+                          int analysis, int effort,
+                          const char *wisdom_file);
+void rgbm_ctx_destroy(rgbm_ctx *ctx);
+unsigned int rgbm_ctx_width(const rgbm_ctx *ctx);
+/* Returns the red, green and blue parts of the stripe, which remain
+ * valid until the context is used again. */
+RGBM_STRIPETYPE **rgbm_ctx_process(rgbm_ctx *ctx,
+                                   const RGBM_BINTYPE left_bins[],
+                                   const RGBM_BINTYPE right_bins[]);
+unsigned int rgbm_ctx_num_samples(const rgbm_ctx *ctx);
+/* Buffers are rgbm_ctx_num_samples() long */
+void rgbm_ctx_get_wave_buffers(rgbm_ctx *ctx, RGBM_SAMPTYPE *left[],
+                               RGBM_SAMPTYPE *right[]);
+/* Analyses the wave buffers, returning the stripe like rgbm_ctx_process() */
+RGBM_STRIPETYPE **rgbm_ctx_process_wave(rgbm_ctx *ctx);
+/* With RGBM_ANALYSIS_SDFT, adds count new samples to the sliding DFT */
+void rgbm_ctx_push_samples(rgbm_ctx *ctx, const RGBM_SAMPTYPE left[],
+                           const RGBM_SAMPTYPE right[], unsigned int count);
+/* With RGBM_ANALYSIS_SDFT, returns the stripe for the newest
+ * rgbm_ctx_num_samples() samples, like rgbm_ctx_process() */
+RGBM_STRIPETYPE **rgbm_ctx_process_sliding(rgbm_ctx *ctx);
+
+/*
+ * Single stream with display, for players and the standalone program
+ */
 
 /* Here int really means bool, but some compilers can't handle bool */
 int rgbm_init(void);
 void rgbm_shutdown(void);
-int rgbm_render(const RGBM_BINTYPE left_bins[RGBM_NUMBINS],
-                const RGBM_BINTYPE right_bins[RGBM_NUMBINS]);
-void rgbm_get_wave_buffers(double *left[], double *right[]);
+/* Bins below 12.5 kHz are used */
+int rgbm_render(const RGBM_BINTYPE left_bins[],
+                const RGBM_BINTYPE right_bins[]);
+/* Must be called before rgbm_init() to change defaults. Except with
+ * RGBM_PRESENT_SYNC, the display runs in a separate thread, fed through
+ * a queue of buffers, which must be at least 2. */
+int rgbm_configure_present(int policy, unsigned int buffers);
+/* Must be called before rgbm_init() to change the age in milliseconds
+ * at which RGBM_PRESENT_LATEST skips a queued stripe if a newer one is
+ * waiting. */
+int rgbm_configure_stale(unsigned int ms);
+/* Tags the next rendered stripe with the CLOCK_MONOTONIC time in
+ * nanoseconds at which its newest sample was captured, or 0 if unknown */
+void rgbm_set_capture_time(uint64_t ns);
+/* Tags the next rendered stripe with the time in nanoseconds of its
+ * newest sample from the start of the stream, such as a file, or 0 if
+ * unknown. Recorded history uses it, so files rendered faster than real
+ * time replay at their own pace. Otherwise the capture time is used. */
+void rgbm_set_stream_time(uint64_t ns);
+/* Gets latency statistics of tagged stripes displayed since the previous
+ * call. Returns false if there were none. */
+int rgbm_get_latency(struct rgbm_latency *lat);
+/* Must be called before rgbm_init() to change the default SDL display.
+ * Sinks is a comma separated list from sdl, null, raw:file,
+ * shm[:name], led[:dest[@count]], rec:file and net[:host:port[@stripes]].
+ * raw writes rgb24 rows to file, or to standard output for -. Where
+ * available, shm publishes them in shared memory, led drives an LED strip
+ * via a serial device or udp:host:port, rec records timestamped rows in a
+ * history file for replay, and net streams them over UDP to receivers on
+ * other hosts. Every stripe is sent to all of them. */
+int rgbm_configure_display(const char *sinks);
+/* Must be called before rgbm_init() to change defaults. FFTW wisdom
+ * is loaded from and saved to wisdom_file unless it is NULL. The name
+ * is only used by the next rgbm_init(), and must remain valid until
+ * then. */
+int rgbm_configure_fft(unsigned int numsamp, int effort,
+                       const char *wisdom_file);
+/* Must be called before rgbm_init() to use RGBM_ANALYSIS_CQ or
+ * RGBM_ANALYSIS_SDFT, which aren't available with RGBM_FIXED */
+int rgbm_configure_analysis(int analysis);
+int rgbm_analysis(void);
+unsigned int rgbm_num_samples(void);
+/* Buffers are rgbm_num_samples() long */
+void rgbm_get_wave_buffers(RGBM_SAMPTYPE *left[], RGBM_SAMPTYPE *right[]);
 int rgbm_render_wave(void);
+/* For RGBM_ANALYSIS_SDFT, like rgbm_ctx_push_samples() and
+ * rgbm_ctx_process_sliding() */
+void rgbm_push_samples(const RGBM_SAMPTYPE left[],
+                       const RGBM_SAMPTYPE right[], unsigned int count);
+int rgbm_render_sliding(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,339 @@
+/* Colour waterfall analysis specialized at compile time for common sizes. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#include <stddef.h>
+#include "rgbm.h"
+#include "rgbm_tables.h"
+#include "rgbm_iso226.h"
+#include "rgbm_engine.h"
+
+/*
+ * Tables are computed by constexpr ports of the rgbm_tables.c functions.
+ * Math library calls can't be evaluated in constant expressions, except
+ * as a GCC extension, so logarithms and powers are computed here too.
+ * Tables match the ones computed at run time to within a few units in
+ * the last place.
+ */
+
+namespace {
+
+constexpr double LN2 = 0.693147180559945309417232121458176568;
+constexpr double LN10 = 2.30258509299404568401799145468436421;
+/* LN2 split so k * LN2_HI is exact for the exponents used here */
+constexpr double LN2_HI = 6.93147180369123816490e-01;
+constexpr double LN2_LO = 1.90821492927058770002e-10;
+
+constexpr double cx_fabs(double x) {
+    return x < 0 ? -x : x;
+}
+
+/* Natural logarithm of m from sqrt(1/2) to sqrt(2), as 2 atanh(s) with
+ * s = (m - 1) / (m + 1), whose series converges quickly as |s| < 0.18 */
+constexpr double log_mantissa(double m) {
+    double s = (m - 1) / (m + 1), s2 = s * s, term = s, sum = 0;
+
+    for (int k = 1; sum + term / k != sum; k += 2) {
+        sum += term / k;
+        term *= s2;
+    }
+    return 2 * sum;
+}
+
+/* Scales x > 0 by powers of 2 to m from sqrt(1/2) to sqrt(2), setting e
+ * so x = m * 2^e. Scaling is exact. */
+constexpr double split_exponent(double x, int &e) {
+    e = 0;
+    while (x >= 1.4142135623730951) {
+        x /= 2;
+        e++;
+    }
+    while (x < 0.7071067811865476) {
+        x *= 2;
+        e--;
+    }
+    return x;
+}
+
+constexpr double cx_log(double x) {
+    int e = 0;
+    double m = split_exponent(x, e);
+
+    return e * LN2_HI + (e * LN2_LO + log_mantissa(m));
+}
+
+/* e^x, as 2^k e^r with |r| <= log(2) / 2, summing the series for e^r */
+constexpr double cx_exp(double x) {
+    int k = (int)(x / LN2 + (x < 0 ? -0.5 : 0.5));
+    double r = (x - k * LN2_HI) - k * LN2_LO, term = 1, sum = 1;
+
+    for (int n = 1; sum + term * r / n != sum; n++) {
+        term *= r / n;
+        sum += term;
+    }
+    for (; k > 0; k--) sum *= 2;
+    for (; k < 0; k++) sum /= 2;
+    return sum;
+}
+
+constexpr double cx_log2(double x) {
+    int e = 0;
+    double m = split_exponent(x, e);
+
+    return e + log_mantissa(m) / LN2;
+}
+
+constexpr double cx_log10(double x) {
+    return cx_log(x) / LN10;
+}
+
+/* b^y for b > 0 */
+constexpr double cx_pow(double b, double y) {
+    return cx_exp(y * cx_log(b));
+}
+
+constexpr bool near(double a, double b) {
+    return cx_fabs(a - b) <= 1e-14 * cx_fabs(b);
+}
+
+static_assert(near(cx_log2(1024), 10), "log2 must be accurate");
+static_assert(near(cx_log10(1e-3), -3), "log10 must be accurate");
+static_assert(near(cx_exp(1), 2.718281828459045), "exp must be accurate");
+static_assert(near(cx_pow(10, 0.025 * 70), 56.23413251903491),
+              "pow must be accurate");
+static_assert(near(cx_pow(0.5, 0.3), 0.8122523963562356),
+              "pow must be accurate");
+
+template <unsigned int N> struct Table {
+    double v[N];
+};
+
+constexpr double bin_hz(unsigned int i, unsigned int numsamp) {
+    return (double)(i + 1) * RGBM_TABLES_RATE / numsamp;
+}
+
+constexpr unsigned int usebins(unsigned int numsamp) {
+    return ISO226_TOPFREQ * numsamp / RGBM_TABLES_RATE;
+}
+
+constexpr double hz_to_pitch(double hz) {
+    return hz <= 0 ? 0 : 69 + 12 * cx_log2(hz / 440);
+}
+
+/* Same as green() in rgbm_tables.c */
+template <unsigned int NumSamp, unsigned int UseBins>
+constexpr Table<UseBins> make_green() {
+    Table<UseBins> t{};
+    double first = hz_to_pitch(bin_hz(0, NumSamp));
+    double midpoint = (first + hz_to_pitch(bin_hz(UseBins - 1, NumSamp))) / 2;
+
+    for (unsigned int i = 0; i < UseBins; i++) {
+        double pitch = hz_to_pitch(bin_hz(i, NumSamp));
+        double g = 1 - cx_fabs(midpoint - pitch) / (midpoint - first);
+        t.v[i] = g > 0.0 ? g : 0.0;
+    }
+    return t;
+}
+
+template <unsigned int UseBins>
+constexpr unsigned int find_pivot(const Table<UseBins> &green) {
+    unsigned int pivot = 0;
+
+    for (unsigned int i = 0; i < UseBins; i++) {
+        if (green.v[i] > green.v[pivot]) pivot = i;
+    }
+    return pivot;
+}
+
+/* Loudness contour through the ISO 226 points, as a not-a-knot cubic
+ * spline with second derivatives m, like freq_adj() in rgbm_tables.c */
+struct Spline {
+    double y[ISO226_POINTS], m[ISO226_POINTS];
+};
+
+struct Matrix {
+    double a[ISO226_POINTS][ISO226_POINTS];
+};
+
+constexpr void solve(Matrix &mat, double *b, int n) {
+    auto &a = mat.a;
+
+    for (int i = 0; i < n; i++) {
+        int p = i;
+        for (int j = i + 1; j < n; j++) {
+            if (cx_fabs(a[j][i]) > cx_fabs(a[p][i])) p = j;
+        }
+        if (p != i) {
+            double t = 0;
+            for (int k = 0; k < n; k++) {
+                t = a[i][k]; a[i][k] = a[p][k]; a[p][k] = t;
+            }
+            t = b[i]; b[i] = b[p]; b[p] = t;
+        }
+        for (int j = i + 1; j < n; j++) {
+            double f = a[j][i] / a[i][i];
+            for (int k = i; k < n; k++) a[j][k] -= f * a[i][k];
+            b[j] -= f * b[i];
+        }
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        for (int k = i + 1; k < n; k++) b[i] -= a[i][k] * b[k];
+        b[i] /= a[i][i];
+    }
+}
+
+constexpr Spline make_loudness(double phon) {
+    const double *x = iso226_f;
+    const int n = ISO226_POINTS;
+    Spline s{};
+    Matrix a{};
+
+    for (int i = 0; i < n; i++) {
+        /* Sound pressure level from loudness level (ISO 226 section 4.1) */
+        double Af = 4.47E-3 * (cx_pow(10, 0.025 * phon) - 1.15) +
+                    cx_pow(0.4 * cx_pow(10, (iso226_Tf[i] +
+                                                            iso226_Lu[i]) /
+                                                               10 - 9),
+                                  iso226_af[i]);
+        double Lp = 10 / iso226_af[i] * cx_log10(Af) -
+                    iso226_Lu[i] + 94;
+        s.y[i] = 1 / cx_pow(10, (Lp - phon) / 20);
+    }
+
+    for (int i = 1; i < n - 1; i++) {
+        double h0 = x[i] - x[i - 1], h1 = x[i + 1] - x[i];
+        a.a[i][i - 1] = h0;
+        a.a[i][i] = 2 * (h0 + h1);
+        a.a[i][i + 1] = h1;
+        s.m[i] = 6 * ((s.y[i + 1] - s.y[i]) / h1 - (s.y[i] - s.y[i - 1]) / h0);
+    }
+
+    /* Third derivative is continuous across second and second last knot */
+    a.a[0][0] = x[2] - x[1];
+    a.a[0][1] = -(x[2] - x[0]);
+    a.a[0][2] = x[1] - x[0];
+    s.m[0] = 0.0;
+    a.a[n - 1][n - 3] = x[n - 1] - x[n - 2];
+    a.a[n - 1][n - 2] = -(x[n - 1] - x[n - 3]);
+    a.a[n - 1][n - 1] = x[n - 2] - x[n - 3];
+    s.m[n - 1] = 0.0;
+
+    solve(a, s.m, n);
+    return s;
+}
+
+constexpr double spline_eval(const Spline &s, double v) {
+    const double *x = iso226_f, *y = s.y, *m = s.m;
+    const int n = ISO226_POINTS;
+    int i = 0;
+
+    while (i < n - 2 && v >= x[i + 1]) i++;
+    double h = x[i + 1] - x[i], l = v - x[i], r = x[i + 1] - v;
+    return (m[i] * r * r * r + m[i + 1] * l * l * l) / (6 * h) +
+           (y[i] / h - m[i] * h / 6) * r +
+           (y[i + 1] / h - m[i + 1] * h / 6) * l;
+}
+
+constexpr Spline loudness = make_loudness(70.0);
+/* Values from freq_adj() in rgbm_tables.c, using the math library */
+static_assert(near(loudness.y[0], 0.006122101576112809) &&
+              near(loudness.y[17], 0.998630897214555) &&
+              near(loudness.y[ISO226_POINTS - 1], 0.4445260545711426),
+              "Loudness must match the contour computed at run time");
+
+template <unsigned int NumSamp, unsigned int UseBins>
+constexpr Table<UseBins> make_freq_adj() {
+    Table<UseBins> t{};
+
+    for (unsigned int i = 0; i < UseBins; i++) {
+        t.v[i] = spline_eval(loudness, bin_hz(i, NumSamp));
+    }
+    return t;
+}
+
+/* Bin power weights, like weights_init() in rgbm.c */
+template <unsigned int N> struct Weights {
+    RGBM_STRIPETYPE green[N], other[N];
+};
+
+template <unsigned int N>
+constexpr Weights<N> make_weights(const Table<N> &green_tab,
+                                  const Table<N> &freq_adj) {
+    Weights<N> w{};
+
+    for (unsigned int i = 0; i < N; i++) {
+        double adj = freq_adj.v[i] * freq_adj.v[i];
+        w.green[i] = adj * green_tab.v[i];
+        w.other[i] = adj * (1.0 - green_tab.v[i]);
+    }
+    return w;
+}
+
+/* Tables for FFT bins up to 12.5 kHz from NumSamp samples */
+template <unsigned int NumSamp> struct FFTTables {
+    static constexpr unsigned int use_bins = usebins(NumSamp);
+    static constexpr Table<use_bins> green_tab = make_green<NumSamp,
+                                                           use_bins>();
+    static constexpr unsigned int pivot_bin = find_pivot(green_tab);
+};
+
+template <unsigned int NumSamp>
+constexpr Table<FFTTables<NumSamp>::use_bins> FFTTables<NumSamp>::green_tab;
+
+/*
+ * The engine holds the tables rgbm.c would otherwise compute in
+ * rgbm_ctx_create(), including the bin power weights, so summing uses
+ * the same vectorized rgbm_weigh_bins() either way.
+ */
+template <unsigned int NumSamp, unsigned int UseBins, unsigned int PivotBin>
+struct Engine {
+    static_assert(PivotBin < UseBins, "Pivot bin must be a used bin");
+
+    static constexpr Table<UseBins> green_tab = make_green<NumSamp,
+                                                           UseBins>();
+    static constexpr Table<UseBins> freq_adj = make_freq_adj<NumSamp,
+                                                             UseBins>();
+    static constexpr Weights<UseBins> weights = make_weights(green_tab,
+                                                             freq_adj);
+    static_assert(PivotBin == find_pivot(green_tab),
+                  "Pivot bin must be at the peak of the green ramp");
+
+    static const rgbm_engine info;
+};
+
+#define ENGINE_TEMPLATE \
+    template <unsigned int NumSamp, unsigned int UseBins, \
+              unsigned int PivotBin>
+#define ENGINE_CLASS Engine<NumSamp, UseBins, PivotBin>
+
+ENGINE_TEMPLATE constexpr Table<UseBins> ENGINE_CLASS::green_tab;
+ENGINE_TEMPLATE constexpr Table<UseBins> ENGINE_CLASS::freq_adj;
+ENGINE_TEMPLATE constexpr Weights<UseBins> ENGINE_CLASS::weights;
+ENGINE_TEMPLATE const rgbm_engine ENGINE_CLASS::info = {
+    NumSamp, UseBins, PivotBin, green_tab.v, freq_adj.v, weights.green,
+    weights.other
+};
+
+/* Engine for FFT bins up to 12.5 kHz */
+#define FFT_ENGINE(numsamp) \
+    Engine<numsamp, FFTTables<numsamp>::use_bins, \
+           FFTTables<numsamp>::pivot_bin>
+
+} /* namespace */
+
+/* Every supported FFT size. Constant-Q bins use tables computed at run
+ * time. */
+static const rgbm_engine *const engines[] = {
+    &FFT_ENGINE(256)::info,
+    &FFT_ENGINE(512)::info,
+    &FFT_ENGINE(1024)::info,
+    &FFT_ENGINE(2048)::info,
+    &FFT_ENGINE(4096)::info,
+    &FFT_ENGINE(8192)::info
+};
+
+const rgbm_engine *rgbm_engine_find(unsigned int numsamp) {
+    for (const rgbm_engine *e : engines) {
+        if (e->numsamp == numsamp) return e;
+    }
+    return NULL;
+}
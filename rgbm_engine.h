@@ -0,0 +1,32 @@
+/* Header file for colour waterfall analysis specialized at compile time. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#ifndef _RGBM_ENGINE_H_
+#define _RGBM_ENGINE_H_
+
+#include "rgbm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Tables for one FFT size, computed while compiling and kept in
+ * read-only data */
+struct rgbm_engine {
+    unsigned int numsamp;
+    unsigned int use_bins, pivot_bin;
+    /* Same as from rgbm_tables_green() and rgbm_tables_freq_adj() */
+    const double *green_tab, *freq_adj;
+    /* Bin power weights for rgbm_weigh_bins(), as in rgbm.c */
+    const RGBM_STRIPETYPE *green_w, *other_w;
+};
+
+/* Returns the engine for FFT bins from numsamp samples, or NULL if tables
+ * need to be computed at run time. */
+const struct rgbm_engine *rgbm_engine_find(unsigned int numsamp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !_RGBM_ENGINE_H_ */
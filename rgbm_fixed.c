@@ -0,0 +1,598 @@
+/* Fixed point analysis for the RGB lamp, for CPUs without an FPU. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+/*
+ * This is the RGBM_ANALYSIS_FFT pipeline of rgbm.c in integer arithmetic,
+ * built instead of rgbm.c with RGBM_FIXED. Floating point is only used
+ * while creating a context, to compute the window, twiddle factors and
+ * bin weights, which are then kept as integers.
+ *
+ * Samples are Q15, and the window and twiddle factors are Q30. FFT
+ * values are kept in 32 bits, scaled once before the transform so it
+ * doesn't need to scale down at each stage. Bin amplitudes have
+ * RGBM_BIN_FRAC_BITS fraction bits and the same scale as bins in
+ * rgbm.c, and stripe values have RGBM_STRIPE_FRAC_BITS.
+ *
+ * Compared with the double precision engine on the same 16-bit input,
+ * bins differ by at most 4 * 2^-16, growing with FFT size. In stereo
+ * pink noise and sweeps, colour components differ by at most 1 level in
+ * 99.9% of pixels at the default size, and in 98.7% at 8192. Larger
+ * differences happen where a bin's left/right balance is on a pixel
+ * boundary, so a tiny error moves it, and its overflow, to the next
+ * pixel. That is also why input with the same level in both channels,
+ * such as mono, can differ more, as it does between the double and
+ * float engines. "make check-fixed" measures this on the benchmark's
+ * sources, failing if bins differ by more, or if fewer than 98.5% of
+ * components in stereo sources are within 1 level.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "rgbm.h"
+#include "rgbm_tables.h"
+#include "rgbm_simd.h"
+
+/* Stripe values are 100 times the square root of weighted bin power */
+#define SQRT_MULT 100
+/* Largest stripe value, with fraction bits */
+#define PIXEL_BOUND (255 << RGBM_STRIPE_FRAC_BITS)
+/* Power weights are scaled so weighing gives squared stripe values,
+ * with WEIGHT_FRAC_BITS more so the smallest weights keep precision */
+#define WEIGHT_FRAC_BITS 8
+#define WEIGHT_SCALE ((double)SQRT_MULT * SQRT_MULT * \
+                      (1 << (2 * RGBM_STRIPE_FRAC_BITS + WEIGHT_FRAC_BITS)))
+/* Power has 2 * RGBM_BIN_FRAC_BITS fraction bits */
+#define WEIGHT_SHIFT (2 * RGBM_BIN_FRAC_BITS + WEIGHT_FRAC_BITS)
+
+/* Bins are scaled for the default FFT size, which is 2^NUMSAMP_BITS */
+#define NUMSAMP_BITS 9
+#if RGBM_NUMSAMP != 1 << NUMSAMP_BITS
+#error NUMSAMP_BITS does not match RGBM_NUMSAMP.
+#endif
+/* Windowed samples are scaled so the spectrum of each channel stays
+ * below 2^FFT_BITS, which leaves room for CORDIC gain in 32 bits */
+#define FFT_BITS 30
+#if RGBM_MAX_NUMSAMP > 1 << 16
+#error Bit reversed positions need more than 16 bits.
+#endif
+
+/* Magnitude is computed by this many CORDIC steps, leaving an angle of
+ * under 0.03 degrees, and a relative error of about 1.2e-7 */
+#define CORDIC_STEPS 12
+/* Reciprocal of the gain of those steps, Q30 */
+#define CORDIC_INV_GAIN 652032900
+
+/* Twiddle factor 1, Q30 */
+#define TWIDDLE_ONE (1 << 30)
+
+/*
+ * Analysis state
+ */
+
+struct rgbm_ctx {
+    unsigned int width;
+    int use_bins, pivot_bin;
+    unsigned int num_samp, log2_samp;
+    RGBM_SAMPTYPE *fft_in_l, *fft_in_r;
+    /* The same window as rgbm.c, Q30. Scaling by FFT size is applied
+     * to bins. */
+    int32_t *window;
+    /* Q30 cos and sin of 2 pi k / num_samp, for k up to num_samp / 2.
+     * Q15 would be enough for samples, but its error lets the loudest
+     * bins leak into quiet ones. */
+    int32_t *tw_cos, *tw_sin;
+    /* Position of each sample in bit reversed order */
+    uint16_t *bitrev;
+    /* Both channels are transformed together, with left as the real part
+     * and right as the imaginary part, interleaved. */
+    int32_t *fft_buf;
+    RGBM_BINTYPE *fft_bins_l, *fft_bins_r;
+    /* Bin power weights for green, and for red below pivot_bin or blue
+     * at and above it, as in rgbm.c, times WEIGHT_SCALE */
+    uint32_t *green_w, *other_w;
+    /* Squared stripe values, summed from bins */
+    uint64_t *acc;
+    /* Energy going left from each pixel, for peakify_stripe_linear() */
+    int32_t *left_rem;
+    unsigned int left_rem_width;
+    /* Output stripe, with pointers to red, green and blue parts */
+    RGBM_STRIPETYPE *stripe_alloc;
+    RGBM_STRIPETYPE *stripe[3];
+};
+
+static pthread_once_t simd_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Integer helpers
+ */
+
+/* Square root rounded to nearest, digit by digit. Values below 2^32,
+ * which are most of them, take the cheaper 32-bit path. */
+static uint32_t isqrt32(uint32_t v) {
+    uint32_t res = 0, bit = 1UL << 30;
+
+    while (bit > v) bit >>= 2;
+    while (bit != 0) {
+        if (v >= res + bit) {
+            v -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    /* v is now the remainder */
+    return v > res ? res + 1 : res;
+}
+
+static uint32_t isqrt(uint64_t v) {
+    uint64_t res = 0, bit = 1ULL << 62;
+
+    if (v <= 0xffffffffUL) return isqrt32(v);
+    while (bit > v) bit >>= 2;
+    while (bit != 0) {
+        if (v >= res + bit) {
+            v -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return v > res ? res + 1 : res;
+}
+
+/* Magnitude of x + iy by CORDIC vectoring. Each step rotates the vector
+ * towards the real axis by atan(2^-i), using only shifts and adds. */
+static uint32_t magnitude(int32_t x, int32_t y) {
+    int i;
+
+    /* Folding into the first quadrant also makes the result symmetric,
+     * so identical channels get identical bins. */
+    if (x < 0) x = -x;
+    if (y < 0) y = -y;
+    for (i = 0; i < CORDIC_STEPS; i++) {
+        int32_t t = x;
+
+        if (y >= 0) {
+            x += y >> i;
+            y -= t >> i;
+        } else {
+            x -= y >> i;
+            y += t >> i;
+        }
+    }
+    return ((uint64_t)x * CORDIC_INV_GAIN + (1 << 29)) >> 30;
+}
+
+/*
+ * Internal routines
+ */
+
+static void weights_init(rgbm_ctx *ctx, const double *green_tab,
+                         const double *freq_adj) {
+    int i;
+
+    for (i = 0; i < ctx->use_bins; i++) {
+        double adj = freq_adj[i] * freq_adj[i] * WEIGHT_SCALE;
+
+        ctx->green_w[i] = adj * green_tab[i] + 0.5;
+        ctx->other_w[i] = adj * (1.0 - green_tab[i]) + 0.5;
+    }
+}
+
+/* (power * weight) >> WEIGHT_SHIFT, in two parts so the product fits in
+ * 64 bits. Bins are below 2^25, so power is below 2^51. */
+static uint64_t weigh(uint64_t power, uint32_t weight) {
+    return ((power >> 24) * weight +
+            (((power & 0xffffff) * weight) >> 24)) >> (WEIGHT_SHIFT - 24);
+}
+
+/* Like sum_to_stripe() in rgbm.c, adding weighted power of each bin to
+ * the squared stripe values at the pixel given by left/right balance */
+static void sum_to_stripe(rgbm_ctx *ctx, const RGBM_BINTYPE left_bins[],
+                          const RGBM_BINTYPE right_bins[],
+                          unsigned int width) {
+    uint64_t *acc[3] = { ctx->acc, &ctx->acc[width], &ctx->acc[width * 2] };
+    int i;
+
+    for (i = 0; i < ctx->use_bins; i++) {
+        int32_t l = left_bins[i], r = right_bins[i];
+        uint64_t power = (int64_t)l * l + (int64_t)r * r;
+        int total = l + r, pos = width / 2;
+
+        /* Only bin 0 can be negative. Where one side is, the position
+         * is clamped to the other end, as in rgbm.c. */
+        if (total > 0) {
+            if (r <= 0) {
+                pos = 0;
+            } else if (l <= 0) {
+                pos = width - 1;
+            } else {
+                pos = ((uint64_t)(width - 1) * 2 * r + total) / (2 * total);
+            }
+        }
+        acc[1][pos] += weigh(power, ctx->green_w[i]);
+        acc[i < ctx->pivot_bin ? 0 : 2][pos] +=
+            weigh(power, ctx->other_w[i]);
+    }
+}
+
+static void sqrt_stripe(rgbm_ctx *ctx, RGBM_STRIPETYPE **stripe,
+                        unsigned int width) {
+    const uint64_t *acc = ctx->acc;
+    int i, j;
+
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < width; j++) {
+            uint64_t v = *(acc++);
+            stripe[i][j] = v != 0 ? isqrt(v) : 0;
+        }
+    }
+}
+
+static bool bound_pixel(RGBM_STRIPETYPE **stripe, unsigned int index,
+                        int32_t *rem) {
+    int j;
+    int32_t max_col = stripe[0][index];
+    if (stripe[1][index] > max_col) max_col = stripe[1][index];
+    if (stripe[2][index] > max_col) max_col = stripe[2][index];
+
+    if (max_col > PIXEL_BOUND) {
+        /* Q16 factor bringing the brightest colour down to the bound */
+        uint32_t scale = ((uint32_t)PIXEL_BOUND << 16) / max_col;
+        for (j = 0; j < 3; j++) {
+            int32_t v = stripe[j][index];
+            stripe[j][index] = ((int64_t)v * scale + (1 << 15)) >> 16;
+            rem[j] = v - stripe[j][index];
+        }
+        return true;
+    } else {
+        for (j = 0; j < 3; j++) {
+            rem[j] = 0;
+        }
+        return false;
+    }
+}
+
+/* The same as in rgbm.c, on fixed point values */
+#if defined(RGBM_PEAKIFY_WALK) || defined(RGBM_BENCH)
+static void peakify_stripe_walk(RGBM_STRIPETYPE **stripe,
+                                unsigned int width) {
+    int i, j, k;
+    int32_t reml[3], remr[3] = { 0, 0, 0 };
+
+    for (i = 0; i < width; i++) {
+        bool goleft;
+
+        goleft = bound_pixel(stripe, i, reml);
+
+        for (j = 0; j < 3; j++) {
+            reml[j] >>= 1;
+            stripe[j][i] += remr[j] + reml[j];
+        }
+        bound_pixel(stripe, i, remr);
+
+        if (goleft) {
+            for (k = i - 1; k >= 0; k--) {
+                for (j = 0; j < 3; j++) {
+                    stripe[j][k] += reml[j];
+                }
+                if (!bound_pixel(stripe, k, reml)) break;
+            }
+        }
+    }
+}
+#endif
+
+#if !defined(RGBM_PEAKIFY_WALK) || defined(RGBM_BENCH)
+static void peakify_stripe_linear(rgbm_ctx *ctx, RGBM_STRIPETYPE **stripe,
+                                  unsigned int width) {
+    int32_t *left_rem;
+    int i, j;
+    int32_t rem[3], carry[3] = { 0, 0, 0 };
+
+    if (width > ctx->left_rem_width) {
+        free(ctx->left_rem);
+        ctx->left_rem = malloc(width * 3 * sizeof(int32_t));
+        if (ctx->left_rem == NULL) {
+            ctx->left_rem_width = 0;
+            return;
+        }
+        ctx->left_rem_width = width;
+    }
+    left_rem = ctx->left_rem;
+
+    for (i = 0; i < width; i++) {
+        bound_pixel(stripe, i, rem);
+
+        for (j = 0; j < 3; j++) {
+            /* Half of overflow energy propagates in each direction. An
+             * odd unit stays here, so none is lost. */
+            left_rem[i * 3 + j] = rem[j] >> 1;
+            stripe[j][i] += carry[j] + rem[j] - (rem[j] >> 1);
+        }
+        bound_pixel(stripe, i, carry);
+    }
+
+    for (j = 0; j < 3; j++) carry[j] = 0;
+    for (i = width - 1; i >= 0; i--) {
+        for (j = 0; j < 3; j++) {
+            stripe[j][i] += carry[j];
+        }
+        bound_pixel(stripe, i, carry);
+        /* Energy from this pixel starts at the next one to the left */
+        for (j = 0; j < 3; j++) {
+            carry[j] += left_rem[i * 3 + j];
+        }
+    }
+}
+#endif
+
+static void peakify_stripe(rgbm_ctx *ctx, RGBM_STRIPETYPE **stripe,
+                           unsigned int width) {
+#ifdef RGBM_PEAKIFY_WALK
+    peakify_stripe_walk(stripe, width);
+#else
+    peakify_stripe_linear(ctx, stripe, width);
+#endif
+}
+
+/*
+ * Context creation
+ */
+
+static void simd_init_once(void) {
+    rgbm_simd_init();
+}
+
+static bool fft_init(rgbm_ctx *ctx) {
+    unsigned int num_samp = ctx->num_samp, i, j;
+    double *green_tab, *freq_adj;
+
+    for (ctx->log2_samp = 0; (1U << ctx->log2_samp) < num_samp;
+         ctx->log2_samp++);
+    ctx->use_bins = rgbm_tables_usebins(num_samp);
+
+    ctx->fft_in_l = (RGBM_SAMPTYPE *)malloc(sizeof(RGBM_SAMPTYPE) *
+                                            num_samp);
+    ctx->fft_in_r = (RGBM_SAMPTYPE *)malloc(sizeof(RGBM_SAMPTYPE) *
+                                            num_samp);
+    ctx->window = (int32_t *)malloc(sizeof(int32_t) * num_samp);
+    ctx->tw_cos = (int32_t *)malloc(sizeof(int32_t) * num_samp / 2);
+    ctx->tw_sin = (int32_t *)malloc(sizeof(int32_t) * num_samp / 2);
+    ctx->bitrev = (uint16_t *)malloc(sizeof(uint16_t) * num_samp);
+    ctx->fft_buf = (int32_t *)malloc(sizeof(int32_t) * 2 * num_samp);
+    ctx->fft_bins_l = (RGBM_BINTYPE *)malloc(sizeof(RGBM_BINTYPE) *
+                                             ctx->use_bins);
+    ctx->fft_bins_r = (RGBM_BINTYPE *)malloc(sizeof(RGBM_BINTYPE) *
+                                             ctx->use_bins);
+    ctx->green_w = (uint32_t *)malloc(sizeof(uint32_t) * ctx->use_bins);
+    ctx->other_w = (uint32_t *)malloc(sizeof(uint32_t) * ctx->use_bins);
+    if (ctx->fft_in_l == NULL || ctx->fft_in_r == NULL ||
+        ctx->window == NULL || ctx->tw_cos == NULL || ctx->tw_sin == NULL ||
+        ctx->bitrev == NULL || ctx->fft_buf == NULL ||
+        ctx->fft_bins_l == NULL || ctx->fft_bins_r == NULL ||
+        ctx->green_w == NULL || ctx->other_w == NULL)
+        return false;
+
+    for (i = 0; i < num_samp; i++) {
+        ctx->window[i] = (1 - 0.852 * cos(2 * M_PI * i / (num_samp - 1))) *
+                         (1 << 30) + 0.5;
+        ctx->bitrev[i] = 0;
+        for (j = 0; j < ctx->log2_samp; j++) {
+            if (i & (1U << j))
+                ctx->bitrev[i] |= 1U << (ctx->log2_samp - 1 - j);
+        }
+    }
+    for (i = 0; i < num_samp / 2; i++) {
+        ctx->tw_cos[i] = floor(cos(2 * M_PI * i / num_samp) * TWIDDLE_ONE +
+                               0.5);
+        ctx->tw_sin[i] = floor(sin(2 * M_PI * i / num_samp) * TWIDDLE_ONE +
+                               0.5);
+    }
+
+    green_tab = (double *)malloc(sizeof(double) * ctx->use_bins);
+    freq_adj = (double *)malloc(sizeof(double) * ctx->use_bins);
+    if (green_tab == NULL || freq_adj == NULL) {
+        free(green_tab);
+        free(freq_adj);
+        return false;
+    }
+    ctx->pivot_bin = rgbm_tables_green(green_tab, ctx->use_bins, num_samp);
+    rgbm_tables_freq_adj(freq_adj, ctx->use_bins, num_samp);
+    weights_init(ctx, green_tab, freq_adj);
+    free(green_tab);
+    free(freq_adj);
+    return true;
+}
+
+rgbm_ctx *rgbm_ctx_create(unsigned int width, unsigned int numsamp,
+                          int analysis, int effort,
+                          const char *wisdom_file) {
+    rgbm_ctx *ctx;
+    int i;
+
+    /* There is no FFTW plan, so effort and wisdom_file don't matter */
+    if (numsamp < RGBM_MIN_NUMSAMP || numsamp > RGBM_MAX_NUMSAMP ||
+        (numsamp & (numsamp - 1)) != 0 || analysis != RGBM_ANALYSIS_FFT ||
+        effort < RGBM_PLAN_ESTIMATE || effort > RGBM_PLAN_PATIENT)
+        return NULL;
+    if (width == 0) return NULL;
+
+    pthread_once(&simd_once, simd_init_once);
+
+    ctx = (rgbm_ctx *)calloc(1, sizeof(rgbm_ctx));
+    if (ctx == NULL) return NULL;
+    ctx->width = width;
+    ctx->num_samp = numsamp;
+    if (!fft_init(ctx)) {
+        rgbm_ctx_destroy(ctx);
+        return NULL;
+    }
+
+    ctx->acc = (uint64_t *)malloc(sizeof(uint64_t) * 3 * width);
+    ctx->left_rem = (int32_t *)malloc(sizeof(int32_t) * 3 * width);
+    ctx->left_rem_width = width;
+    ctx->stripe_alloc = (RGBM_STRIPETYPE *)malloc(sizeof(RGBM_STRIPETYPE) *
+                                                  3 * width);
+    if (ctx->acc == NULL || ctx->left_rem == NULL ||
+        ctx->stripe_alloc == NULL) {
+        rgbm_ctx_destroy(ctx);
+        return NULL;
+    }
+    for (i = 0; i < 3; i++) {
+        ctx->stripe[i] = &ctx->stripe_alloc[width * i];
+    }
+    return ctx;
+}
+
+void rgbm_ctx_destroy(rgbm_ctx *ctx) {
+    if (ctx == NULL) return;
+    free(ctx->fft_in_l);
+    free(ctx->fft_in_r);
+    free(ctx->window);
+    free(ctx->tw_cos);
+    free(ctx->tw_sin);
+    free(ctx->bitrev);
+    free(ctx->fft_buf);
+    free(ctx->fft_bins_l);
+    free(ctx->fft_bins_r);
+    free(ctx->green_w);
+    free(ctx->other_w);
+    free(ctx->acc);
+    free(ctx->left_rem);
+    free(ctx->stripe_alloc);
+    free(ctx);
+}
+
+unsigned int rgbm_ctx_width(const rgbm_ctx *ctx) {
+    return ctx->width;
+}
+
+RGBM_STRIPETYPE **rgbm_ctx_process(rgbm_ctx *ctx,
+                                   const RGBM_BINTYPE left_bins[],
+                                   const RGBM_BINTYPE right_bins[]) {
+    unsigned int width = ctx->width;
+    RGBM_STRIPETYPE **stripe = ctx->stripe;
+
+    memset(ctx->acc, 0, sizeof(uint64_t) * 3 * width);
+    sum_to_stripe(ctx, left_bins, right_bins, width);
+    sqrt_stripe(ctx, stripe, width);
+    peakify_stripe(ctx, stripe, width);
+    return stripe;
+}
+
+/*
+ * FFT
+ */
+
+unsigned int rgbm_ctx_num_samples(const rgbm_ctx *ctx) {
+    return ctx->num_samp;
+}
+
+void rgbm_ctx_get_wave_buffers(rgbm_ctx *ctx, RGBM_SAMPTYPE *left[],
+                               RGBM_SAMPTYPE *right[]) {
+    *left = ctx->fft_in_l;
+    *right = ctx->fft_in_r;
+}
+
+/* Window both channels while packing them into one complex input, in
+ * bit reversed order for fft_execute(). The mean of the window is 2^30,
+ * so the sum of num_samp products stays below 2^(45 + log2_samp) before
+ * shifting. */
+static void fft_pack_window(rgbm_ctx *ctx) {
+    int shift = 45 + ctx->log2_samp - FFT_BITS;
+    int64_t round = (int64_t)1 << (shift - 1);
+    unsigned int i;
+
+    for (i = 0; i < ctx->num_samp; i++) {
+        int32_t *z = &ctx->fft_buf[ctx->bitrev[i] * 2];
+        int64_t w = ctx->window[i];
+
+        z[0] = (ctx->fft_in_l[i] * w + round) >> shift;
+        z[1] = (ctx->fft_in_r[i] * w + round) >> shift;
+    }
+}
+
+/* In place radix 2 decimation in time FFT. Partial sums are bounded
+ * like the result, but rotation by twiddle factors can make a part up
+ * to sqrt(2) larger, so values stay below 2^(FFT_BITS + 0.5). Products
+ * with Q30 twiddle factors use 64 bits. */
+static void fft_execute(rgbm_ctx *ctx) {
+    int32_t *buf = ctx->fft_buf;
+    unsigned int n = ctx->num_samp, half, step, j, k;
+
+    for (half = 1, step = n / 2; half < n; half *= 2, step /= 2) {
+        for (j = 0; j < half; j++) {
+            int32_t c = ctx->tw_cos[j * step], s = ctx->tw_sin[j * step];
+
+            for (k = j; k < n; k += half * 2) {
+                int32_t *a = &buf[k * 2], *b = &buf[(k + half) * 2];
+                int32_t tr, ti;
+
+                /* b times exp(-2 pi i j / (2 * half)) */
+                if (j == 0) {
+                    tr = b[0];
+                    ti = b[1];
+                } else {
+                    tr = ((int64_t)b[0] * c + (int64_t)b[1] * s +
+                          TWIDDLE_ONE / 2) >> 30;
+                    ti = ((int64_t)b[1] * c - (int64_t)b[0] * s +
+                          TWIDDLE_ONE / 2) >> 30;
+                }
+                b[0] = a[0] - tr;
+                b[1] = a[1] - ti;
+                a[0] += tr;
+                a[1] += ti;
+            }
+        }
+    }
+}
+
+/* Separate the spectra of the two real channels and convert them to
+ * amplitudes, as in fft_split_magnitude() in rgbm.c. Values are halved
+ * before adding, so they are the channel spectra, below 2^FFT_BITS.
+ * Bins in rgbm.c are those spectra times RGBM_NUMSAMP / num_samp, and
+ * here they are in units of num_samp * 2^-FFT_BITS, so with fraction
+ * bits added the scale is a constant right shift. */
+#define BIN_SHIFT (FFT_BITS - NUMSAMP_BITS - RGBM_BIN_FRAC_BITS)
+#define BIN_ROUND (1 << (BIN_SHIFT - 1))
+
+static void fft_to_bins(rgbm_ctx *ctx) {
+    const int32_t *z = ctx->fft_buf;
+    unsigned int n = ctx->num_samp, k;
+
+    /* Bin 0 is left as the signed real DC value */
+    ctx->fft_bins_l[0] = (z[0] + BIN_ROUND) >> BIN_SHIFT;
+    ctx->fft_bins_r[0] = (z[1] + BIN_ROUND) >> BIN_SHIFT;
+    for (k = 1; k < ctx->use_bins; k++) {
+        int32_t a = z[k * 2] >> 1, b = z[k * 2 + 1] >> 1;
+        int32_t c = z[(n - k) * 2] >> 1, d = z[(n - k) * 2 + 1] >> 1;
+
+        ctx->fft_bins_l[k] = (magnitude(a + c, b - d) + BIN_ROUND) >>
+                             BIN_SHIFT;
+        ctx->fft_bins_r[k] = (magnitude(b + d, c - a) + BIN_ROUND) >>
+                             BIN_SHIFT;
+    }
+}
+
+RGBM_STRIPETYPE **rgbm_ctx_process_wave(rgbm_ctx *ctx) {
+    fft_pack_window(ctx);
+    fft_execute(ctx);
+    fft_to_bins(ctx);
+    return rgbm_ctx_process(ctx, ctx->fft_bins_l, ctx->fft_bins_r);
+}
+
+/* Contexts are only created for RGBM_ANALYSIS_FFT, so these are never
+ * reached. They exist so programs supporting the sliding DFT link. */
+void rgbm_ctx_push_samples(rgbm_ctx *ctx, const RGBM_SAMPTYPE left[],
+                           const RGBM_SAMPTYPE right[], unsigned int count) {
+}
+
+RGBM_STRIPETYPE **rgbm_ctx_process_sliding(rgbm_ctx *ctx) {
+    return NULL;
+}
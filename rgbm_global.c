@@ -0,0 +1,142 @@
+/* Single stream visualization, connecting analysis to the display. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include "rgbm.h"
+#include "display.h"
+#include "present.h"
+
+static rgbm_ctx *ctx = NULL;
+static int present_policy = RGBM_PRESENT_DROP;
+static unsigned int present_buffers = RGBM_PRESENT_BUFFERS;
+static unsigned int present_stale_ms = RGBM_PRESENT_STALE_MS;
+/* Capture time and stream position of the next stripe, or 0 if unknown */
+static uint64_t capture_time = 0, stream_time = 0;
+
+static unsigned int num_samp = RGBM_NUMSAMP;
+static int analysis_type = RGBM_ANALYSIS_FFT;
+static int plan_effort = RGBM_PLAN_ESTIMATE;
+static const char *wisdom_file = NULL;
+
+int rgbm_configure_present(int policy, unsigned int buffers) {
+    if (policy < RGBM_PRESENT_SYNC || policy > RGBM_PRESENT_LATEST ||
+        buffers < 2)
+        return false;
+
+    present_policy = policy;
+    present_buffers = buffers;
+    return true;
+}
+
+int rgbm_configure_stale(unsigned int ms) {
+    if (ms == 0) return false;
+
+    present_stale_ms = ms;
+    return true;
+}
+
+void rgbm_set_capture_time(uint64_t ns) {
+    capture_time = ns;
+}
+
+void rgbm_set_stream_time(uint64_t ns) {
+    stream_time = ns;
+}
+
+int rgbm_get_latency(struct rgbm_latency *lat) {
+    return present_latency(lat);
+}
+
+int rgbm_configure_display(const char *sinks) {
+    return display_configure(sinks);
+}
+
+int rgbm_configure_fft(unsigned int numsamp, int effort,
+                       const char *wisdom) {
+    if (numsamp < RGBM_MIN_NUMSAMP || numsamp > RGBM_MAX_NUMSAMP ||
+        effort < RGBM_PLAN_ESTIMATE || effort > RGBM_PLAN_PATIENT)
+        return false;
+#ifdef RGBM_FIXED
+    /* The fixed point FFT is radix 2 */
+    if ((numsamp & (numsamp - 1)) != 0) return false;
+#endif
+
+    num_samp = numsamp;
+    plan_effort = effort;
+    wisdom_file = wisdom;
+    return true;
+}
+
+int rgbm_configure_analysis(int analysis) {
+    if (analysis < RGBM_ANALYSIS_FFT || analysis > RGBM_ANALYSIS_SDFT)
+        return false;
+#ifdef RGBM_FIXED
+    if (analysis != RGBM_ANALYSIS_FFT) return false;
+#endif
+
+    analysis_type = analysis;
+    return true;
+}
+
+int rgbm_analysis(void) {
+    return analysis_type;
+}
+
+unsigned int rgbm_num_samples(void) {
+    return num_samp;
+}
+
+int rgbm_init(void) {
+    ctx = rgbm_ctx_create(display_width(), num_samp, analysis_type,
+                          plan_effort, wisdom_file);
+    /* Caller's name may not remain valid */
+    wisdom_file = NULL;
+    if (ctx == NULL)
+        return false;
+
+    if (!present_init(present_policy, present_buffers, present_stale_ms)) {
+        rgbm_ctx_destroy(ctx);
+        ctx = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+void rgbm_shutdown(void) {
+    present_quit();
+    rgbm_ctx_destroy(ctx);
+    ctx = NULL;
+}
+
+/* Each time only applies to one stripe */
+static int present_tagged(RGBM_STRIPETYPE **stripe) {
+    uint64_t t = capture_time, s = stream_time;
+
+    capture_time = 0;
+    stream_time = 0;
+    return present_stripe(stripe, rgbm_ctx_width(ctx), t, s);
+}
+
+int rgbm_render(const RGBM_BINTYPE left_bins[],
+                const RGBM_BINTYPE right_bins[]) {
+    return present_tagged(rgbm_ctx_process(ctx, left_bins, right_bins));
+}
+
+void rgbm_get_wave_buffers(RGBM_SAMPTYPE *left[], RGBM_SAMPTYPE *right[]) {
+    rgbm_ctx_get_wave_buffers(ctx, left, right);
+}
+
+int rgbm_render_wave(void) {
+    return present_tagged(rgbm_ctx_process_wave(ctx));
+}
+
+void rgbm_push_samples(const RGBM_SAMPTYPE left[],
+                       const RGBM_SAMPTYPE right[], unsigned int count) {
+    rgbm_ctx_push_samples(ctx, left, right, count);
+}
+
+int rgbm_render_sliding(void) {
+    return present_tagged(rgbm_ctx_process_sliding(ctx));
+}
@@ -0,0 +1,43 @@
+/* ISO 226 equal loudness contour data for colour waterfall tables. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#ifndef _RGBM_ISO226_H_
+#define _RGBM_ISO226_H_
+
+/* The tables are constexpr in C++, so rgbm_engine.cc can compute
+ * tables from them while compiling. */
+#ifdef __cplusplus
+#define ISO226_CONST constexpr
+#else
+#define ISO226_CONST const
+#endif
+
+#define ISO226_POINTS 29
+#define ISO226_TOPFREQ 12500.0
+
+/* Tables from ISO 226, as in iso226.m by Jeff Tackett */
+static ISO226_CONST double iso226_f[ISO226_POINTS] = {
+    20, 25, 31.5, 40, 50, 63, 80, 100, 125, 160, 200, 250, 315, 400, 500,
+    630, 800, 1000, 1250, 1600, 2000, 2500, 3150, 4000, 5000, 6300, 8000,
+    10000, 12500
+};
+
+static ISO226_CONST double iso226_af[ISO226_POINTS] = {
+    0.532, 0.506, 0.480, 0.455, 0.432, 0.409, 0.387, 0.367, 0.349, 0.330,
+    0.315, 0.301, 0.288, 0.276, 0.267, 0.259, 0.253, 0.250, 0.246, 0.244,
+    0.243, 0.243, 0.243, 0.242, 0.242, 0.245, 0.254, 0.271, 0.301
+};
+
+static ISO226_CONST double iso226_Lu[ISO226_POINTS] = {
+    -31.6, -27.2, -23.0, -19.1, -15.9, -13.0, -10.3, -8.1, -6.2, -4.5,
+    -3.1, -2.0, -1.1, -0.4, 0.0, 0.3, 0.5, 0.0, -2.7, -4.1, -1.0, 1.7,
+    2.5, 1.2, -2.1, -7.1, -11.2, -10.7, -3.1
+};
+
+static ISO226_CONST double iso226_Tf[ISO226_POINTS] = {
+    78.5, 68.7, 59.5, 51.1, 44.0, 37.5, 31.5, 26.5, 22.1, 17.9, 14.4,
+    11.4, 8.6, 6.2, 4.4, 3.0, 2.2, 2.4, 3.5, 1.7, -1.3, -4.2, -6.0, -5.4,
+    -1.5, 6.0, 12.6, 13.9, 12.3
+};
+
+#endif /* !_RGBM_ISO226_H_ */
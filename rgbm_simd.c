@@ -0,0 +1,710 @@
+/* Vectorized colour waterfall kernels with run time CPU selection. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "rgbm.h"
+#include "rgbm_simd.h"
+#include "display.h"
+
+/* The fixed point engine has its own analysis code in rgbm_fixed.c, so
+ * only the input and display kernels are built for it. */
+#ifndef RGBM_FIXED
+#define RGBM_SIMD_ANALYSIS
+#endif
+
+/* Analysis and display kernels are only vectorized for single precision,
+ * where they process twice as many values per instruction. Double
+ * precision builds, such as the default Audacious plugin, still have
+ * vectorized deinterleaving of the player's float PCM. */
+#ifdef RGBM_SIMD_ANALYSIS
+#if defined(__i386__) || defined(__x86_64__)
+#define RGBM_SIMD_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define RGBM_SIMD_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+#ifdef RGBM_FLOAT
+#define RGBM_SQRT sqrtf
+#else
+#define RGBM_SQRT sqrt
+#endif
+
+/*
+ * Scalar kernels, also used for the ends of vectorized loops
+ */
+
+static void deinterleave_scalar(const float *pcm, RGBM_SAMPTYPE *left,
+                                RGBM_SAMPTYPE *right, unsigned int n) {
+    unsigned int i;
+    for (i = 0; i < n; i++) {
+        left[i] = RGBM_SAMPLE_FLOAT(pcm[i * 2]);
+        right[i] = RGBM_SAMPLE_FLOAT(pcm[i * 2 + 1]);
+    }
+}
+
+#ifdef RGBM_SIMD_ANALYSIS
+static void pack_window_scalar(const RGBM_SAMPTYPE *left,
+                               const RGBM_SAMPTYPE *right,
+                               const RGBM_SAMPTYPE *window,
+                               RGBM_SAMPTYPE *cplx, unsigned int n) {
+    unsigned int i;
+    for (i = 0; i < n; i++) {
+        cplx[i * 2] = left[i] * window[i];
+        cplx[i * 2 + 1] = right[i] * window[i];
+    }
+}
+
+/* Handles bins from start to bins - 1 */
+static void split_magnitude_range(const RGBM_SAMPTYPE *cplx,
+                                  RGBM_BINTYPE *left, RGBM_BINTYPE *right,
+                                  unsigned int start, unsigned int bins,
+                                  unsigned int n) {
+    unsigned int i;
+    for (i = start; i < bins; i++) {
+        const RGBM_SAMPTYPE *z = &cplx[i * 2], *zc = &cplx[(n - i) * 2];
+        RGBM_SAMPTYPE re, im;
+
+        re = z[0] + zc[0];
+        im = z[1] - zc[1];
+        left[i] = 0.5 * RGBM_SQRT(re * re + im * im);
+        re = z[0] - zc[0];
+        im = z[1] + zc[1];
+        right[i] = 0.5 * RGBM_SQRT(re * re + im * im);
+    }
+}
+
+static void split_magnitude_scalar(const RGBM_SAMPTYPE *cplx,
+                                   RGBM_BINTYPE *left, RGBM_BINTYPE *right,
+                                   unsigned int bins, unsigned int n) {
+    split_magnitude_range(cplx, left, right, 1, bins, n);
+}
+#endif /* RGBM_SIMD_ANALYSIS */
+
+#ifdef RGBM_SIMD_ANALYSIS
+/* Computed in double precision, exactly like the original
+ * sum_to_stripe(), so results don't depend on the bin type. */
+static void weigh_bins_scalar(const RGBM_BINTYPE *left,
+                              const RGBM_BINTYPE *right,
+                              const RGBM_STRIPETYPE *green_w,
+                              const RGBM_STRIPETYPE *other_w,
+                              unsigned int n, unsigned int width, int *pos,
+                              RGBM_STRIPETYPE *green,
+                              RGBM_STRIPETYPE *other) {
+    unsigned int i;
+    for (i = 0; i < n; i++) {
+        double l = left[i], r = right[i], power, total;
+
+        power = l * l + r * r;
+        green[i] = green_w[i] * power;
+        other[i] = other_w[i] * power;
+
+        /* This calculation needs non-negative bin values. */
+        total = l + r;
+        if (total > 0) {
+            int p = (width - 1) * r / total + 0.5;
+            if (p >= (int)width) {
+                p = width - 1;
+            } else if (p < 0) {
+                p = 0;
+            }
+            pos[i] = p;
+        } else {
+            pos[i] = width / 2;
+        }
+    }
+}
+
+static void sqrt_scale_scalar(RGBM_STRIPETYPE *p, unsigned int n,
+                              RGBM_STRIPETYPE scale) {
+    unsigned int i;
+    for (i = 0; i < n; i++) {
+        p[i] = RGBM_SQRT(p[i]) * scale;
+    }
+}
+#endif /* RGBM_SIMD_ANALYSIS */
+
+/* Rounds exactly like display_clip() */
+static void pack_pixels_scalar(const RGBM_STRIPETYPE *r,
+                               const RGBM_STRIPETYPE *g,
+                               const RGBM_STRIPETYPE *b, uint32_t *out,
+                               unsigned int n, int rshift, int gshift,
+                               int bshift) {
+    unsigned int i;
+    for (i = 0; i < n; i++) {
+        out[i] = ((uint32_t)display_clip(r[i]) << rshift) |
+                 ((uint32_t)display_clip(g[i]) << gshift) |
+                 ((uint32_t)display_clip(b[i]) << bshift);
+    }
+}
+
+#if defined(RGBM_SIMD_X86) && defined(RGBM_FLOAT)
+/*
+ * SSE2 kernels, 4 floats per vector
+ */
+
+__attribute__((target("sse2")))
+static void pack_window_sse2(const float *left, const float *right,
+                             const float *window, float *cplx,
+                             unsigned int n) {
+    unsigned int i;
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128 w = _mm_loadu_ps(&window[i]);
+        __m128 l = _mm_mul_ps(_mm_loadu_ps(&left[i]), w);
+        __m128 r = _mm_mul_ps(_mm_loadu_ps(&right[i]), w);
+        _mm_storeu_ps(&cplx[i * 2], _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(&cplx[i * 2 + 4], _mm_unpackhi_ps(l, r));
+    }
+    pack_window_scalar(&left[i], &right[i], &window[i], &cplx[i * 2], n - i);
+}
+
+__attribute__((target("sse2")))
+static void deinterleave_sse2(const float *pcm, float *left, float *right,
+                              unsigned int n) {
+    unsigned int i;
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128 a = _mm_loadu_ps(&pcm[i * 2]);
+        __m128 b = _mm_loadu_ps(&pcm[i * 2 + 4]);
+        _mm_storeu_ps(&left[i], _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(&right[i], _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    deinterleave_scalar(&pcm[i * 2], &left[i], &right[i], n - i);
+}
+
+__attribute__((target("sse2")))
+static void split_magnitude_sse2(const float *cplx, float *left,
+                                 float *right, unsigned int bins,
+                                 unsigned int n) {
+    const __m128 half = _mm_set1_ps(0.5f);
+    unsigned int i;
+
+    for (i = 1; i + 4 <= bins; i += 4) {
+        /* Bins i to i + 3 */
+        __m128 z0 = _mm_loadu_ps(&cplx[i * 2]);
+        __m128 z1 = _mm_loadu_ps(&cplx[i * 2 + 4]);
+        /* Bins n - i - 3 to n - i, reversed to match */
+        __m128 c0 = _mm_loadu_ps(&cplx[(n - i - 3) * 2]);
+        __m128 c1 = _mm_loadu_ps(&cplx[(n - i - 1) * 2]);
+        __m128 zr = _mm_shuffle_ps(z0, z1, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 zi = _mm_shuffle_ps(z0, z1, _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 cr = _mm_shuffle_ps(c1, c0, _MM_SHUFFLE(0, 2, 0, 2));
+        __m128 ci = _mm_shuffle_ps(c1, c0, _MM_SHUFFLE(1, 3, 1, 3));
+        __m128 re, im;
+
+        re = _mm_add_ps(zr, cr);
+        im = _mm_sub_ps(zi, ci);
+        _mm_storeu_ps(&left[i], _mm_mul_ps(half, _mm_sqrt_ps(
+            _mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im)))));
+        re = _mm_sub_ps(zr, cr);
+        im = _mm_add_ps(zi, ci);
+        _mm_storeu_ps(&right[i], _mm_mul_ps(half, _mm_sqrt_ps(
+            _mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im)))));
+    }
+    split_magnitude_range(cplx, left, right, i, bins, n);
+}
+
+__attribute__((target("sse2")))
+static void weigh_bins_sse2(const float *left, const float *right,
+                            const float *green_w, const float *other_w,
+                            unsigned int n, unsigned int width, int *pos,
+                            float *green, float *other) {
+    const __m128 zero = _mm_setzero_ps(), half = _mm_set1_ps(0.5f);
+    const __m128 last = _mm_set1_ps(width - 1);
+    const __m128 centre = _mm_set1_ps(width / 2);
+    unsigned int i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128 l = _mm_loadu_ps(&left[i]), r = _mm_loadu_ps(&right[i]);
+        __m128 power = _mm_add_ps(_mm_mul_ps(l, l), _mm_mul_ps(r, r));
+        __m128 total = _mm_add_ps(l, r);
+        __m128 valid = _mm_cmpgt_ps(total, zero);
+        __m128 p;
+
+        _mm_storeu_ps(&green[i], _mm_mul_ps(_mm_loadu_ps(&green_w[i]), power));
+        _mm_storeu_ps(&other[i], _mm_mul_ps(_mm_loadu_ps(&other_w[i]), power));
+
+        /* Division by zero or negative total is masked out afterwards */
+        p = _mm_add_ps(_mm_div_ps(_mm_mul_ps(last, r), total), half);
+        p = _mm_min_ps(_mm_max_ps(p, zero), last);
+        p = _mm_or_ps(_mm_and_ps(valid, p), _mm_andnot_ps(valid, centre));
+        _mm_storeu_si128((__m128i *)&pos[i], _mm_cvttps_epi32(p));
+    }
+    weigh_bins_scalar(&left[i], &right[i], &green_w[i], &other_w[i], n - i,
+                      width, &pos[i], &green[i], &other[i]);
+}
+
+/* Clamping before conversion keeps huge values and NaN from wrapping */
+__attribute__((target("sse2")))
+static inline __m128i clip_sse2(__m128 v) {
+    v = _mm_add_ps(v, _mm_set1_ps(0.5f));
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+    return _mm_cvttps_epi32(v);
+}
+
+__attribute__((target("sse2")))
+static void pack_pixels_sse2(const float *r, const float *g, const float *b,
+                             uint32_t *out, unsigned int n, int rshift,
+                             int gshift, int bshift) {
+    const __m128i rs = _mm_cvtsi32_si128(rshift);
+    const __m128i gs = _mm_cvtsi32_si128(gshift);
+    const __m128i bs = _mm_cvtsi32_si128(bshift);
+    unsigned int i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128i p = _mm_or_si128(
+            _mm_or_si128(_mm_sll_epi32(clip_sse2(_mm_loadu_ps(&r[i])), rs),
+                         _mm_sll_epi32(clip_sse2(_mm_loadu_ps(&g[i])), gs)),
+            _mm_sll_epi32(clip_sse2(_mm_loadu_ps(&b[i])), bs));
+        _mm_storeu_si128((__m128i *)&out[i], p);
+    }
+    pack_pixels_scalar(&r[i], &g[i], &b[i], &out[i], n - i,
+                       rshift, gshift, bshift);
+}
+
+__attribute__((target("sse2")))
+static void sqrt_scale_sse2(float *p, unsigned int n, float scale) {
+    const __m128 s = _mm_set1_ps(scale);
+    unsigned int i;
+    for (i = 0; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(&p[i], _mm_mul_ps(_mm_sqrt_ps(_mm_loadu_ps(&p[i])), s));
+    }
+    sqrt_scale_scalar(&p[i], n - i, scale);
+}
+
+/*
+ * AVX2 kernels, 8 floats per vector
+ */
+
+/* Deinterleave 8 complex numbers from a and b into real and imaginary */
+__attribute__((target("avx2")))
+static inline void deinterleave_avx2(__m256 a, __m256 b,
+                                     __m256 *re, __m256 *im) {
+    /* Shuffles work within 128-bit lanes, so 64-bit pairs end up in
+     * 0, 2, 1, 3 order and need to be permuted back. */
+    *re = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(
+          _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))), 0xd8));
+    *im = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(
+          _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), 0xd8));
+}
+
+__attribute__((target("avx2")))
+static void pack_window_avx2(const float *left, const float *right,
+                             const float *window, float *cplx,
+                             unsigned int n) {
+    unsigned int i;
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256 w = _mm256_loadu_ps(&window[i]);
+        __m256 l = _mm256_mul_ps(_mm256_loadu_ps(&left[i]), w);
+        __m256 r = _mm256_mul_ps(_mm256_loadu_ps(&right[i]), w);
+        __m256 lo = _mm256_unpacklo_ps(l, r);
+        __m256 hi = _mm256_unpackhi_ps(l, r);
+        _mm256_storeu_ps(&cplx[i * 2], _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(&cplx[i * 2 + 8],
+                         _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+    pack_window_scalar(&left[i], &right[i], &window[i], &cplx[i * 2], n - i);
+}
+
+__attribute__((target("avx2")))
+static void deinterleave_pcm_avx2(const float *pcm, float *left,
+                                  float *right, unsigned int n) {
+    unsigned int i;
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256 l, r;
+        deinterleave_avx2(_mm256_loadu_ps(&pcm[i * 2]),
+                          _mm256_loadu_ps(&pcm[i * 2 + 8]), &l, &r);
+        _mm256_storeu_ps(&left[i], l);
+        _mm256_storeu_ps(&right[i], r);
+    }
+    deinterleave_scalar(&pcm[i * 2], &left[i], &right[i], n - i);
+}
+
+__attribute__((target("avx2")))
+static void split_magnitude_avx2(const float *cplx, float *left,
+                                 float *right, unsigned int bins,
+                                 unsigned int n) {
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256i reverse = _mm256_set_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    unsigned int i;
+
+    for (i = 1; i + 8 <= bins; i += 8) {
+        __m256 zr, zi, cr, ci, re, im;
+
+        /* Bins i to i + 7 */
+        deinterleave_avx2(_mm256_loadu_ps(&cplx[i * 2]),
+                          _mm256_loadu_ps(&cplx[i * 2 + 8]), &zr, &zi);
+        /* Bins n - i - 7 to n - i, reversed to match */
+        deinterleave_avx2(_mm256_loadu_ps(&cplx[(n - i - 7) * 2]),
+                          _mm256_loadu_ps(&cplx[(n - i - 3) * 2]), &cr, &ci);
+        cr = _mm256_permutevar8x32_ps(cr, reverse);
+        ci = _mm256_permutevar8x32_ps(ci, reverse);
+
+        re = _mm256_add_ps(zr, cr);
+        im = _mm256_sub_ps(zi, ci);
+        _mm256_storeu_ps(&left[i], _mm256_mul_ps(half, _mm256_sqrt_ps(
+            _mm256_add_ps(_mm256_mul_ps(re, re), _mm256_mul_ps(im, im)))));
+        re = _mm256_sub_ps(zr, cr);
+        im = _mm256_add_ps(zi, ci);
+        _mm256_storeu_ps(&right[i], _mm256_mul_ps(half, _mm256_sqrt_ps(
+            _mm256_add_ps(_mm256_mul_ps(re, re), _mm256_mul_ps(im, im)))));
+    }
+    split_magnitude_range(cplx, left, right, i, bins, n);
+}
+
+__attribute__((target("avx2")))
+static void weigh_bins_avx2(const float *left, const float *right,
+                            const float *green_w, const float *other_w,
+                            unsigned int n, unsigned int width, int *pos,
+                            float *green, float *other) {
+    const __m256 zero = _mm256_setzero_ps(), half = _mm256_set1_ps(0.5f);
+    const __m256 last = _mm256_set1_ps(width - 1);
+    const __m256 centre = _mm256_set1_ps(width / 2);
+    unsigned int i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256 l = _mm256_loadu_ps(&left[i]), r = _mm256_loadu_ps(&right[i]);
+        __m256 power = _mm256_add_ps(_mm256_mul_ps(l, l), _mm256_mul_ps(r, r));
+        __m256 total = _mm256_add_ps(l, r);
+        __m256 valid = _mm256_cmp_ps(total, zero, _CMP_GT_OQ);
+        __m256 p;
+
+        _mm256_storeu_ps(&green[i],
+                         _mm256_mul_ps(_mm256_loadu_ps(&green_w[i]), power));
+        _mm256_storeu_ps(&other[i],
+                         _mm256_mul_ps(_mm256_loadu_ps(&other_w[i]), power));
+
+        p = _mm256_add_ps(_mm256_div_ps(_mm256_mul_ps(last, r), total), half);
+        p = _mm256_min_ps(_mm256_max_ps(p, zero), last);
+        p = _mm256_blendv_ps(centre, p, valid);
+        _mm256_storeu_si256((__m256i *)&pos[i], _mm256_cvttps_epi32(p));
+    }
+    weigh_bins_scalar(&left[i], &right[i], &green_w[i], &other_w[i], n - i,
+                      width, &pos[i], &green[i], &other[i]);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i clip_avx2(__m256 v) {
+    v = _mm256_add_ps(v, _mm256_set1_ps(0.5f));
+    v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()),
+                      _mm256_set1_ps(255.0f));
+    return _mm256_cvttps_epi32(v);
+}
+
+__attribute__((target("avx2")))
+static void pack_pixels_avx2(const float *r, const float *g, const float *b,
+                             uint32_t *out, unsigned int n, int rshift,
+                             int gshift, int bshift) {
+    const __m128i rs = _mm_cvtsi32_si128(rshift);
+    const __m128i gs = _mm_cvtsi32_si128(gshift);
+    const __m128i bs = _mm_cvtsi32_si128(bshift);
+    unsigned int i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256i p = _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_sll_epi32(clip_avx2(_mm256_loadu_ps(&r[i])), rs),
+                _mm256_sll_epi32(clip_avx2(_mm256_loadu_ps(&g[i])), gs)),
+            _mm256_sll_epi32(clip_avx2(_mm256_loadu_ps(&b[i])), bs));
+        _mm256_storeu_si256((__m256i *)&out[i], p);
+    }
+    pack_pixels_scalar(&r[i], &g[i], &b[i], &out[i], n - i,
+                       rshift, gshift, bshift);
+}
+
+__attribute__((target("avx2")))
+static void sqrt_scale_avx2(float *p, unsigned int n, float scale) {
+    const __m256 s = _mm256_set1_ps(scale);
+    unsigned int i;
+    for (i = 0; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(&p[i],
+                         _mm256_mul_ps(_mm256_sqrt_ps(_mm256_loadu_ps(&p[i])),
+                                       s));
+    }
+    sqrt_scale_scalar(&p[i], n - i, scale);
+}
+#endif /* RGBM_SIMD_X86 && RGBM_FLOAT */
+
+#if defined(RGBM_SIMD_NEON) && defined(RGBM_FLOAT)
+/*
+ * NEON kernels, 4 floats per vector. AArch64 always has NEON, so
+ * these don't need run time detection.
+ */
+
+static void pack_window_neon(const float *left, const float *right,
+                             const float *window, float *cplx,
+                             unsigned int n) {
+    unsigned int i;
+    for (i = 0; i + 4 <= n; i += 4) {
+        float32x4_t w = vld1q_f32(&window[i]);
+        float32x4x2_t lr;
+        lr.val[0] = vmulq_f32(vld1q_f32(&left[i]), w);
+        lr.val[1] = vmulq_f32(vld1q_f32(&right[i]), w);
+        vst2q_f32(&cplx[i * 2], lr);
+    }
+    pack_window_scalar(&left[i], &right[i], &window[i], &cplx[i * 2], n - i);
+}
+
+static inline float32x4_t reverse_neon(float32x4_t v) {
+    v = vrev64q_f32(v);
+    return vcombine_f32(vget_high_f32(v), vget_low_f32(v));
+}
+
+static void deinterleave_neon(const float *pcm, float *left, float *right,
+                              unsigned int n) {
+    unsigned int i;
+    for (i = 0; i + 4 <= n; i += 4) {
+        float32x4x2_t lr = vld2q_f32(&pcm[i * 2]);
+        vst1q_f32(&left[i], lr.val[0]);
+        vst1q_f32(&right[i], lr.val[1]);
+    }
+    deinterleave_scalar(&pcm[i * 2], &left[i], &right[i], n - i);
+}
+
+static void split_magnitude_neon(const float *cplx, float *left,
+                                 float *right, unsigned int bins,
+                                 unsigned int n) {
+    unsigned int i;
+
+    for (i = 1; i + 4 <= bins; i += 4) {
+        float32x4x2_t z = vld2q_f32(&cplx[i * 2]);
+        float32x4x2_t c = vld2q_f32(&cplx[(n - i - 3) * 2]);
+        float32x4_t cr = reverse_neon(c.val[0]), ci = reverse_neon(c.val[1]);
+        float32x4_t re, im;
+
+        re = vaddq_f32(z.val[0], cr);
+        im = vsubq_f32(z.val[1], ci);
+        vst1q_f32(&left[i], vmulq_n_f32(vsqrtq_f32(
+            vmlaq_f32(vmulq_f32(re, re), im, im)), 0.5f));
+        re = vsubq_f32(z.val[0], cr);
+        im = vaddq_f32(z.val[1], ci);
+        vst1q_f32(&right[i], vmulq_n_f32(vsqrtq_f32(
+            vmlaq_f32(vmulq_f32(re, re), im, im)), 0.5f));
+    }
+    split_magnitude_range(cplx, left, right, i, bins, n);
+}
+
+static void weigh_bins_neon(const float *left, const float *right,
+                            const float *green_w, const float *other_w,
+                            unsigned int n, unsigned int width, int *pos,
+                            float *green, float *other) {
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t last = vdupq_n_f32(width - 1);
+    const float32x4_t centre = vdupq_n_f32(width / 2);
+    unsigned int i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        float32x4_t l = vld1q_f32(&left[i]), r = vld1q_f32(&right[i]);
+        float32x4_t power = vmlaq_f32(vmulq_f32(l, l), r, r);
+        float32x4_t total = vaddq_f32(l, r);
+        uint32x4_t valid = vcgtq_f32(total, zero);
+        float32x4_t p;
+
+        vst1q_f32(&green[i], vmulq_f32(vld1q_f32(&green_w[i]), power));
+        vst1q_f32(&other[i], vmulq_f32(vld1q_f32(&other_w[i]), power));
+
+        p = vaddq_f32(vdivq_f32(vmulq_f32(last, r), total),
+                      vdupq_n_f32(0.5f));
+        p = vminq_f32(vmaxq_f32(p, zero), last);
+        p = vbslq_f32(valid, p, centre);
+        vst1q_s32(&pos[i], vcvtq_s32_f32(p));
+    }
+    weigh_bins_scalar(&left[i], &right[i], &green_w[i], &other_w[i], n - i,
+                      width, &pos[i], &green[i], &other[i]);
+}
+
+static inline uint32x4_t clip_neon(float32x4_t v) {
+    v = vaddq_f32(v, vdupq_n_f32(0.5f));
+    v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(0.0f)), vdupq_n_f32(255.0f));
+    return vcvtq_u32_f32(v);
+}
+
+static void pack_pixels_neon(const float *r, const float *g, const float *b,
+                             uint32_t *out, unsigned int n, int rshift,
+                             int gshift, int bshift) {
+    const int32x4_t rs = vdupq_n_s32(rshift);
+    const int32x4_t gs = vdupq_n_s32(gshift);
+    const int32x4_t bs = vdupq_n_s32(bshift);
+    unsigned int i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        uint32x4_t p = vorrq_u32(
+            vorrq_u32(vshlq_u32(clip_neon(vld1q_f32(&r[i])), rs),
+                      vshlq_u32(clip_neon(vld1q_f32(&g[i])), gs)),
+            vshlq_u32(clip_neon(vld1q_f32(&b[i])), bs));
+        vst1q_u32(&out[i], p);
+    }
+    pack_pixels_scalar(&r[i], &g[i], &b[i], &out[i], n - i,
+                       rshift, gshift, bshift);
+}
+
+static void sqrt_scale_neon(float *p, unsigned int n, float scale) {
+    unsigned int i;
+    for (i = 0; i + 4 <= n; i += 4) {
+        vst1q_f32(&p[i], vmulq_n_f32(vsqrtq_f32(vld1q_f32(&p[i])), scale));
+    }
+    sqrt_scale_scalar(&p[i], n - i, scale);
+}
+#endif /* RGBM_SIMD_NEON && RGBM_FLOAT */
+
+#ifndef RGBM_FLOAT
+/*
+ * Double precision deinterleaving, converting each half of a float
+ * vector to doubles after separating channels
+ */
+
+#ifdef RGBM_SIMD_X86
+__attribute__((target("sse2")))
+static void deinterleave_sse2(const float *pcm, double *left, double *right,
+                              unsigned int n) {
+    unsigned int i;
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128 a = _mm_loadu_ps(&pcm[i * 2]);
+        __m128 b = _mm_loadu_ps(&pcm[i * 2 + 4]);
+        __m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        _mm_storeu_pd(&left[i], _mm_cvtps_pd(l));
+        _mm_storeu_pd(&left[i + 2], _mm_cvtps_pd(_mm_movehl_ps(l, l)));
+        _mm_storeu_pd(&right[i], _mm_cvtps_pd(r));
+        _mm_storeu_pd(&right[i + 2], _mm_cvtps_pd(_mm_movehl_ps(r, r)));
+    }
+    deinterleave_scalar(&pcm[i * 2], &left[i], &right[i], n - i);
+}
+
+/* Shuffles work within 128-bit lanes, so 64-bit pairs are permuted
+ * back into order before each half is widened to doubles */
+__attribute__((target("avx2")))
+static void deinterleave_pcm_avx2(const float *pcm, double *left,
+                                  double *right, unsigned int n) {
+    unsigned int i;
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256 a = _mm256_loadu_ps(&pcm[i * 2]);
+        __m256 b = _mm256_loadu_ps(&pcm[i * 2 + 8]);
+        __m256 l = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(
+                   _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))), 0xd8));
+        __m256 r = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(
+                   _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), 0xd8));
+        _mm256_storeu_pd(&left[i],
+                         _mm256_cvtps_pd(_mm256_castps256_ps128(l)));
+        _mm256_storeu_pd(&left[i + 4],
+                         _mm256_cvtps_pd(_mm256_extractf128_ps(l, 1)));
+        _mm256_storeu_pd(&right[i],
+                         _mm256_cvtps_pd(_mm256_castps256_ps128(r)));
+        _mm256_storeu_pd(&right[i + 4],
+                         _mm256_cvtps_pd(_mm256_extractf128_ps(r, 1)));
+    }
+    deinterleave_scalar(&pcm[i * 2], &left[i], &right[i], n - i);
+}
+#endif /* RGBM_SIMD_X86 */
+
+#ifdef RGBM_SIMD_NEON
+static void deinterleave_neon(const float *pcm, double *left, double *right,
+                              unsigned int n) {
+    unsigned int i;
+    for (i = 0; i + 4 <= n; i += 4) {
+        float32x4x2_t lr = vld2q_f32(&pcm[i * 2]);
+        vst1q_f64(&left[i], vcvt_f64_f32(vget_low_f32(lr.val[0])));
+        vst1q_f64(&left[i + 2], vcvt_high_f64_f32(lr.val[0]));
+        vst1q_f64(&right[i], vcvt_f64_f32(vget_low_f32(lr.val[1])));
+        vst1q_f64(&right[i + 2], vcvt_high_f64_f32(lr.val[1]));
+    }
+    deinterleave_scalar(&pcm[i * 2], &left[i], &right[i], n - i);
+}
+#endif /* RGBM_SIMD_NEON */
+#endif /* !RGBM_FLOAT */
+
+/*
+ * Selection
+ */
+
+#ifdef RGBM_SIMD_ANALYSIS
+void (*rgbm_pack_window)(const RGBM_SAMPTYPE *left,
+                         const RGBM_SAMPTYPE *right,
+                         const RGBM_SAMPTYPE *window,
+                         RGBM_SAMPTYPE *cplx, unsigned int n) =
+    pack_window_scalar;
+void (*rgbm_split_magnitude)(const RGBM_SAMPTYPE *cplx,
+                             RGBM_BINTYPE *left, RGBM_BINTYPE *right,
+                             unsigned int bins, unsigned int n) =
+    split_magnitude_scalar;
+#endif
+void (*rgbm_deinterleave)(const float *pcm, RGBM_SAMPTYPE *left,
+                          RGBM_SAMPTYPE *right, unsigned int n) =
+    deinterleave_scalar;
+#ifdef RGBM_SIMD_ANALYSIS
+void (*rgbm_weigh_bins)(const RGBM_BINTYPE *left, const RGBM_BINTYPE *right,
+                        const RGBM_STRIPETYPE *green_w,
+                        const RGBM_STRIPETYPE *other_w,
+                        unsigned int n, unsigned int width, int *pos,
+                        RGBM_STRIPETYPE *green, RGBM_STRIPETYPE *other) =
+    weigh_bins_scalar;
+void (*rgbm_sqrt_scale)(RGBM_STRIPETYPE *p, unsigned int n,
+                        RGBM_STRIPETYPE scale) = sqrt_scale_scalar;
+#endif
+void (*rgbm_pack_pixels)(const RGBM_STRIPETYPE *r, const RGBM_STRIPETYPE *g,
+                         const RGBM_STRIPETYPE *b, uint32_t *out,
+                         unsigned int n, int rshift, int gshift,
+                         int bshift) = pack_pixels_scalar;
+
+#if defined(RGBM_SIMD_X86) || defined(RGBM_SIMD_NEON)
+/* True if name is allowed by the RGBM_SIMD environment variable */
+static int simd_allowed(const char *name) {
+    const char *force = getenv("RGBM_SIMD");
+    return force == NULL || !strcmp(force, name);
+}
+#endif
+
+const char *rgbm_simd_init(void) {
+#ifdef RGBM_SIMD_X86
+    __builtin_cpu_init();
+    if (simd_allowed("avx2") && __builtin_cpu_supports("avx2")) {
+        rgbm_deinterleave = deinterleave_pcm_avx2;
+#ifdef RGBM_FLOAT
+        rgbm_pack_window = pack_window_avx2;
+        rgbm_split_magnitude = split_magnitude_avx2;
+        rgbm_weigh_bins = weigh_bins_avx2;
+        rgbm_sqrt_scale = sqrt_scale_avx2;
+        rgbm_pack_pixels = pack_pixels_avx2;
+#endif
+        return "avx2";
+    }
+    if (simd_allowed("sse2") && __builtin_cpu_supports("sse2")) {
+        rgbm_deinterleave = deinterleave_sse2;
+#ifdef RGBM_FLOAT
+        rgbm_pack_window = pack_window_sse2;
+        rgbm_split_magnitude = split_magnitude_sse2;
+        rgbm_weigh_bins = weigh_bins_sse2;
+        rgbm_sqrt_scale = sqrt_scale_sse2;
+        rgbm_pack_pixels = pack_pixels_sse2;
+#endif
+        return "sse2";
+    }
+#endif
+#ifdef RGBM_SIMD_NEON
+    if (simd_allowed("neon")) {
+        rgbm_deinterleave = deinterleave_neon;
+#ifdef RGBM_FLOAT
+        rgbm_pack_window = pack_window_neon;
+        rgbm_split_magnitude = split_magnitude_neon;
+        rgbm_weigh_bins = weigh_bins_neon;
+        rgbm_sqrt_scale = sqrt_scale_neon;
+        rgbm_pack_pixels = pack_pixels_neon;
+#endif
+        return "neon";
+    }
+#endif
+#ifdef RGBM_SIMD_ANALYSIS
+    rgbm_pack_window = pack_window_scalar;
+    rgbm_split_magnitude = split_magnitude_scalar;
+#endif
+    rgbm_deinterleave = deinterleave_scalar;
+#ifdef RGBM_SIMD_ANALYSIS
+    rgbm_weigh_bins = weigh_bins_scalar;
+    rgbm_sqrt_scale = sqrt_scale_scalar;
+#endif
+    rgbm_pack_pixels = pack_pixels_scalar;
+    return "scalar";
+}
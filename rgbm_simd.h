@@ -0,0 +1,64 @@
+/* Header file for vectorized colour waterfall kernels. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#ifndef _RGBM_SIMD_H_
+#define _RGBM_SIMD_H_
+
+#include "rgbm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The fixed point engine has its own analysis code, so only the
+ * input and display kernels exist with RGBM_FIXED. */
+#ifndef RGBM_FIXED
+/* Window left and right samples, interleaving them as complex numbers
+ * with left in the real part and right in the imaginary part. */
+extern void (*rgbm_pack_window)(const RGBM_SAMPTYPE *left,
+                                const RGBM_SAMPTYPE *right,
+                                const RGBM_SAMPTYPE *window,
+                                RGBM_SAMPTYPE *cplx, unsigned int n);
+/* Separate spectra of two real channels packed as left + i * right in an
+ * n point complex FFT, and store amplitudes of bins 1 to bins - 1.
+ * Bins must be at most n / 2. */
+extern void (*rgbm_split_magnitude)(const RGBM_SAMPTYPE *cplx,
+                                    RGBM_BINTYPE *left, RGBM_BINTYPE *right,
+                                    unsigned int bins, unsigned int n);
+#endif
+/* Separate n frames of interleaved stereo PCM into left and right */
+extern void (*rgbm_deinterleave)(const float *pcm, RGBM_SAMPTYPE *left,
+                                 RGBM_SAMPTYPE *right, unsigned int n);
+#ifndef RGBM_FIXED
+/* For bins 0 to n - 1, compute power weighted by green_w for green and
+ * by other_w for red or blue, and the stripe position from left/right
+ * balance. Bins with no amplitude are placed at the centre. */
+extern void (*rgbm_weigh_bins)(const RGBM_BINTYPE *left,
+                               const RGBM_BINTYPE *right,
+                               const RGBM_STRIPETYPE *green_w,
+                               const RGBM_STRIPETYPE *other_w,
+                               unsigned int n, unsigned int width, int *pos,
+                               RGBM_STRIPETYPE *green,
+                               RGBM_STRIPETYPE *other);
+/* p[i] = sqrt(p[i]) * scale */
+extern void (*rgbm_sqrt_scale)(RGBM_STRIPETYPE *p, unsigned int n,
+                               RGBM_STRIPETYPE scale);
+#endif
+/* Round and saturate like display_clip(), and pack each pixel into 32
+ * bits with the colours shifted left by rshift, gshift and bshift. */
+extern void (*rgbm_pack_pixels)(const RGBM_STRIPETYPE *r,
+                                const RGBM_STRIPETYPE *g,
+                                const RGBM_STRIPETYPE *b, uint32_t *out,
+                                unsigned int n, int rshift, int gshift,
+                                int bshift);
+
+/* Select the fastest kernels supported by this CPU. The RGBM_SIMD
+ * environment variable can force scalar, sse2, avx2 or neon. Returns
+ * the name of the selected kernels. */
+const char *rgbm_simd_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !_RGBM_SIMD_H_ */
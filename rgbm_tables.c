@@ -0,0 +1,174 @@
+/* Run time computation of colour waterfall bin weight tables. */
+/* Copyright 2013, 2023 Boris Gjenero. Released under the MIT license. */
+
+#include <stddef.h>
+#include <math.h>
+#include "rgbm_tables.h"
+#include "rgbm_iso226.h"
+
+/* Lowest constant-Q bin, at C1 */
+#define CQ_MIN_HZ 32.703
+
+/* Frequency of bin, following the calibration of the original tables */
+static double bin_hz(unsigned int i, unsigned int numsamp) {
+    return (double)(i + 1) * RGBM_TABLES_RATE / numsamp;
+}
+
+/* Frequency of bin i, from hz if given, otherwise an FFT bin */
+static double table_hz(const double *hz, unsigned int i,
+                       unsigned int numsamp) {
+    return hz != NULL ? hz[i] : bin_hz(i, numsamp);
+}
+
+unsigned int rgbm_tables_usebins(unsigned int numsamp) {
+    return ISO226_TOPFREQ * numsamp / RGBM_TABLES_RATE;
+}
+
+unsigned int rgbm_tables_cq_bins(unsigned int bins_per_octave) {
+    return floor(bins_per_octave * log2(ISO226_TOPFREQ / CQ_MIN_HZ)) + 1;
+}
+
+void rgbm_tables_cq_hz(double *hz, unsigned int bins_per_octave) {
+    unsigned int i, n = rgbm_tables_cq_bins(bins_per_octave);
+
+    for (i = 0; i < n; i++) {
+        hz[i] = CQ_MIN_HZ * pow(2, (double)i / bins_per_octave);
+    }
+}
+
+static double hz_to_pitch(double hz) {
+    return hz <= 0 ? 0 : 69 + 12 * log2(hz / 440);
+}
+
+static unsigned int green(double *green_tab, unsigned int usebins,
+                          const double *hz, unsigned int numsamp) {
+    double first, midpoint;
+    unsigned int i, pivot = 0;
+
+    first = hz_to_pitch(table_hz(hz, 0, numsamp));
+    midpoint = (first + hz_to_pitch(table_hz(hz, usebins - 1, numsamp))) / 2;
+
+    for (i = 0; i < usebins; i++) {
+        double pitch = hz_to_pitch(table_hz(hz, i, numsamp));
+        double g = 1 - fabs(midpoint - pitch) / (midpoint - first);
+        green_tab[i] = g > 0.0 ? g : 0.0;
+        if (green_tab[i] > green_tab[pivot]) pivot = i;
+    }
+    return pivot;
+}
+
+unsigned int rgbm_tables_green(double *green_tab, unsigned int usebins,
+                               unsigned int numsamp) {
+    return green(green_tab, usebins, NULL, numsamp);
+}
+
+unsigned int rgbm_tables_green_hz(double *green_tab, const double *hz,
+                                  unsigned int n) {
+    return green(green_tab, n, hz, 0);
+}
+
+/* Solve n by n system a * x = b in place using Gaussian elimination
+ * with partial pivoting. Result replaces b. */
+static void solve(double a[ISO226_POINTS][ISO226_POINTS], double *b, int n) {
+    int i, j, k;
+
+    for (i = 0; i < n; i++) {
+        int p = i;
+        for (j = i + 1; j < n; j++) {
+            if (fabs(a[j][i]) > fabs(a[p][i])) p = j;
+        }
+        if (p != i) {
+            double t;
+            for (k = 0; k < n; k++) {
+                t = a[i][k]; a[i][k] = a[p][k]; a[p][k] = t;
+            }
+            t = b[i]; b[i] = b[p]; b[p] = t;
+        }
+        for (j = i + 1; j < n; j++) {
+            double f = a[j][i] / a[i][i];
+            for (k = i; k < n; k++) a[j][k] -= f * a[i][k];
+            b[j] -= f * b[i];
+        }
+    }
+    for (i = n - 1; i >= 0; i--) {
+        for (k = i + 1; k < n; k++) b[i] -= a[i][k] * b[k];
+        b[i] /= a[i][i];
+    }
+}
+
+/* Cubic spline through (x, y) with not-a-knot end conditions, like
+ * spline() in Octave. Computes second derivatives m at the knots. */
+static void spline_init(const double *x, const double *y, double *m, int n) {
+    double a[ISO226_POINTS][ISO226_POINTS];
+    int i, j;
+
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < n; j++) a[i][j] = 0.0;
+    }
+
+    for (i = 1; i < n - 1; i++) {
+        double h0 = x[i] - x[i - 1], h1 = x[i + 1] - x[i];
+        a[i][i - 1] = h0;
+        a[i][i] = 2 * (h0 + h1);
+        a[i][i + 1] = h1;
+        m[i] = 6 * ((y[i + 1] - y[i]) / h1 - (y[i] - y[i - 1]) / h0);
+    }
+
+    /* Third derivative is continuous across second and second last knot */
+    a[0][0] = x[2] - x[1];
+    a[0][1] = -(x[2] - x[0]);
+    a[0][2] = x[1] - x[0];
+    m[0] = 0.0;
+    a[n - 1][n - 3] = x[n - 1] - x[n - 2];
+    a[n - 1][n - 2] = -(x[n - 1] - x[n - 3]);
+    a[n - 1][n - 1] = x[n - 2] - x[n - 3];
+    m[n - 1] = 0.0;
+
+    solve(a, m, n);
+}
+
+/* Evaluate spline. Outside the knots, the end polynomials extrapolate. */
+static double spline_eval(const double *x, const double *y, const double *m,
+                          int n, double v) {
+    int i = 0;
+    double h, l, r;
+
+    while (i < n - 2 && v >= x[i + 1]) i++;
+    h = x[i + 1] - x[i];
+    l = v - x[i];
+    r = x[i + 1] - v;
+    return (m[i] * r * r * r + m[i + 1] * l * l * l) / (6 * h) +
+           (y[i] / h - m[i] * h / 6) * r +
+           (y[i + 1] / h - m[i + 1] * h / 6) * l;
+}
+
+static void freq_adj(double *adj, unsigned int usebins, const double *hz,
+                     unsigned int numsamp) {
+    const double phon = 70.0;
+    double peakscale[ISO226_POINTS], m[ISO226_POINTS];
+    unsigned int i;
+
+    for (i = 0; i < ISO226_POINTS; i++) {
+        /* Sound pressure level from loudness level (ISO 226 section 4.1) */
+        double Af = 4.47E-3 * (pow(10, 0.025 * phon) - 1.15) +
+                    pow(0.4 * pow(10, (iso226_Tf[i] + iso226_Lu[i]) / 10 - 9),
+                        iso226_af[i]);
+        double Lp = 10 / iso226_af[i] * log10(Af) - iso226_Lu[i] + 94;
+        peakscale[i] = 1 / pow(10, (Lp - phon) / 20);
+    }
+
+    spline_init(iso226_f, peakscale, m, ISO226_POINTS);
+    for (i = 0; i < usebins; i++) {
+        adj[i] = spline_eval(iso226_f, peakscale, m, ISO226_POINTS,
+                             table_hz(hz, i, numsamp));
+    }
+}
+
+void rgbm_tables_freq_adj(double *adj, unsigned int usebins,
+                          unsigned int numsamp) {
+    freq_adj(adj, usebins, NULL, numsamp);
+}
+
+void rgbm_tables_freq_adj_hz(double *adj, const double *hz, unsigned int n) {
+    freq_adj(adj, n, hz, 0);
+}
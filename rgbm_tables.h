@@ -0,0 +1,42 @@
+/* Header file for computing colour waterfall bin weight tables. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#ifndef _RGBM_TABLES_H_
+#define _RGBM_TABLES_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Sample rate assumed by the tables */
+#define RGBM_TABLES_RATE 44100
+
+/* Number of bins used with an FFT of numsamp samples. Bins stop at
+ * 12.5 kHz, the highest frequency in the ISO 226 tables. */
+unsigned int rgbm_tables_usebins(unsigned int numsamp);
+/* Fill green_tab with weights for summing bin powers to green.
+ * Returns RGBM_PIVOTBIN equivalent: below it, red + green = 1.0,
+ * and at and above it, blue + green = 1.0. Common FFT sizes also have
+ * these tables computed while compiling, in rgbm_engine.cc. */
+unsigned int rgbm_tables_green(double *green_tab, unsigned int usebins,
+                               unsigned int numsamp);
+/* Fill freq_adj with bin amplitude scaling from the 70 phon equal
+ * loudness contour, interpolated using a not-a-knot cubic spline. */
+void rgbm_tables_freq_adj(double *freq_adj, unsigned int usebins,
+                          unsigned int numsamp);
+
+/* Number of constant-Q bins, from C1 up to 12.5 kHz */
+unsigned int rgbm_tables_cq_bins(unsigned int bins_per_octave);
+/* Fill hz with centre frequencies of the constant-Q bins */
+void rgbm_tables_cq_hz(double *hz, unsigned int bins_per_octave);
+/* Same as the above, for n bins with centre frequencies hz */
+unsigned int rgbm_tables_green_hz(double *green_tab, const double *hz,
+                                  unsigned int n);
+void rgbm_tables_freq_adj_hz(double *freq_adj, const double *hz,
+                             unsigned int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !_RGBM_TABLES_H_ */
@@ -21,7 +21,6 @@ static void config(struct MODULETYPE *this_mod) {
                title, MB_OK);
 }
 
-#ifdef RGBM_FFT
 visHelperAPI *vishelper_api = NULL;
 
 static int find_helper(void) {
@@ -40,17 +39,14 @@ static int find_helper(void) {
 
     return 1;
 }
-#endif
 
 static int init(struct MODULETYPE *this_mod) {
-#ifdef RGBM_FFT
     if (!find_helper()) {
         MessageBox(this_mod->hwndParent,
                    "Cannot find visualization helper", title,
                    MB_ICONSTOP | MB_OK);
         return 1;
     }
-#endif
 
     if (rgbm_init()) {
         return 0;
@@ -64,35 +60,26 @@ static int init(struct MODULETYPE *this_mod) {
 
 static void quit(struct MODULETYPE *this_mod) {
     rgbm_shutdown();
-#ifdef RGBM_FFT
     vishelper_api->stop();
-#endif
 }
 
-#ifdef RGBM_FFT
 static void copy_data(const int16_t *input) {
     int i;
-    double *left, *right;
+    RGBM_SAMPTYPE *left, *right;
     rgbm_get_wave_buffers(&left, &right);
 
     for (i = 0; i < RGBM_NUMSAMP; i++) {
-        left[i] = input[i * 2] / 32768.0;
-        right[i] = input[i * 2 + 1] / 32768.0;
+        left[i] = RGBM_SAMPLE_S16(input[i * 2]);
+        right[i] = RGBM_SAMPLE_S16(input[i * 2 + 1]);
     }
 }
-#endif
 
 static int render(struct winampVisModule *this_mod) {
     int noerror;
-#ifdef RGBM_FFT
     int16_t *data = (int16_t *)vishelper_api->get_raw_data(RGBM_NUMSAMP * 4);
     if (data == NULL) return 1;
     copy_data(data);
     noerror = rgbm_render_wave();
-#else
-    noerror = rgbm_render(this_mod->spectrumData[0], 
-                          this_mod->spectrumData[1]);
-#endif
     return noerror ? 0 : 1;
 }
 
@@ -3,9 +3,13 @@
 
 #include <stdbool.h>
 #include <SDL.h>
+#include "display.h"
+#include "rgbm_simd.h"
 
-#define width 640
+#define width DISPLAY_WIDTH
 #define height 480
+/* Minimum time between screen updates in milliseconds */
+#define present_interval 16
 
 static void sdlError(const char *str)
 {
@@ -14,12 +18,28 @@ static void sdlError(const char *str)
     exit(1);
 }
 
-static SDL_Surface *screen, *surface;
+/* History holds the last height rows in a circle. The newest row is at
+ * head, and older ones follow it, wrapping from the bottom to the top. */
+static SDL_Surface *screen, *history;
+static int head = 0;
+static Uint32 last_present;
+/* History has rows which are not on the screen yet */
+static bool dirty;
+/* Bit positions of colours in history's 32-bit pixels */
+static int r_shift, g_shift, b_shift;
+
+static void *sdl_init(const char *arg) {
+    const SDL_PixelFormat *fmt;
+    Uint32 rmask = 0xff0000, gmask = 0x00ff00, bmask = 0x0000ff;
+
+    if (history != NULL) {
+        fprintf(stderr, "Error: only one SDL display is supported\n");
+        return NULL;
+    }
 
-bool display_init(void) {
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         sdlError("initializing SDL");
-        return false;
+        return NULL;
     }
 
     SDL_WM_SetCaption("Colour waterfall visualization",
@@ -29,64 +49,100 @@ bool display_init(void) {
 
     if (!screen) {
         sdlError("setting video mode");
-        return false;
+        return NULL;
     }
 
-    surface = SDL_CreateRGBSurface(SDL_SWSURFACE, width, 1,
-                                   24, 0xff0000, 0x00ff00, 0x0000ff, 0);
+    /* Rows are packed in the screen's own format when it has 32-bit
+     * pixels with 8 bits per colour, as is usual, so blits to the screen
+     * are plain copies. Otherwise SDL converts from 32-bit XRGB. */
+    fmt = screen->format;
+    if (fmt->BytesPerPixel == 4 && fmt->Rloss == 0 && fmt->Gloss == 0 &&
+        fmt->Bloss == 0) {
+        rmask = fmt->Rmask;
+        gmask = fmt->Gmask;
+        bmask = fmt->Bmask;
+    }
+    history = SDL_CreateRGBSurface(SDL_SWSURFACE, width, height,
+                                   32, rmask, gmask, bmask, 0);
 
-    if (!surface) {
+    if (!history) {
         sdlError("creating surface");
-        return false;
+        return NULL;
     }
-
-    return true;
+    r_shift = history->format->Rshift;
+    g_shift = history->format->Gshift;
+    b_shift = history->format->Bshift;
+    SDL_FillRect(history, NULL, 0);
+    head = 0;
+    last_present = SDL_GetTicks();
+    dirty = false;
+
+    return screen;
 }
 
-static unsigned char clip_value(double d) {
-    int t = d + 0.5;
+/* Copies history to the screen, newest row at the top, in two blits */
+static void sdl_present(void) {
+    SDL_Rect src = { 0, head, width, height - head };
+    SDL_Rect dest = { 0, 0, width, height - head };
+
+    SDL_BlitSurface(history, &src, screen, &dest);
+    if (head > 0) {
+        src.y = 0;
+        src.h = head;
+        dest.y = height - head;
+        dest.h = head;
+        SDL_BlitSurface(history, &src, screen, &dest);
+    }
+    SDL_UpdateRect(screen, 0, 0, width, height);
+    last_present = SDL_GetTicks();
+    dirty = false;
+}
 
-    if (t < 0) return 0;
-    if (t > 255) return 255;
-    return t;
+/* Copying to the screen costs time proportional to the window area,
+ * so when rows arrive faster than the display can usefully show them
+ * only the newest state is presented. */
+static void sdl_present_due(void) {
+    if (dirty && SDL_GetTicks() - last_present >= present_interval) {
+        sdl_present();
+    }
 }
 
-bool display_render(double *r, double *g, double *b) {
-    static SDL_Rect scroll_src = { 0, 0, width, height - 1 };
-    static SDL_Rect scroll_dest = { 0, 1, width, height - 1 };
-    int i;
-    unsigned char *p;
+static bool sdl_render(void *state, RGBM_STRIPETYPE *r,
+                       RGBM_STRIPETYPE *g, RGBM_STRIPETYPE *b) {
+    /* Scroll by moving the head up, overwriting the oldest row */
+    head = (head > 0 ? head : height) - 1;
 
-    if SDL_MUSTLOCK(surface) {
-        SDL_LockSurface(surface);
+    if SDL_MUSTLOCK(history) {
+        SDL_LockSurface(history);
     }
-    p = (unsigned char *)(surface->pixels);
-    for (i = 0; i < width; i++) {
-        *(p++) = clip_value(b[i]);
-        *(p++) = clip_value(g[i]);
-        *(p++) = clip_value(r[i]);
+    rgbm_pack_pixels(r, g, b, (uint32_t *)((unsigned char *)history->pixels +
+                                           head * history->pitch),
+                     width, r_shift, g_shift, b_shift);
+    if SDL_MUSTLOCK(history) {
+        SDL_UnlockSurface(history);
     }
-    if SDL_MUSTLOCK(surface) {
-        SDL_UnlockSurface(surface);
-    }
-    SDL_UpdateRect(surface, 0, 0, width, 1);
 
-    SDL_BlitSurface(screen, &scroll_src, screen, &scroll_dest);
-    SDL_BlitSurface(surface, NULL, screen, NULL);
-    SDL_UpdateRect(screen, 0, 0, width, height);
+    dirty = true;
+    sdl_present_due();
     return true;
 }
 
-unsigned int display_width(void)
-{
-    return width;
-}
-
-bool display_pollquit(void) {
+/* Also called while no rows arrive, so the last ones are shown when
+ * they stop, for example at pause or at the end of a file */
+static bool sdl_pollquit(void *state) {
     SDL_Event event;
+
+    sdl_present_due();
     return SDL_PollEvent(&event) != 0 && event.type == SDL_QUIT;
 }
 
-void display_quit(void) {
+static void sdl_quit(void *state) {
+    if (dirty) sdl_present();
+    SDL_FreeSurface(history);
+    history = NULL;
     SDL_Quit();
 }
+
+const struct display_backend display_sdl = {
+    "sdl", sdl_init, sdl_render, sdl_pollquit, sdl_quit
+};
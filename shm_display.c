@@ -0,0 +1,43 @@
+/* Display sink publishing stripes to other processes via shared memory. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "display.h"
+#include "stripeshm.h"
+
+/* Arg is the shm object name, with or without the leading '/' */
+static void *shm_init(const char *arg) {
+    char name[256];
+
+    if (arg == NULL || arg[0] == '\0') arg = STRIPESHM_DEFAULT_NAME;
+    snprintf(name, sizeof(name), "%s%s", arg[0] == '/' ? "" : "/", arg);
+    return stripeshm_create(name, DISPLAY_WIDTH, STRIPESHM_DEFAULT_SLOTS);
+}
+
+static bool shm_render(void *state, RGBM_STRIPETYPE *r,
+                       RGBM_STRIPETYPE *g, RGBM_STRIPETYPE *b) {
+    unsigned char *p = stripeshm_begin(state);
+    int i;
+
+    for (i = 0; i < DISPLAY_WIDTH; i++) {
+        *(p++) = display_clip(r[i]);
+        *(p++) = display_clip(g[i]);
+        *(p++) = display_clip(b[i]);
+    }
+    stripeshm_publish(state);
+    return true;
+}
+
+static bool shm_pollquit(void *state) {
+    return false;
+}
+
+static void shm_quit(void *state) {
+    stripeshm_destroy(state);
+}
+
+const struct display_backend display_shm = {
+    "shm", shm_init, shm_render, shm_pollquit, shm_quit
+};
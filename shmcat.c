@@ -0,0 +1,115 @@
+/* Test consumer for stripes published by the shm display sink. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "stripeshm.h"
+
+/* How long to sleep when no new stripe is available */
+#define POLL_NS 2000000
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-n stripes] [-o file] [shm_name]\n"
+                    "Follows stripes published with -D shm[:name], "
+                    "printing statistics each second.\n"
+                    "  -n stripes  exit after this many stripes\n"
+                    "  -o file     also write rgb24 rows to file, "
+                    "or - for standard output\n"
+                    "The default name is %s\n",
+            name, STRIPESHM_DEFAULT_NAME);
+    exit(-1);
+}
+
+int main(int argc, char **argv) {
+    const char *name = STRIPESHM_DEFAULT_NAME;
+    char namebuf[256];
+    FILE *out = NULL;
+    struct stripeshm *shm;
+    unsigned char *rgb;
+    unsigned long limit = 0, got = 0, lost = 0, sec_got = 0, sec_lost = 0;
+    unsigned int width, i;
+    uint64_t n;
+    time_t last;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:o:")) != -1) {
+        switch (opt) {
+        case 'n':
+            limit = strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            out = strcmp(optarg, "-") ? fopen(optarg, "wb") : stdout;
+            if (out == NULL) {
+                perror(optarg);
+                return -1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind == argc - 1) {
+        name = argv[optind];
+        if (name[0] != '/') {
+            snprintf(namebuf, sizeof(namebuf), "/%s", name);
+            name = namebuf;
+        }
+    } else if (optind != argc) {
+        usage(argv[0]);
+    }
+
+    shm = stripeshm_open(name);
+    if (shm == NULL) return -1;
+    width = stripeshm_width(shm);
+    rgb = calloc(width, 3);
+    if (rgb == NULL) return -1;
+
+    /* Start from the newest stripe, like a live viewer */
+    n = stripeshm_published(shm);
+    last = time(NULL);
+    while (limit == 0 || got < limit) {
+        int res = stripeshm_read(shm, n, rgb);
+
+        if (res == STRIPESHM_OK) {
+            if (out != NULL) fwrite(rgb, 3, width, out);
+            got++;
+            sec_got++;
+            n++;
+        } else if (res == STRIPESHM_LOST) {
+            /* Fell behind, so skip to oldest stripe still available */
+            uint64_t oldest = stripeshm_oldest(shm);
+            if (oldest <= n) oldest = n + 1;
+            lost += oldest - n;
+            sec_lost += oldest - n;
+            n = oldest;
+        } else if (stripeshm_closed(shm)) {
+            break;
+        } else {
+            struct timespec ts = { 0, POLL_NS };
+            nanosleep(&ts, NULL);
+        }
+
+        if (time(NULL) != last) {
+            unsigned long sum[3] = { 0, 0, 0 };
+
+            for (i = 0; i < width * 3; i++) sum[i % 3] += rgb[i];
+            fprintf(stderr, "%lu stripes, %lu lost, last average "
+                            "colour %lu,%lu,%lu\n",
+                    sec_got, sec_lost, sum[0] / width, sum[1] / width,
+                    sum[2] / width);
+            sec_got = 0;
+            sec_lost = 0;
+            last = time(NULL);
+        }
+    }
+
+    fprintf(stderr, "Total %lu stripes, %lu lost%s\n", got, lost,
+            stripeshm_closed(shm) ? ", writer exited" : "");
+    stripeshm_close(shm);
+    free(rgb);
+    if (out != NULL && out != stdout) fclose(out);
+    return 0;
+}
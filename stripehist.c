@@ -0,0 +1,295 @@
+/* Records stripe history in a memory mapped file, for replay and seeking. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "stripehist.h"
+
+#define STRIPEHIST_ALIGN 64
+/* Bytes of rows mapped at once, and how much the file grows at a time */
+#define STRIPEHIST_WINDOW (16 << 20)
+
+struct stripehist {
+    int fd;
+    bool writer;
+    struct stripehist_header *hdr;
+    /* Mapped part of the file, starting at a page boundary */
+    char *win;
+    off_t win_start;
+    size_t win_len, win_max;
+    /* Writer only: allocated file size, time of the first row and the
+     * latest row, and whether rows are timed when they are appended */
+    off_t file_size;
+    uint64_t t0, last;
+    bool clocked;
+};
+
+static uint64_t ts_ns(const struct timespec *ts) {
+    return (uint64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+/* Maps the window containing the row at file offset off. Returns the
+ * row, or NULL if it is beyond the end of the file or mapping failed. */
+static struct stripehist_row *map_row(struct stripehist *hist, off_t off) {
+    size_t row_size = hist->hdr->row_size;
+    off_t start;
+    size_t len;
+
+    if (hist->win != NULL && off >= hist->win_start &&
+        off + row_size <= hist->win_start + hist->win_len)
+        return (struct stripehist_row *)(hist->win + (off - hist->win_start));
+
+    if (hist->win != NULL) {
+        munmap(hist->win, hist->win_len);
+        hist->win = NULL;
+    }
+    start = off & ~(off_t)(sysconf(_SC_PAGESIZE) - 1);
+    len = hist->win_max;
+
+    if (hist->writer) {
+        if (start + len > hist->file_size) {
+            if (ftruncate(hist->fd, start + len) < 0) {
+                perror("Error extending stripe history");
+                return NULL;
+            }
+            hist->file_size = start + len;
+        }
+    } else {
+        struct stat st;
+
+        /* File grows while it is being recorded */
+        if (fstat(hist->fd, &st) < 0 || st.st_size < off + row_size)
+            return NULL;
+        if (start + len > st.st_size) len = st.st_size - start;
+    }
+
+    hist->win = mmap(NULL, len, hist->writer ? PROT_READ | PROT_WRITE :
+                     PROT_READ, MAP_SHARED, hist->fd, start);
+    if (hist->win == MAP_FAILED) {
+        hist->win = NULL;
+        perror("Error mapping stripe history");
+        return NULL;
+    }
+    if (!hist->writer) madvise(hist->win, len, MADV_SEQUENTIAL);
+    hist->win_start = start;
+    hist->win_len = len;
+    return (struct stripehist_row *)(hist->win + (off - start));
+}
+
+static struct stripehist_row *get_row(struct stripehist *hist, uint64_t n) {
+    return map_row(hist, hist->hdr->data_offset +
+                         (off_t)n * hist->hdr->row_size);
+}
+
+static struct stripehist *stripehist_alloc(int fd, bool writer,
+                                           size_t row_size) {
+    struct stripehist *hist = calloc(1, sizeof(struct stripehist));
+    size_t page = sysconf(_SC_PAGESIZE);
+
+    if (hist == NULL) return NULL;
+    hist->fd = fd;
+    hist->writer = writer;
+    /* Any row must fit in a window starting at a page boundary */
+    hist->win_max = STRIPEHIST_WINDOW;
+    if (hist->win_max < row_size + page) {
+        hist->win_max = (row_size + page * 2 - 1) & ~(page - 1);
+    }
+    return hist;
+}
+
+/*
+ * Writer
+ */
+
+struct stripehist *stripehist_create(const char *name, unsigned int width) {
+    struct stripehist *hist;
+    struct stripehist_header *hdr;
+    size_t row_size, data_offset;
+    int fd;
+
+    row_size = (sizeof(struct stripehist_row) + width * 3 + 7) & ~7;
+    data_offset = (sizeof(struct stripehist_header) + STRIPEHIST_ALIGN - 1) &
+                  ~(STRIPEHIST_ALIGN - 1);
+
+    fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(name);
+        return NULL;
+    }
+    if (ftruncate(fd, data_offset) < 0) {
+        perror(name);
+        close(fd);
+        return NULL;
+    }
+    hdr = mmap(NULL, data_offset, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (hdr == MAP_FAILED) {
+        perror(name);
+        close(fd);
+        return NULL;
+    }
+
+    hist = stripehist_alloc(fd, true, row_size);
+    if (hist == NULL) {
+        munmap(hdr, data_offset);
+        close(fd);
+        return NULL;
+    }
+    hist->hdr = hdr;
+    hist->file_size = data_offset;
+
+    hdr->version = STRIPEHIST_VERSION;
+    hdr->width = width;
+    hdr->row_size = row_size;
+    hdr->data_offset = data_offset;
+    hdr->reserved = 0;
+    hdr->start_time = 0;
+    atomic_init(&hdr->rows, 0);
+    /* Readers check magic, so it marks the header as complete */
+    atomic_thread_fence(memory_order_release);
+    hdr->magic = STRIPEHIST_MAGIC;
+
+    return hist;
+}
+
+unsigned char *stripehist_begin(struct stripehist *hist) {
+    struct stripehist_row *row;
+
+    row = get_row(hist, atomic_load_explicit(&hist->hdr->rows,
+                                             memory_order_relaxed));
+    return row != NULL ? row->rgb : NULL;
+}
+
+void stripehist_append(struct stripehist *hist, uint64_t time) {
+    uint64_t n = atomic_load_explicit(&hist->hdr->rows, memory_order_relaxed);
+    struct stripehist_row *row = get_row(hist, n);
+
+    if (row == NULL) return;
+
+    if (n == 0) {
+        struct timespec wall;
+
+        clock_gettime(CLOCK_REALTIME, &wall);
+        hist->hdr->start_time = ts_ns(&wall);
+        hist->clocked = time == 0;
+    }
+    if (hist->clocked) {
+        struct timespec now;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        time = ts_ns(&now);
+    }
+    if (n == 0) {
+        hist->t0 = time;
+        hist->last = 0;
+    }
+    /* Timestamps must not decrease, so they can be searched. A row with
+     * an unknown time gets the time of the row before it. */
+    time = time > hist->t0 ? time - hist->t0 : 0;
+    if (time < hist->last) time = hist->last;
+    hist->last = time;
+    row->time = time;
+    atomic_store_explicit(&hist->hdr->rows, n + 1, memory_order_release);
+}
+
+/*
+ * Reader
+ */
+
+struct stripehist *stripehist_open(const char *name) {
+    struct stripehist *hist;
+    struct stripehist_header hdr;
+    void *p;
+    int fd;
+
+    fd = open(name, O_RDONLY);
+    if (fd < 0) {
+        perror(name);
+        return NULL;
+    }
+    if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        hdr.magic != STRIPEHIST_MAGIC || hdr.version != STRIPEHIST_VERSION ||
+        hdr.width == 0 || hdr.data_offset < sizeof(hdr) ||
+        hdr.row_size < sizeof(struct stripehist_row) + hdr.width * 3) {
+        fprintf(stderr, "Error: %s is not a stripe history\n", name);
+        close(fd);
+        return NULL;
+    }
+
+    p = mmap(NULL, hdr.data_offset, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        perror(name);
+        close(fd);
+        return NULL;
+    }
+    hist = stripehist_alloc(fd, false, hdr.row_size);
+    if (hist == NULL) {
+        munmap(p, hdr.data_offset);
+        close(fd);
+        return NULL;
+    }
+    hist->hdr = p;
+    return hist;
+}
+
+unsigned int stripehist_width(const struct stripehist *hist) {
+    return hist->hdr->width;
+}
+
+uint64_t stripehist_rows(const struct stripehist *hist) {
+    return atomic_load_explicit(&hist->hdr->rows, memory_order_acquire);
+}
+
+uint64_t stripehist_start_time(const struct stripehist *hist) {
+    return hist->hdr->start_time;
+}
+
+const unsigned char *stripehist_row(struct stripehist *hist, uint64_t n,
+                                    uint64_t *time) {
+    struct stripehist_row *row;
+
+    if (n >= stripehist_rows(hist)) return NULL;
+    row = get_row(hist, n);
+    if (row == NULL) return NULL;
+    *time = row->time;
+    return row->rgb;
+}
+
+uint64_t stripehist_seek(struct stripehist *hist, uint64_t time) {
+    uint64_t lo = 0, hi = stripehist_rows(hist);
+
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2, t;
+
+        if (stripehist_row(hist, mid, &t) == NULL) return hi;
+        if (t < time) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void stripehist_close(struct stripehist *hist) {
+    uint64_t rows = atomic_load_explicit(&hist->hdr->rows,
+                                         memory_order_relaxed);
+    size_t data_offset = hist->hdr->data_offset;
+
+    if (hist->win != NULL) munmap(hist->win, hist->win_len);
+    if (hist->writer) {
+        /* Remove the unused part of the last window */
+        if (ftruncate(hist->fd, data_offset +
+                      (off_t)rows * hist->hdr->row_size) < 0) {
+            perror("Error truncating stripe history");
+        }
+    }
+    munmap(hist->hdr, data_offset);
+    close(hist->fd);
+    free(hist);
+}
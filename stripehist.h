@@ -0,0 +1,83 @@
+/* Header file for recording stripe history in a memory mapped file. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#ifndef _STRIPEHIST_H_
+#define _STRIPEHIST_H_
+
+/*
+ * The file holds a header followed by rows of equal size. Row n begins
+ * at data_offset + n * row_size, with a timestamp followed by width
+ * pixels of red, green and blue bytes. Timestamps never decrease, so
+ * they form an index which is searched to seek to a time. Only a fixed
+ * size window of the file is mapped at once, so memory use does not
+ * depend on how long the history is.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define STRIPEHIST_MAGIC 0x48535743 /* "CWSH" */
+#define STRIPEHIST_VERSION 1
+
+struct stripehist_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    /* Bytes from start of one row to the next */
+    uint32_t row_size;
+    /* Bytes from start of file to the first row */
+    uint32_t data_offset;
+    uint32_t reserved;
+    /* Wall clock time of the first row, in nanoseconds since 1970 */
+    uint64_t start_time;
+    /* Number of complete rows. The file may be longer while recording. */
+    atomic_ullong rows;
+};
+
+struct stripehist_row {
+    /* Nanoseconds since the first row */
+    uint64_t time;
+    unsigned char rgb[];
+};
+
+struct stripehist;
+
+/*
+ * Writer
+ */
+
+/* Creates or replaces the file. Returns NULL on failure. */
+struct stripehist *stripehist_create(const char *name, unsigned int width);
+/* Returns a buffer for width * 3 bytes of the next row, which is added
+ * by stripehist_append(), or NULL on failure. */
+unsigned char *stripehist_begin(struct stripehist *hist);
+/* Timestamps the row and adds it to the history. Time is the stripe's
+ * position in the stream in nanoseconds, so history replays at the pace
+ * of the audio even if it was rendered faster. If the first row's time
+ * is 0, meaning unknown, all rows are timed by when they are appended. */
+void stripehist_append(struct stripehist *hist, uint64_t time);
+
+/*
+ * Reader. Rows may be read while the file is still being recorded.
+ */
+
+/* Returns NULL on failure */
+struct stripehist *stripehist_open(const char *name);
+unsigned int stripehist_width(const struct stripehist *hist);
+uint64_t stripehist_rows(const struct stripehist *hist);
+uint64_t stripehist_start_time(const struct stripehist *hist);
+/* Returns the pixels of row n and sets *time to its timestamp, or
+ * returns NULL if row n is not available. The pixels remain valid
+ * until the next call. */
+const unsigned char *stripehist_row(struct stripehist *hist, uint64_t n,
+                                    uint64_t *time);
+/* Returns the first row at or after time, or stripehist_rows() if
+ * there is none */
+uint64_t stripehist_seek(struct stripehist *hist, uint64_t time);
+
+/* For both writer and reader. The writer truncates the file to the rows
+ * which were appended. */
+void stripehist_close(struct stripehist *hist);
+
+#endif /* !_STRIPEHIST_H_ */
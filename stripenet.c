@@ -0,0 +1,620 @@
+/* Streams stripes to other hosts as UDP datagrams. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+/* For sendmmsg() and recvmmsg() */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "stripenet.h"
+
+#define SEGMENT_PAYLOAD (STRIPENET_MAX_DATAGRAM - STRIPENET_HEADER_SIZE)
+/* No run takes more than 4 bytes per pixel, and a segment only ends
+ * with less than 4 bytes left, so each covers at least this many */
+#define SEGMENT_MIN_PIXELS ((SEGMENT_PAYLOAD - 3) / 4)
+
+/* Results of take_datagram() */
+#define DGRAM_NONE 0
+#define DGRAM_STRIPE 1
+#define DGRAM_END 2
+
+struct stripenet {
+    int fd;
+    unsigned int width;
+    struct stripenet_stats stats;
+    /* Datagram buffers, with a message for each */
+    unsigned char *dgrams;
+    struct mmsghdr *msgs;
+    struct iovec *iov;
+
+    /* Sender: next sequence number, previous stripe for delta coding,
+     * and stripes and datagrams waiting to be sent */
+    uint32_t seq;
+    unsigned char *prev;
+    unsigned int batch, max_segments, queued_stripes, queued;
+    bool warned;
+
+    /* Receiver: stripe being assembled in row, from segments in seen,
+     * and last complete stripe in last */
+    unsigned char *row, *last;
+    bool started, assembling, undecodable, have_last;
+    uint32_t next_seq, cur_seq, last_seq;
+    unsigned int segs_seen, segs_total;
+    unsigned char seen[32];
+    /* Datagrams received but not yet taken */
+    unsigned int pending, next_msg;
+};
+
+static void put16(unsigned char *p, unsigned int v) {
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void put32(unsigned char *p, uint32_t v) {
+    put16(p, v >> 16);
+    put16(p + 2, v);
+}
+
+static unsigned int get16(const unsigned char *p) {
+    return (p[0] << 8) | p[1];
+}
+
+static uint32_t get32(const unsigned char *p) {
+    return ((uint32_t)get16(p) << 16) | get16(p + 2);
+}
+
+static void put_header(unsigned char *d, unsigned int flags,
+                       unsigned int width, uint32_t seq, unsigned int first,
+                       unsigned int count, unsigned int index) {
+    memcpy(d, STRIPENET_MAGIC, 4);
+    d[4] = STRIPENET_VERSION;
+    d[5] = flags;
+    put16(d + 6, width);
+    put32(d + 8, seq);
+    put16(d + 12, first);
+    put16(d + 14, count);
+    d[16] = index;
+    d[17] = 0;
+}
+
+/* Splits HOST:PORT at the last ':', so HOST may be an IPv6 address,
+ * optionally in brackets. Without ':', all of s is the port and host
+ * is empty. */
+static bool split_dest(const char *s, char *host, size_t size,
+                       const char **port) {
+    const char *colon = strrchr(s, ':');
+    size_t len;
+
+    if (colon == NULL) {
+        host[0] = '\0';
+        *port = s;
+        return true;
+    }
+    len = colon - s;
+    if (len >= 2 && s[0] == '[' && s[len - 1] == ']') {
+        s++;
+        len -= 2;
+    }
+    if (len >= size) return false;
+    memcpy(host, s, len);
+    host[len] = '\0';
+    *port = colon + 1;
+    return true;
+}
+
+static void free_net(struct stripenet *net) {
+    if (net->fd >= 0) close(net->fd);
+    free(net->dgrams);
+    free(net->msgs);
+    free(net->iov);
+    free(net->prev);
+    free(net->row);
+    free(net->last);
+    free(net);
+}
+
+/* Allocates count datagram buffers with messages pointing at them */
+static bool alloc_msgs(struct stripenet *net, unsigned int count) {
+    unsigned int i;
+
+    net->dgrams = malloc((size_t)count * STRIPENET_MAX_DATAGRAM);
+    net->msgs = calloc(count, sizeof(struct mmsghdr));
+    net->iov = calloc(count, sizeof(struct iovec));
+    if (net->dgrams == NULL || net->msgs == NULL || net->iov == NULL)
+        return false;
+    for (i = 0; i < count; i++) {
+        net->iov[i].iov_base = &net->dgrams[i * STRIPENET_MAX_DATAGRAM];
+        net->iov[i].iov_len = STRIPENET_MAX_DATAGRAM;
+        net->msgs[i].msg_hdr.msg_iov = &net->iov[i];
+        net->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    return true;
+}
+
+/*
+ * Sender
+ */
+
+static bool same_pixel(const unsigned char *a, const unsigned char *b) {
+    return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+}
+
+/* Encodes pixels from first into at most space bytes at out, with skip
+ * runs where pixels equal prev, unless it is NULL. Sets len to the
+ * bytes used and returns the number of pixels encoded. */
+static unsigned int encode_segment(const unsigned char *rgb,
+                                   const unsigned char *prev,
+                                   unsigned int first, unsigned int width,
+                                   unsigned char *out, size_t space,
+                                   size_t *len) {
+    unsigned int i = first, n;
+    size_t o = 0, literal = 0;
+    bool in_literal = false;
+
+    while (i < width) {
+        const unsigned char *p = &rgb[i * 3];
+
+        if (prev != NULL && same_pixel(p, &prev[i * 3])) {
+            if (o + 1 > space) break;
+            for (n = 1; n < STRIPENET_RUN_MAX && i + n < width &&
+                        same_pixel(&rgb[(i + n) * 3], &prev[(i + n) * 3]);
+                 n++);
+            out[o++] = STRIPENET_SKIP + n - 1;
+            in_literal = false;
+        } else {
+            for (n = 1; n < STRIPENET_RUN_MAX && i + n < width &&
+                        same_pixel(&rgb[(i + n) * 3], p);
+                 n++);
+            if (n >= 2) {
+                if (o + 4 > space) break;
+                out[o++] = STRIPENET_RUN + n - 1;
+                in_literal = false;
+            } else if (in_literal &&
+                       out[literal] + 1 < STRIPENET_LITERAL_MAX) {
+                if (o + 3 > space) break;
+                out[literal]++;
+            } else {
+                if (o + 4 > space) break;
+                literal = o;
+                out[o++] = 0;
+                in_literal = true;
+            }
+            memcpy(&out[o], p, 3);
+            o += 3;
+        }
+        i += n;
+    }
+    *len = o;
+    return i - first;
+}
+
+static void queue_stripe(struct stripenet *net, const unsigned char *rgb) {
+    bool delta = net->seq % STRIPENET_KEY_INTERVAL != 0;
+    unsigned int first = 0, segs = 0, i;
+
+    while (first < net->width) {
+        struct iovec *iov = &net->iov[net->queued + segs];
+        unsigned char *d = iov->iov_base;
+        unsigned int n;
+        size_t len;
+
+        n = encode_segment(rgb, delta ? net->prev : NULL, first, net->width,
+                           d + STRIPENET_HEADER_SIZE, SEGMENT_PAYLOAD, &len);
+        put_header(d, delta ? STRIPENET_DELTA : 0, net->width, net->seq,
+                   first, n, segs);
+        iov->iov_len = STRIPENET_HEADER_SIZE + len;
+        first += n;
+        segs++;
+    }
+    for (i = 0; i < segs; i++) {
+        ((unsigned char *)net->iov[net->queued + i].iov_base)[17] = segs;
+    }
+
+    memcpy(net->prev, rgb, net->width * 3);
+    net->seq++;
+    net->queued += segs;
+    net->queued_stripes++;
+    net->stats.stripes++;
+}
+
+static void flush_queue(struct stripenet *net) {
+    unsigned int sent = 0, i;
+    bool retried = false;
+
+    while (sent < net->queued) {
+        int res = sendmmsg(net->fd, &net->msgs[sent], net->queued - sent, 0);
+
+        if (res > 0) {
+            for (i = sent; i < sent + res; i++) {
+                net->stats.bytes += net->msgs[i].msg_len;
+            }
+            net->stats.datagrams += res;
+            sent += res;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == ECONNREFUSED && !retried) {
+            /* Unicast to a port without a receiver reports the error on
+             * a later send, which then didn't happen, so try again */
+            retried = true;
+        } else {
+            /* Datagrams are independent, so just give up on these */
+            if (errno != EAGAIN && errno != EWOULDBLOCK &&
+                errno != ECONNREFUSED && !net->warned) {
+                perror("Error sending stripes");
+                net->warned = true;
+            }
+            break;
+        }
+    }
+    net->stats.lost += net->queued - sent;
+    net->queued = 0;
+    net->queued_stripes = 0;
+}
+
+struct stripenet *stripenet_create(const char *dest, unsigned int width,
+                                   unsigned int batch) {
+    struct stripenet *net;
+    struct addrinfo hints, *res, *ai;
+    char host[256];
+    const char *port;
+    int err;
+
+    if (dest == NULL || dest[0] == '\0') dest = STRIPENET_DEFAULT_DEST;
+    if (!split_dest(dest, host, sizeof(host), &port) || host[0] == '\0') {
+        fprintf(stderr, "Error: network destination must be HOST:PORT\n");
+        return NULL;
+    }
+    if (width == 0 || width > STRIPENET_MAX_WIDTH || batch == 0 ||
+        batch > STRIPENET_MAX_BATCH) {
+        fprintf(stderr, "Error: network sink needs a width up to %u and "
+                        "1 to %u stripes per batch\n",
+                STRIPENET_MAX_WIDTH, STRIPENET_MAX_BATCH);
+        return NULL;
+    }
+
+    net = calloc(1, sizeof(struct stripenet));
+    if (net == NULL) return NULL;
+    net->width = width;
+    net->batch = batch;
+    net->max_segments = width / SEGMENT_MIN_PIXELS + 1;
+    net->prev = malloc(width * 3);
+    if (net->prev == NULL || !alloc_msgs(net, batch * net->max_segments)) {
+        fprintf(stderr, "Error initializing network sink\n");
+        net->fd = -1;
+        free_net(net);
+        return NULL;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    err = getaddrinfo(host, port, &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "Error: %s: %s\n", dest, gai_strerror(err));
+        net->fd = -1;
+        free_net(net);
+        return NULL;
+    }
+    /* Multicast keeps the default TTL of 1, so it stays on the local
+     * network, and is looped back to receivers on this host. */
+    net->fd = -1;
+    for (ai = res; ai != NULL; ai = ai->ai_next) {
+        net->fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (net->fd < 0) continue;
+        if (connect(net->fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        close(net->fd);
+        net->fd = -1;
+    }
+    freeaddrinfo(res);
+    if (net->fd < 0) {
+        perror(dest);
+        free_net(net);
+        return NULL;
+    }
+    fcntl(net->fd, F_SETFL, fcntl(net->fd, F_GETFL) | O_NONBLOCK);
+    return net;
+}
+
+void stripenet_send(struct stripenet *net, const unsigned char *rgb) {
+    queue_stripe(net, rgb);
+    if (net->queued_stripes >= net->batch) flush_queue(net);
+}
+
+void stripenet_destroy(struct stripenet *net) {
+    unsigned char end[STRIPENET_HEADER_SIZE];
+
+    flush_queue(net);
+    put_header(end, STRIPENET_END, net->width, net->seq, 0, 0, 0);
+    if (send(net->fd, end, sizeof(end), 0) < 0 && errno == ECONNREFUSED)
+        send(net->fd, end, sizeof(end), 0);
+    free_net(net);
+}
+
+/*
+ * Receiver
+ */
+
+static bool is_multicast(const struct sockaddr *sa) {
+    if (sa->sa_family == AF_INET) {
+        const struct sockaddr_in *sin = (const struct sockaddr_in *)sa;
+        return IN_MULTICAST(ntohl(sin->sin_addr.s_addr));
+    } else if (sa->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *)sa;
+        return IN6_IS_ADDR_MULTICAST(&sin6->sin6_addr);
+    }
+    return false;
+}
+
+/* Binds to the port of group on all addresses, and joins the group */
+static bool join_group(int fd, const struct addrinfo *ai) {
+    struct sockaddr_storage any;
+
+    memcpy(&any, ai->ai_addr, ai->ai_addrlen);
+    if (ai->ai_family == AF_INET) {
+        const struct sockaddr_in *sin =
+            (const struct sockaddr_in *)ai->ai_addr;
+        struct ip_mreq mreq;
+
+        ((struct sockaddr_in *)&any)->sin_addr.s_addr = htonl(INADDR_ANY);
+        if (bind(fd, (struct sockaddr *)&any, ai->ai_addrlen) < 0)
+            return false;
+        mreq.imr_multiaddr = sin->sin_addr;
+        mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+        return setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq,
+                          sizeof(mreq)) == 0;
+    } else {
+        const struct sockaddr_in6 *sin6 =
+            (const struct sockaddr_in6 *)ai->ai_addr;
+        struct ipv6_mreq mreq;
+
+        ((struct sockaddr_in6 *)&any)->sin6_addr = in6addr_any;
+        if (bind(fd, (struct sockaddr *)&any, ai->ai_addrlen) < 0)
+            return false;
+        mreq.ipv6mr_multiaddr = sin6->sin6_addr;
+        mreq.ipv6mr_interface = 0;
+        return setsockopt(fd, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mreq,
+                          sizeof(mreq)) == 0;
+    }
+}
+
+struct stripenet *stripenet_listen(const char *addr) {
+    struct stripenet *net;
+    struct addrinfo hints, *res, *ai;
+    char host[256];
+    const char *port;
+    int err, one = 1;
+
+    if (addr == NULL || addr[0] == '\0') addr = STRIPENET_DEFAULT_DEST;
+    if (!split_dest(addr, host, sizeof(host), &port)) {
+        fprintf(stderr, "Error: network address must be [HOST:]PORT\n");
+        return NULL;
+    }
+
+    net = calloc(1, sizeof(struct stripenet));
+    if (net == NULL) return NULL;
+    net->fd = -1;
+    if (!alloc_msgs(net, STRIPENET_MAX_BATCH)) {
+        free_net(net);
+        return NULL;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_PASSIVE;
+    err = getaddrinfo(host[0] != '\0' ? host : NULL, port, &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "Error: %s: %s\n", addr, gai_strerror(err));
+        free_net(net);
+        return NULL;
+    }
+    for (ai = res; ai != NULL; ai = ai->ai_next) {
+        bool ok;
+
+        net->fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (net->fd < 0) continue;
+        /* Several receivers on one host can follow the same group */
+        setsockopt(net->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (is_multicast(ai->ai_addr)) {
+            ok = join_group(net->fd, ai);
+        } else {
+            ok = bind(net->fd, ai->ai_addr, ai->ai_addrlen) == 0;
+        }
+        if (ok) break;
+        close(net->fd);
+        net->fd = -1;
+    }
+    freeaddrinfo(res);
+    if (net->fd < 0) {
+        perror(addr);
+        free_net(net);
+        return NULL;
+    }
+    fcntl(net->fd, F_SETFL, fcntl(net->fd, F_GETFL) | O_NONBLOCK);
+    return net;
+}
+
+static bool set_width(struct stripenet *net, unsigned int width) {
+    free(net->row);
+    free(net->last);
+    net->row = malloc(width * 3);
+    net->last = malloc(width * 3);
+    net->width = net->row != NULL && net->last != NULL ? width : 0;
+    net->started = false;
+    net->assembling = false;
+    net->have_last = false;
+    return net->width != 0;
+}
+
+static void start_stripe(struct stripenet *net, uint32_t seq,
+                         unsigned int flags, unsigned int total) {
+    /* The previous stripe is incomplete, and those between it and
+     * this one never arrived */
+    if (net->assembling) net->stats.lost++;
+    if (net->started) net->stats.lost += seq - net->next_seq;
+
+    net->started = true;
+    net->assembling = true;
+    net->next_seq = seq + 1;
+    net->cur_seq = seq;
+    net->segs_seen = 0;
+    net->segs_total = total;
+    memset(net->seen, 0, sizeof(net->seen));
+
+    /* Delta stripes need the one before, until the next key stripe */
+    net->undecodable = (flags & STRIPENET_DELTA) &&
+                       !(net->have_last && net->last_seq == seq - 1);
+    if ((flags & STRIPENET_DELTA) && !net->undecodable)
+        memcpy(net->row, net->last, net->width * 3);
+}
+
+/* Decodes count pixels from first, from len bytes at p, into row.
+ * Returns false if they don't encode exactly that many pixels. */
+static bool decode_segment(struct stripenet *net, const unsigned char *p,
+                           size_t len, unsigned int first,
+                           unsigned int count, bool delta) {
+    const unsigned char *end = p + len;
+    unsigned char *out = &net->row[first * 3];
+    unsigned int n, i;
+
+    while (count > 0) {
+        unsigned int c;
+
+        if (p >= end) return false;
+        c = *(p++);
+        if (c < STRIPENET_RUN) {
+            n = c + 1;
+            if (n > count || end - p < n * 3) return false;
+            memcpy(out, p, n * 3);
+            p += n * 3;
+        } else if (c < STRIPENET_SKIP) {
+            n = (c & 0x3f) + 1;
+            if (n > count || end - p < 3) return false;
+            for (i = 0; i < n; i++) memcpy(&out[i * 3], p, 3);
+            p += 3;
+        } else {
+            /* Pixels were copied from the previous stripe */
+            n = (c & 0x3f) + 1;
+            if (n > count || !delta) return false;
+        }
+        out += n * 3;
+        count -= n;
+    }
+    return p == end;
+}
+
+static int take_datagram(struct stripenet *net, const unsigned char *d,
+                         size_t len) {
+    unsigned int flags, width, first, count, index, total;
+    uint32_t seq;
+
+    if (len < STRIPENET_HEADER_SIZE || memcmp(d, STRIPENET_MAGIC, 4) ||
+        d[4] != STRIPENET_VERSION) return DGRAM_NONE;
+    flags = d[5];
+    width = get16(d + 6);
+    seq = get32(d + 8);
+    first = get16(d + 12);
+    count = get16(d + 14);
+    index = d[16];
+    total = d[17];
+    net->stats.datagrams++;
+    net->stats.bytes += len;
+
+    if (flags & STRIPENET_END) {
+        if (net->assembling) net->stats.lost++;
+        net->started = false;
+        net->assembling = false;
+        net->have_last = false;
+        return DGRAM_END;
+    }
+    if (width == 0 || width > STRIPENET_MAX_WIDTH || index >= total ||
+        first + count > width) return DGRAM_NONE;
+    if (width != net->width && !set_width(net, width)) return DGRAM_NONE;
+
+    if (!net->assembling || seq != net->cur_seq) {
+        int32_t age = net->next_seq - seq;
+
+        /* Late datagrams of stripes already given up on are ignored.
+         * Sequence numbers from much further back mean the sender
+         * restarted. */
+        if (net->started && age > 0 && age <= STRIPENET_KEY_INTERVAL)
+            return DGRAM_NONE;
+        if (net->started && age > 0) net->started = false;
+        start_stripe(net, seq, flags, total);
+    }
+    if (net->undecodable) return DGRAM_NONE;
+    if (total != net->segs_total || index >= sizeof(net->seen) * 8 ||
+        (net->seen[index / 8] & (1 << (index % 8)))) return DGRAM_NONE;
+    if (!decode_segment(net, d + STRIPENET_HEADER_SIZE,
+                        len - STRIPENET_HEADER_SIZE, first, count,
+                        flags & STRIPENET_DELTA)) {
+        net->undecodable = true;
+        return DGRAM_NONE;
+    }
+    net->seen[index / 8] |= 1 << (index % 8);
+    if (++net->segs_seen < total) return DGRAM_NONE;
+
+    /* Complete, so it becomes the last stripe */
+    {
+        unsigned char *t = net->last;
+        net->last = net->row;
+        net->row = t;
+    }
+    net->have_last = true;
+    net->last_seq = seq;
+    net->assembling = false;
+    net->stats.stripes++;
+    return DGRAM_STRIPE;
+}
+
+const unsigned char *stripenet_receive(struct stripenet *net,
+                                       int timeout_ms, unsigned int *width,
+                                       bool *ended) {
+    struct pollfd pfd = { net->fd, POLLIN, 0 };
+    int res;
+
+    *ended = false;
+    while (true) {
+        while (net->next_msg < net->pending) {
+            struct mmsghdr *m = &net->msgs[net->next_msg++];
+
+            if (m->msg_hdr.msg_flags & MSG_TRUNC) continue;
+            res = take_datagram(net, m->msg_hdr.msg_iov->iov_base,
+                                m->msg_len);
+            if (res == DGRAM_END) {
+                *ended = true;
+                return NULL;
+            } else if (res == DGRAM_STRIPE) {
+                *width = net->width;
+                return net->last;
+            }
+        }
+
+        if (poll(&pfd, 1, timeout_ms) <= 0) return NULL;
+        res = recvmmsg(net->fd, net->msgs, STRIPENET_MAX_BATCH, MSG_DONTWAIT,
+                       NULL);
+        if (res <= 0) return NULL;
+        net->pending = res;
+        net->next_msg = 0;
+        /* Only wait once, so callers get control back regularly even if
+         * datagrams keep arriving without completing stripes */
+        timeout_ms = 0;
+    }
+}
+
+void stripenet_close(struct stripenet *net) {
+    free_net(net);
+}
+
+void stripenet_stats(const struct stripenet *net,
+                     struct stripenet_stats *stats) {
+    *stats = net->stats;
+}
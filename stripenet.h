@@ -0,0 +1,106 @@
+/* Header file for streaming stripes to other hosts over UDP. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#ifndef _STRIPENET_H_
+#define _STRIPENET_H_
+
+/*
+ * Each stripe is sent as one or more datagrams, each covering a range
+ * of pixels. A datagram has a STRIPENET_HEADER_SIZE byte header, with
+ * multibyte fields big endian:
+ *
+ *   0  magic "CWSN"        8  stripe sequence number, 32 bits
+ *   4  version             12 first pixel, 16 bits
+ *   5  flags               14 pixel count, 16 bits
+ *   6  width, 16 bits      16 segment index, and 17 segment count
+ *
+ * The pixels follow as a sequence of runs, each starting with a control
+ * byte c. Literal runs are c + 1 pixels of red, green and blue bytes,
+ * for c below STRIPENET_RUN. Repeat runs are one pixel used for
+ * (c & 0x3f) + 1 pixels. Skip runs leave (c & 0x3f) + 1 pixels the same
+ * as in the previous stripe, and are only allowed in delta stripes.
+ * Key stripes, without STRIPENET_DELTA, are sent every
+ * STRIPENET_KEY_INTERVAL stripes, so a receiver which missed part of a
+ * stripe can resume from the next one.
+ *
+ * Receivers detect lost datagrams from gaps in sequence numbers and
+ * from stripes with missing segments. A datagram with STRIPENET_END and
+ * no segments tells receivers the sender stopped.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define STRIPENET_MAGIC "CWSN"
+#define STRIPENET_VERSION 1
+#define STRIPENET_HEADER_SIZE 18
+/* Stripe is encoded relative to the previous one */
+#define STRIPENET_DELTA 1
+/* Sender stopped */
+#define STRIPENET_END 2
+
+/* Control bytes of runs */
+#define STRIPENET_RUN 0x80
+#define STRIPENET_SKIP 0xc0
+#define STRIPENET_LITERAL_MAX 128
+#define STRIPENET_RUN_MAX 64
+
+/* Datagrams stay below the usual 1500 byte Ethernet MTU */
+#define STRIPENET_MAX_DATAGRAM 1400
+#define STRIPENET_KEY_INTERVAL 16
+#define STRIPENET_MAX_WIDTH 16384
+/* Used when no destination is given. Multicast is looped back to
+ * receivers on the sending host. */
+#define STRIPENET_DEFAULT_DEST "239.255.67.87:7687"
+/* Stripes sent together by one sendmmsg(). More save system calls,
+ * but the first stripe in a batch waits for the others. */
+#define STRIPENET_DEFAULT_BATCH 1
+#define STRIPENET_MAX_BATCH 64
+
+struct stripenet;
+
+/* Counts since the sender or receiver was created */
+struct stripenet_stats {
+    unsigned long stripes, datagrams;
+    uint64_t bytes;
+    /* Sender: datagrams not sent. Receiver: stripes lost, including
+     * delta stripes skipped until the next key stripe. */
+    unsigned long lost;
+};
+
+/*
+ * Sender
+ */
+
+/* Dest is HOST:PORT, where HOST may be a multicast group. Stripes are
+ * width pixels wide, and sent batch at a time. Returns NULL on failure
+ * after printing an error. */
+struct stripenet *stripenet_create(const char *dest, unsigned int width,
+                                   unsigned int batch);
+/* Queues a stripe of width * 3 bytes of red, green and blue, sending
+ * the queue when it holds the batch. Datagrams which can't be sent
+ * right away are dropped and counted as lost. */
+void stripenet_send(struct stripenet *net, const unsigned char *rgb);
+/* Sends queued stripes and the end marker, then closes */
+void stripenet_destroy(struct stripenet *net);
+
+/*
+ * Receiver
+ */
+
+/* Addr is [HOST:]PORT. With a multicast group as HOST, it is joined.
+ * Otherwise, HOST is the local address to listen on. Returns NULL on
+ * failure after printing an error. */
+struct stripenet *stripenet_listen(const char *addr);
+/* Waits up to timeout_ms for the next complete stripe. Returns its
+ * pixels, valid until the next call, and sets width, or returns NULL
+ * on timeout or error. Sets ended if the sender stopped. */
+const unsigned char *stripenet_receive(struct stripenet *net,
+                                       int timeout_ms, unsigned int *width,
+                                       bool *ended);
+void stripenet_close(struct stripenet *net);
+
+void stripenet_stats(const struct stripenet *net,
+                     struct stripenet_stats *stats);
+
+#endif /* !_STRIPENET_H_ */
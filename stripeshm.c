@@ -0,0 +1,230 @@
+/* Shares stripes with other processes through a POSIX shm ring. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "stripeshm.h"
+
+/* Keeps header and slots on separate cache lines */
+#define STRIPESHM_ALIGN 64
+
+struct stripeshm {
+    struct stripeshm_header *hdr;
+    size_t size;
+    char *name;
+    /* Next stripe to write, for the writer only */
+    uint64_t next;
+};
+
+static struct stripeshm_slot *get_slot(const struct stripeshm *shm,
+                                       uint64_t n) {
+    const struct stripeshm_header *hdr = shm->hdr;
+    return (struct stripeshm_slot *)((char *)shm->hdr + hdr->data_offset +
+                                     (size_t)(n % hdr->slots) *
+                                     hdr->slot_size);
+}
+
+/*
+ * Writer
+ */
+
+struct stripeshm *stripeshm_create(const char *name, unsigned int width,
+                                   unsigned int slots) {
+    struct stripeshm *shm;
+    struct stripeshm_header *hdr;
+    size_t slot_size, data_offset;
+    unsigned int i;
+    int fd;
+
+    slot_size = (sizeof(struct stripeshm_slot) + width * 3 +
+                 STRIPESHM_ALIGN - 1) & ~(STRIPESHM_ALIGN - 1);
+    data_offset = (sizeof(struct stripeshm_header) + STRIPESHM_ALIGN - 1) &
+                  ~(STRIPESHM_ALIGN - 1);
+
+    shm = malloc(sizeof(struct stripeshm));
+    if (shm == NULL) return NULL;
+    shm->name = strdup(name);
+    shm->size = data_offset + slot_size * slots;
+    shm->next = 0;
+    if (shm->name == NULL) {
+        free(shm);
+        return NULL;
+    }
+
+    /* Readers of an older object keep it until they see it closed */
+    shm_unlink(name);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        perror(name);
+        goto fail;
+    }
+    if (ftruncate(fd, shm->size) < 0) {
+        perror(name);
+        close(fd);
+        shm_unlink(name);
+        goto fail;
+    }
+    hdr = mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (hdr == MAP_FAILED) {
+        perror(name);
+        shm_unlink(name);
+        goto fail;
+    }
+
+    shm->hdr = hdr;
+    hdr->width = width;
+    hdr->slots = slots;
+    hdr->slot_size = slot_size;
+    hdr->data_offset = data_offset;
+    atomic_init(&hdr->closed, 0);
+    hdr->reserved = 0;
+    atomic_init(&hdr->published, 0);
+    for (i = 0; i < slots; i++) {
+        atomic_init(&get_slot(shm, i)->seq, 0);
+    }
+    hdr->version = STRIPESHM_VERSION;
+    /* Readers check magic last, so it marks the header as complete */
+    atomic_thread_fence(memory_order_release);
+    hdr->magic = STRIPESHM_MAGIC;
+
+    return shm;
+
+fail:
+    free(shm->name);
+    free(shm);
+    return NULL;
+}
+
+unsigned char *stripeshm_begin(struct stripeshm *shm) {
+    struct stripeshm_slot *slot = get_slot(shm, shm->next);
+
+    /* Odd sequence number tells readers the slot is changing */
+    atomic_store_explicit(&slot->seq, shm->next * 2 + 1,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    return slot->rgb;
+}
+
+void stripeshm_publish(struct stripeshm *shm) {
+    struct stripeshm_slot *slot = get_slot(shm, shm->next);
+
+    atomic_store_explicit(&slot->seq, shm->next * 2 + 2,
+                          memory_order_release);
+    shm->next++;
+    atomic_store_explicit(&shm->hdr->published, shm->next,
+                          memory_order_release);
+}
+
+void stripeshm_destroy(struct stripeshm *shm) {
+    atomic_store_explicit(&shm->hdr->closed, 1, memory_order_release);
+    munmap(shm->hdr, shm->size);
+    shm_unlink(shm->name);
+    free(shm->name);
+    free(shm);
+}
+
+/*
+ * Reader
+ */
+
+struct stripeshm *stripeshm_open(const char *name) {
+    struct stripeshm *shm;
+    struct stripeshm_header hdr;
+    struct stat st;
+    void *p;
+    int fd;
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        perror(name);
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < sizeof(hdr) ||
+        pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        hdr.magic != STRIPESHM_MAGIC || hdr.version != STRIPESHM_VERSION ||
+        hdr.slots == 0 ||
+        st.st_size < hdr.data_offset + (off_t)hdr.slots * hdr.slot_size) {
+        fprintf(stderr, "Error: %s is not a usable stripe ring\n", name);
+        close(fd);
+        return NULL;
+    }
+
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        perror(name);
+        return NULL;
+    }
+
+    shm = malloc(sizeof(struct stripeshm));
+    if (shm == NULL) {
+        munmap(p, st.st_size);
+        return NULL;
+    }
+    shm->hdr = p;
+    shm->size = st.st_size;
+    shm->name = NULL;
+    shm->next = 0;
+    return shm;
+}
+
+void stripeshm_close(struct stripeshm *shm) {
+    munmap(shm->hdr, shm->size);
+    free(shm);
+}
+
+unsigned int stripeshm_width(const struct stripeshm *shm) {
+    return shm->hdr->width;
+}
+
+uint64_t stripeshm_published(const struct stripeshm *shm) {
+    return atomic_load_explicit(&shm->hdr->published, memory_order_acquire);
+}
+
+uint64_t stripeshm_oldest(const struct stripeshm *shm) {
+    uint64_t published = stripeshm_published(shm);
+
+    /* The slot after the newest one may be getting overwritten */
+    if (published < shm->hdr->slots) return 0;
+    return published - shm->hdr->slots + 1;
+}
+
+bool stripeshm_closed(const struct stripeshm *shm) {
+    return atomic_load_explicit(&shm->hdr->closed, memory_order_acquire);
+}
+
+const unsigned char *stripeshm_peek(const struct stripeshm *shm,
+                                    uint64_t n) {
+    struct stripeshm_slot *slot = get_slot(shm, n);
+
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != n * 2 + 2)
+        return NULL;
+    return slot->rgb;
+}
+
+bool stripeshm_check(const struct stripeshm *shm, uint64_t n) {
+    struct stripeshm_slot *slot = get_slot(shm, n);
+
+    /* Orders earlier reads of pixels before reading the sequence */
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&slot->seq, memory_order_relaxed) ==
+           n * 2 + 2;
+}
+
+int stripeshm_read(const struct stripeshm *shm, uint64_t n,
+                   unsigned char *rgb) {
+    const unsigned char *p;
+
+    if (n >= stripeshm_published(shm)) return STRIPESHM_NOT_YET;
+
+    p = stripeshm_peek(shm, n);
+    if (p == NULL) return STRIPESHM_LOST;
+    memcpy(rgb, p, shm->hdr->width * 3);
+    return stripeshm_check(shm, n) ? STRIPESHM_OK : STRIPESHM_LOST;
+}
@@ -0,0 +1,96 @@
+/* Header file for sharing stripes with other processes via POSIX shm. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#ifndef _STRIPESHM_H_
+#define _STRIPESHM_H_
+
+/*
+ * The shared memory object holds a header followed by a ring of slots.
+ * Stripe n is in slot n % slots, as width pixels of red, green and blue
+ * bytes. Each slot has a sequence number, which is odd while the slot
+ * is being written and 2 * n + 2 once it holds stripe n. A reader can
+ * use stripe n if the sequence number was 2 * n + 2 both before and
+ * after reading the pixels. Readers never write, so any number of them
+ * can follow at their own pace.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define STRIPESHM_MAGIC 0x53535743 /* "CWSS" */
+#define STRIPESHM_VERSION 1
+/* Name used when none is given. Names must begin with '/'. */
+#define STRIPESHM_DEFAULT_NAME "/colourwaterfall"
+/* Enough for several seconds of stripes at usual rates */
+#define STRIPESHM_DEFAULT_SLOTS 512
+
+struct stripeshm_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t slots;
+    /* Bytes from start of one slot to the next */
+    uint32_t slot_size;
+    /* Bytes from start of object to the first slot */
+    uint32_t data_offset;
+    /* Set when the writer exits. A new writer creates a new object. */
+    atomic_uint closed;
+    uint32_t reserved;
+    /* Number of stripes published so far */
+    atomic_ullong published;
+};
+
+struct stripeshm_slot {
+    atomic_ullong seq;
+    unsigned char rgb[];
+};
+
+/* Results of stripeshm_read() */
+#define STRIPESHM_OK 0
+/* Stripe was not published yet */
+#define STRIPESHM_NOT_YET 1
+/* Stripe was overwritten by a newer one */
+#define STRIPESHM_LOST 2
+
+struct stripeshm;
+
+/*
+ * Writer
+ */
+
+/* Creates or replaces the named object. Returns NULL on failure. */
+struct stripeshm *stripeshm_create(const char *name, unsigned int width,
+                                   unsigned int slots);
+/* Returns a buffer for width * 3 bytes of the next stripe, which is
+ * published by stripeshm_publish(). */
+unsigned char *stripeshm_begin(struct stripeshm *shm);
+void stripeshm_publish(struct stripeshm *shm);
+/* Marks the object closed and removes its name */
+void stripeshm_destroy(struct stripeshm *shm);
+
+/*
+ * Reader
+ */
+
+/* Returns NULL on failure */
+struct stripeshm *stripeshm_open(const char *name);
+void stripeshm_close(struct stripeshm *shm);
+unsigned int stripeshm_width(const struct stripeshm *shm);
+/* Number of stripes published, so the newest is this minus one */
+uint64_t stripeshm_published(const struct stripeshm *shm);
+/* Oldest stripe which is not yet being overwritten */
+uint64_t stripeshm_oldest(const struct stripeshm *shm);
+/* True after the writer has exited */
+bool stripeshm_closed(const struct stripeshm *shm);
+/* Copies stripe n into rgb, which holds width * 3 bytes */
+int stripeshm_read(const struct stripeshm *shm, uint64_t n,
+                   unsigned char *rgb);
+/* For reading in place: returns the pixels of stripe n, or NULL if
+ * stripe n is not available. The pixels may be overwritten at any time,
+ * so once done with them, use stripeshm_check() to see if they were. */
+const unsigned char *stripeshm_peek(const struct stripeshm *shm,
+                                    uint64_t n);
+bool stripeshm_check(const struct stripeshm *shm, uint64_t n);
+
+#endif /* !_STRIPESHM_H_ */
@@ -0,0 +1,107 @@
+/* Analysis window shared by all sources of interleaved PCM. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#include <stdbool.h>
+#include <string.h>
+#include "rgbm.h"
+#include "wavefeed.h"
+
+static RGBM_SAMPTYPE *left_samp = NULL, *right_samp = NULL;
+/* Most recent num_samp frames, from which output blocks are built */
+static int16_t window[RGBM_MAX_NUMSAMP * 2];
+static unsigned int num_samp;
+/* Frames between output blocks, and frames since the last one */
+static unsigned int hop_size, pending;
+/* With the sliding DFT, new frames go straight to analysis */
+static bool sliding;
+/* Capture time of frame number stamp_frame, counting appended frames */
+static uint64_t stamp_ns, stamp_frame, frames_appended;
+static unsigned int stamp_rate;
+/* Sample rate of a file, for tagging rows with their position in it */
+static unsigned int stream_rate;
+
+void wavefeed_init(unsigned int hop) {
+    rgbm_get_wave_buffers(&left_samp, &right_samp);
+    num_samp = rgbm_num_samples();
+    memset(window, 0, sizeof(window));
+    hop_size = hop;
+    pending = 0;
+    sliding = rgbm_analysis() == RGBM_ANALYSIS_SDFT;
+    stamp_ns = 0;
+    frames_appended = 0;
+    stream_rate = 0;
+}
+
+void wavefeed_stream_rate(unsigned int rate) {
+    stream_rate = rate;
+}
+
+void wavefeed_timestamp(uint64_t ns, unsigned int rate) {
+    stamp_ns = ns;
+    stamp_frame = frames_appended;
+    stamp_rate = rate;
+}
+
+static void wavefeed_append(const int16_t *frames, unsigned int count) {
+    int i;
+
+    frames_appended += count;
+    if (sliding) {
+        /* Wave buffers are unused, so they hold the converted frames */
+        for (i = 0; i < count; i++) {
+            left_samp[i] = RGBM_SAMPLE_S16(frames[i * 2]);
+            right_samp[i] = RGBM_SAMPLE_S16(frames[i * 2 + 1]);
+        }
+        rgbm_push_samples(left_samp, right_samp, count);
+        return;
+    }
+    memmove(&window[0], &window[count * 2],
+            (num_samp - count) * 2 * sizeof(int16_t));
+    memcpy(&window[(num_samp - count) * 2], frames,
+           count * 2 * sizeof(int16_t));
+}
+
+int wavefeed_render(void) {
+    int i;
+
+    if (stamp_ns != 0 && frames_appended > stamp_frame) {
+        rgbm_set_capture_time(stamp_ns + (frames_appended - stamp_frame - 1) *
+                                         1000000000ULL / stamp_rate);
+    }
+    if (stream_rate != 0) {
+        rgbm_set_stream_time(frames_appended * 1000000000ULL / stream_rate);
+    }
+    if (sliding) return rgbm_render_sliding();
+    /* rgbm_render_wave() destroys its input, so convert every time. */
+    for (i = 0; i < num_samp; i++) {
+        left_samp[i] = RGBM_SAMPLE_S16(window[i * 2]);
+        right_samp[i] = RGBM_SAMPLE_S16(window[i * 2 + 1]);
+    }
+    return rgbm_render_wave();
+}
+
+int wavefeed_push(const int16_t *frames, unsigned long count) {
+    /* A block may contain several hops, each producing a frame. */
+    while (count > 0) {
+        unsigned int n = hop_size - pending;
+        if (n > count) n = count;
+        wavefeed_append(frames, n);
+        frames += n * 2;
+        count -= n;
+        pending += n;
+        if (pending == hop_size) {
+            pending = 0;
+            if (!wavefeed_render()) return false;
+        }
+    }
+    return true;
+}
+
+unsigned int wavefeed_needed(void) {
+    return hop_size - pending;
+}
+
+void wavefeed_resync(const int16_t *frames, unsigned int count) {
+    wavefeed_append(frames, count);
+    pending = 0;
+}
@@ -0,0 +1,36 @@
+/* Header file for feeding interleaved PCM to the visualization. */
+/* Copyright 2013 Boris Gjenero. Released under the MIT license. */
+
+#ifndef _WAVEFEED_H_
+#define _WAVEFEED_H_
+
+#include <stdint.h>
+
+/* Default number of new frames between rendered output blocks */
+#define WAVEFEED_DEFAULT_HOP (RGBM_NUMSAMP * 2 / 3)
+
+/* Call after rgbm_init(). Hop must be from 1 to rgbm_num_samples(). */
+void wavefeed_init(unsigned int hop);
+/* Append interleaved stereo frames to the analysis window, rendering
+ * an output block each time hop new frames have accumulated. Returns
+ * false when visualization should end. */
+int wavefeed_push(const int16_t *frames, unsigned long count);
+/* Number of frames still needed before the next output block */
+unsigned int wavefeed_needed(void);
+/* Append up to rgbm_num_samples() frames without rendering, for catching up
+ * after falling behind. Partial progress towards the next hop is lost. */
+void wavefeed_resync(const int16_t *frames, unsigned int count);
+/* Render the current window. Returns false when visualization should end. */
+int wavefeed_render(void);
+/* Sets the CLOCK_MONOTONIC capture time in nanoseconds of the next frame
+ * to be appended, with later frames following at rate per second.
+ * Rendered rows are tagged with the time of their newest frame. A time
+ * of 0 means unknown, which is the default. */
+void wavefeed_timestamp(uint64_t ns, unsigned int rate);
+/* Sets the sample rate of a file being fed, so rendered rows are also
+ * tagged with their position in it, counting from the first frame
+ * appended after wavefeed_init(). A rate of 0, the default, means live
+ * input without positions. */
+void wavefeed_stream_rate(unsigned int rate);
+
+#endif /* !_WAVEFEED_H_ */